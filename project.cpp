@@ -5,15 +5,44 @@
 #endif
 
 #include <GL/freeglut.h>
+#include <GL/glext.h>
+#if defined(__linux__)
+#  define HAVE_HEADLESS_EGL 1  // --headless renders through a surfaceless EGL context
+#  include <EGL/egl.h>
+#  include <EGL/eglext.h>
+#endif
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <vector>
+#include <cstdio>
 #include <cstdlib>
+#include <iostream>
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <map>
 #include <chrono>
 #include <ctime>
-#include <direct.h>
+#include <deque>
+#include <queue>
+#include <memory>
+#include <new>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#if defined(__SSE2__) || defined(_M_X64) || defined(__AVX__)
+#  include <immintrin.h>  // Span filling in the software rasterizer
+#endif
+#ifdef _WIN32
+#  include <direct.h>
+#else
+#  include <sys/stat.h>
+#endif
 
 int winW = 1000, winH = 700;
 float viewportTopY = 20.0f;  // Current viewport top Y coordinate (updated in reshape)
@@ -21,17 +50,13 @@ float viewportTopY = 20.0f;  // Current viewport top Y coordinate (updated in re
 // Color struct definition (needed before Firecracker struct)
 struct Color { float r, g, b; };
 
-// Rocket animation state
-float rocketAnimTime = 0.0f;      // Animation progress (0.0 to 1.0)
+// Rocket animation settings
 float rocketSpeed = 0.0083f;      // Animation speed (completes in ~2 seconds at 60fps)
 
-// Drone animation state
-float droneAnimTime = 0.0f;       // Animation progress (0.0 to 1.0)
+// Drone animation settings
 float droneSpeed = 0.00238f;      // Animation speed (completes in ~7 seconds at 60fps)
-bool droneDirection = true;       // true = DIU→City, false = City→DIU
 
-// Cloud animation state
-float cloudOffsetX = 0.0f;        // Current X offset for cloud movement
+// Cloud animation settings
 float cloudSpeed = 0.008f;        // Cloud movement speed (slower - pixels per frame)
 float cloudLoopWidth = 80.0f;     // Width of the loop (when cloud goes beyond this, reset)
 float cloudYPositions[6];         // Random Y positions for each cloud (initialized once)
@@ -42,69 +67,274 @@ float vehicleOffsetX = 0.0f;      // Current X offset for vehicle movement
 float vehicleSpeed = 0.05f;       // Vehicle movement speed
 float vehicleLoopWidth = 80.0f;   // Width of the loop
 
-// Flag animation state
-float flagWaveTime = 0.0f;        // Time for flag waving animation
+// Flag animation settings
 float flagWaveSpeed = 0.05f;      // Flag wave animation speed
 
-// Building destruction state
-bool cityBuildingDestroyed = false;
-float explosionTime = 0.0f;      // Time since explosion (increases after impact)
+// Building destruction settings
 float explosionSpeed = 0.02f;    // Speed of explosion animation
-int missileHitCount = 0;          // Number of times missile has hit (max 2)
-bool missileAttackActive = false; // Whether missiles should continue launching (starts false)
 float programStartTime = 0.0f;    // Time when program started (in seconds)
 float missileDelay = 10.0f;       // Delay before first missile launches (10 seconds)
 float secondMissileDelay = 4.0f;  // Delay before second missile launches after first hit (4 seconds)
-float firstMissileHitTime = -1.0f; // Time when first missile hit (-1 if not hit yet)
-bool timeInitialized = false;     // Whether timer has been initialized
-int startTime = 0;                // Start time for delay calculation
-int countdownValue = 10;          // Countdown timer value (10 to 0)
-int lastFrameTime = 0;            // Last frame time for deltaTime calculation
-float deltaTime = 0.0167f;        // Frame time delta (defaults to 60 FPS)
-
-// Firecracker jubilation state
-struct Firecracker {
-    float x, y;                   // Current position
-    float vx, vy;                 // Velocity components
+float deltaTime = 0.0167f;        // Simulation step in seconds (one fixed tick)
+
+// -------------------------------------------------------------
+// Entities
+// -------------------------------------------------------------
+// The crowd and the firework shells are entities. Every entity with the
+// same set of components lives in one Archetype, whose components are kept
+// column by column (all positions together, all walkers together, ...), so
+// a system walks straight down the columns it needs and skips archetypes
+// that lack them. An Entity handle names a slot plus the slot's generation;
+// despawning bumps the generation, so an old handle never finds the entity
+// that reuses the slot. Despawns swap the archetype's last row into the
+// hole, so columns stay packed.
+struct Entity {
+    uint32_t index;               // Slot in EntityWorld::slots
+    uint32_t generation;          // Slot's generation when the handle was made
+
+    bool operator==(const Entity& o) const { return index == o.index && generation == o.generation; }
+    bool operator!=(const Entity& o) const { return !(*this == o); }
+};
+
+enum ComponentBit : uint32_t {
+    COMP_POSITION     = 1u << 0,
+    COMP_VELOCITY     = 1u << 1,
+    COMP_WALKER       = 1u << 2,
+    COMP_PERSON_STATE = 1u << 3,
+    COMP_CELEBRATION  = 1u << 4,
+    COMP_SHIRT        = 1u << 5,
+    COMP_SHELL        = 1u << 6,
+    COMP_BURST        = 1u << 7,
+    COMP_GOAL         = 1u << 8
+};
+
+struct Position { float x, y; };
+struct Velocity { float vx, vy; };                // Per tick at 60 Hz
+
+struct Walker {
+    float speed;                  // Walking speed (units per second)
+    float walkCycle;              // Walking animation cycle (0.0 to 1.0)
+};
+
+enum PersonState : uint8_t {
+    PERSON_TO_CITY,               // Walking towards City University
+    PERSON_TO_DIU,                // Walking back to DIU
+    PERSON_CELEBRATING            // Stopped in front of DIU, raising/lowering hands
+};
+
+struct Celebration { float cycle; };              // Celebration animation cycle (0.0 to 1.0)
+struct Goal { float x, y; };                      // A celebrating person's spot in front of DIU
+
+struct Shell {                    // A firework climbing before it bursts
     float launchAngle;            // Launch angle in degrees
     float travelDistance;         // Distance traveled
     float maxDistance;            // Distance before explosion
+    int trajectoryType;           // 0=straight up, 1=-x then up, 2=+x then up
+};
+
+struct Burst {
     bool exploded;                // Whether it has exploded
     float explosionTime;          // Time since explosion (0.0 to 2.0)
-    int trajectoryType;           // 0=straight up, 1=-x then up, 2=+x then up
-    Color color;                   // Random color (red, yellow, blue, green)
+    Color color;                  // Random color (red, yellow, blue, green)
+    unsigned int seed;            // Burst pattern: every spark is derived from it (see drawFireworkSparks)
 };
 
-// People animation state
-struct Person {
-    float x, y;                   // Position on road
-    float walkCycle;              // Walking animation cycle (0.0 to 1.0)
-    bool walkingToCity;           // Walking towards City University
-    bool walkingToDIU;            // Walking back to DIU
-    bool stopped;                 // Stopped in front of DIU
-    bool celebrating;             // Celebrating (raising/lowering hands)
-    float celebrationCycle;       // Celebration animation cycle (0.0 to 1.0)
-    Color shirtColor;             // Random shirt color
-    float speed;                  // Walking speed
+const uint32_t ARCH_PERSON = COMP_POSITION | COMP_WALKER | COMP_PERSON_STATE | COMP_CELEBRATION | COMP_SHIRT | COMP_GOAL;
+const uint32_t ARCH_FIRECRACKER = COMP_POSITION | COMP_VELOCITY | COMP_SHELL | COMP_BURST;
+
+struct Archetype {
+    uint32_t mask;                // Components every row has
+    std::vector<Entity> entities; // Row -> handle
+    std::vector<Position> positions;
+    std::vector<Velocity> velocities;
+    std::vector<Walker> walkers;
+    std::vector<PersonState> personStates;
+    std::vector<Celebration> celebrations;
+    std::vector<int> shirts;      // Index into SHIRT_COLORS
+    std::vector<Shell> shells;
+    std::vector<Burst> bursts;
+    std::vector<Goal> goals;
+
+    size_t size() const { return entities.size(); }
+    bool has(uint32_t components) const { return (mask & components) == components; }
+
+    // Call f on each column this archetype has (the entity column included)
+    template <typename F>
+    void forEachColumn(F f) {
+        f(entities);
+        if (mask & COMP_POSITION) f(positions);
+        if (mask & COMP_VELOCITY) f(velocities);
+        if (mask & COMP_WALKER) f(walkers);
+        if (mask & COMP_PERSON_STATE) f(personStates);
+        if (mask & COMP_CELEBRATION) f(celebrations);
+        if (mask & COMP_SHIRT) f(shirts);
+        if (mask & COMP_SHELL) f(shells);
+        if (mask & COMP_BURST) f(bursts);
+        if (mask & COMP_GOAL) f(goals);
+    }
+};
+
+struct EntitySlot {
+    uint32_t generation = 0;
+    int archetype = -1;           // -1 while the slot is free
+    uint32_t row = 0;
+};
+
+struct EntityWorld {
+    std::vector<Archetype> archetypes;
+    std::vector<EntitySlot> slots;
+    std::vector<uint32_t> freeSlots;
+};
+
+int findArchetype(const EntityWorld& world, uint32_t mask) {
+    for (size_t a = 0; a < world.archetypes.size(); ++a) {
+        if (world.archetypes[a].mask == mask) return static_cast<int>(a);
+    }
+    return -1;
+}
+
+// Add an entity with the given components, zeroed. The new row is the last
+// one of the returned archetype; the reference lasts until the next spawn.
+Archetype& spawnEntity(EntityWorld& world, uint32_t mask, Entity* handle = nullptr) {
+    int a = findArchetype(world, mask);
+    if (a < 0) {
+        a = static_cast<int>(world.archetypes.size());
+        world.archetypes.emplace_back();
+        world.archetypes.back().mask = mask;
+    }
+    uint32_t index;
+    if (!world.freeSlots.empty()) {
+        index = world.freeSlots.back();
+        world.freeSlots.pop_back();
+    } else {
+        index = static_cast<uint32_t>(world.slots.size());
+        world.slots.emplace_back();
+    }
+    Archetype& archetype = world.archetypes[a];
+    EntitySlot& slot = world.slots[index];
+    slot.archetype = a;
+    slot.row = static_cast<uint32_t>(archetype.size());
+    archetype.forEachColumn([](auto& column) { column.emplace_back(); });
+    archetype.entities.back() = { index, slot.generation };
+    if (handle) *handle = archetype.entities.back();
+    return archetype;
+}
+
+bool isAlive(const EntityWorld& world, Entity e) {
+    return e.index < world.slots.size() && world.slots[e.index].archetype >= 0 &&
+        world.slots[e.index].generation == e.generation;
+}
+
+void despawnEntity(EntityWorld& world, Entity e) {
+    if (!isAlive(world, e)) return;
+    EntitySlot& slot = world.slots[e.index];
+    Archetype& archetype = world.archetypes[slot.archetype];
+    const uint32_t row = slot.row, last = static_cast<uint32_t>(archetype.size() - 1);
+    if (row != last) {
+        archetype.forEachColumn([&](auto& column) { column[row] = column[last]; });
+        world.slots[archetype.entities[row].index].row = row;
+    }
+    archetype.forEachColumn([](auto& column) { column.pop_back(); });
+    slot.archetype = -1;
+    ++slot.generation;
+    world.freeSlots.push_back(e.index);
+}
+
+// Every archetype that has all of `components`
+template <typename World, typename F>
+void forEachArchetype(World& world, uint32_t components, F f) {
+    for (auto& archetype : world.archetypes) {
+        if (archetype.has(components) && archetype.size() > 0) f(archetype);
+    }
+}
+
+const int NUM_SHIRT_COLORS = 4;
+const Color SHIRT_COLORS[NUM_SHIRT_COLORS] = {
+    {0.8f, 0.2f, 0.2f},  // Red
+    {0.2f, 0.2f, 0.8f},  // Blue
+    {0.2f, 0.8f, 0.2f},  // Green
+    {0.8f, 0.8f, 0.2f}   // Yellow
 };
 
-const int MAX_PEOPLE = 30;
-Person people[MAX_PEOPLE];
-int numPeople = 30;
-bool peopleInitialized = false;
+const int MAX_PEOPLE = 1000000;
+int numPeople = 30;               // Crowd size (--people command-line option)
 
-const int MAX_FIRECRACKERS = 7;
-Firecracker firecrackers[MAX_FIRECRACKERS];
-bool firecrackersInitialized = false;
-bool firecrackersActive = false;
-float firecrackerJubilationTime = 0.0f;  // Overall animation time
+const int MAX_FIRECRACKERS = 7;          // Most shells in one batch
 float firecrackerDelay = 4.0f;            // Delay before firecrackers launch (4 seconds after building destruction)
-float buildingDestroyedTime = -1.0f;     // Time when building was destroyed (-1 if not destroyed yet)
 
-// Sound effect state
-bool rocketSoundPlayed = false;      // Track if rocket sound was played for current launch
-bool explosionSoundPlayed = false;  // Track if explosion sound was played
-bool firecrackerSoundPlayed = false; // Track if firecracker sound was played
+// Missiles staged or in flight, one array per field (see Missile Salvos).
+// Removing one moves the last into its place, so the live ones stay packed.
+struct MissilePool {
+    std::vector<float> launchTime;    // Simulation seconds (may be still to come)
+    std::vector<float> fromX, fromY;  // Launch point
+    std::vector<float> toX, toY;      // Impact point
+    std::vector<float> arc;           // Peak height above the straight line between them
+
+    size_t count() const { return launchTime.size(); }
+
+    void launch(float time, float x0, float y0, float x1, float y1, float height) {
+        launchTime.push_back(time);
+        fromX.push_back(x0);
+        fromY.push_back(y0);
+        toX.push_back(x1);
+        toY.push_back(y1);
+        arc.push_back(height);
+    }
+
+    void remove(size_t i) {
+        for (std::vector<float>* a : { &launchTime, &fromX, &fromY, &toX, &toY, &arc }) {
+            (*a)[i] = a->back();
+            a->pop_back();
+        }
+    }
+};
+
+// Everything the simulation advances, one copy per tick. The simulation owns
+// `sim` (on its own thread unless --no-sim-thread); drawing code only reads
+// the published copy through `view`, so the two never touch the same state.
+struct SimState {
+    long long tick = 0;               // Ticks run (0 = set up, nothing moved yet)
+    double clock = 0.0;               // Clock reading this tick's state belongs to
+
+    // Missiles
+    float missileClock = 0.0f;        // Seconds since the start, the time missiles are placed at
+    MissilePool missiles;             // The salvo in the air (and any still to leave the roof)
+    int missileHitCount = 0;          // Salvos that have landed (the second brings the building down)
+    bool missileAttackActive = false; // Whether a salvo is in the air
+    float firstMissileHitTime = -1.0f; // Time when first missile hit (-1 if not hit yet)
+    int countdownValue = 10;          // Countdown timer value (10 to 0)
+
+    // Drone
+    float droneAnimTime = 0.0f;       // Animation progress (0.0 to 1.0)
+    bool droneDirection = true;       // true = DIU→City, false = City→DIU
+
+    // Sky and flags
+    float cloudOffsetX = 0.0f;        // Current X offset for cloud movement
+    float flagWaveTime = 0.0f;        // Time for flag waving animation
+    float starTwinkleTime = 0.0f;     // Seconds of star twinkle
+
+    // Building destruction
+    bool cityBuildingDestroyed = false;
+    float explosionTime = 0.0f;       // Time since explosion (increases after impact)
+    float buildingDestroyedTime = -1.0f; // Time when building was destroyed (-1 if not destroyed yet)
+
+    // Firecracker jubilation
+    bool firecrackersInitialized = false;
+    bool firecrackersActive = false;
+    float firecrackerJubilationTime = 0.0f; // Overall animation time
+    unsigned int firecrackerBatches = 0;    // Batches launched; seeds the bursts
+
+    // The crowd and the firework shells
+    EntityWorld world;
+    bool peopleInitialized = false;
+
+    // Sound effects
+    bool explosionSoundPlayed = false; // Track if explosion sound was played
+    bool firecrackerSoundPlayed = false; // Track if firecracker sound was played
+};
+
+SimState sim;                     // Live state, advanced by stepSimulation()
+const SimState* view = &sim;      // State display() draws (a published tick, or a blend of two)
 
 // -------------------------------------------------------------
 // Debug logging helper
@@ -199,272 +429,2849 @@ const Color DRONE_PROP = { 0.2f, 0.2f, 0.25f };      // darker gray propellers
 const Color DRONE_LIGHT = { 0.8f, 0.8f, 1.0f };       // light blue LED
 
 // -------------------------------------------------------------
-// Global helpers
+// Job system
 // -------------------------------------------------------------
-inline void setColor(const Color& c) { glColor3f(c.r, c.g, c.b); }
+// parallelFor() splits a loop across a pool of worker threads: the per-tick
+// update loops on the simulation thread, and draw-list recording and software
+// tiles on the GL thread. The range is cut into chunks and dealt out
+// round-robin to one deque per thread (callers share deque 0 and work too).
+// Each thread takes its own chunks from the back and, once it runs dry,
+// steals from the front of the others', so a chunk that runs long (people
+// arriving, firecrackers relaunching) doesn't leave the rest idle.
+// Every call keeps its body and count of unfinished chunks in a JobBatch on
+// its own stack, so the two threads can run loops at once, and a body may
+// call parallelFor itself. A call returns once its own chunks have finished.
+int jobThreads = 0;                   // --job-threads (0 = one per core)
+size_t jobGrain = 4096;               // --job-grain: items per chunk of an update loop
+
+struct JobBatch {
+    void (*run)(const void* body, size_t first, size_t last);
+    const void* body;
+    std::atomic<size_t> chunksLeft;
+};
 
-void filledRect(float x1, float y1, float x2, float y2, const Color& c) {
-    setColor(c);
-    glBegin(GL_QUADS);
-    glVertex2f(x1, y1);
-    glVertex2f(x2, y1);
-    glVertex2f(x2, y2);
-    glVertex2f(x1, y2);
-    glEnd();
-}
+struct JobChunk {
+    JobBatch* batch;
+    size_t first, last;               // Items [first, last)
+};
 
-void outlineRect(float x1, float y1, float x2, float y2,
-    const Color& c, float lineW = 2.0f) {
-    setColor(c);
-    glLineWidth(lineW);
-    glBegin(GL_LINE_LOOP);
-    glVertex2f(x1, y1);
-    glVertex2f(x2, y1);
-    glVertex2f(x2, y2);
-    glVertex2f(x1, y2);
-    glEnd();
-    glLineWidth(1.0f);
+struct JobDeque {
+    std::mutex mutex;
+    std::deque<JobChunk> chunks;
+};
+
+std::vector<std::thread> jobWorkers;
+std::vector<std::unique_ptr<JobDeque>> jobDeques;  // [0] is the calling threads'
+std::mutex jobMutex;
+std::condition_variable jobWake;      // New chunks were dealt, or shutting down
+std::condition_variable jobDone;      // Some batch's last chunk finished
+int jobGeneration = 0;
+bool jobStopping = false;
+
+bool takeJob(size_t self, JobChunk& chunk) {
+    {
+        JobDeque& own = *jobDeques[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.chunks.empty()) {
+            chunk = own.chunks.back();
+            own.chunks.pop_back();
+            return true;
+        }
+    }
+    for (size_t k = 1; k < jobDeques.size(); ++k) {
+        JobDeque& victim = *jobDeques[(self + k) % jobDeques.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.chunks.empty()) {
+            chunk = victim.chunks.front();
+            victim.chunks.pop_front();
+            return true;
+        }
+    }
+    return false;
 }
 
-// alias for city code
-void outlinedRect(float x1, float y1, float x2, float y2,
-    const Color& border, float lineW = 2.0f) {
-    outlineRect(x1, y1, x2, y2, border, lineW);
+// Run chunks (of any batch) until every deque is empty
+void runJobs(size_t self) {
+    JobChunk chunk;
+    while (takeJob(self, chunk)) {
+        JobBatch& batch = *chunk.batch;
+        batch.run(batch.body, chunk.first, chunk.last);
+        if (batch.chunksLeft.fetch_sub(1) == 1) {  // The caller may return now, so batch is gone
+            std::lock_guard<std::mutex> lock(jobMutex);
+            jobDone.notify_all();
+        }
+    }
 }
 
-void framedRect(float x1, float y1, float x2, float y2,
-    const Color& fill, const Color& border, float lw = 2.0f) {
-    filledRect(x1, y1, x2, y2, fill);
-    outlineRect(x1, y1, x2, y2, border, lw);
+void jobWorkerLoop(size_t self) {
+    int seenGeneration = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobWake.wait(lock, [&] { return jobStopping || jobGeneration != seenGeneration; });
+            if (jobStopping) return;
+            seenGeneration = jobGeneration;
+        }
+        runJobs(self);
+    }
 }
 
-void drawText(const std::string& s, float x, float y, void* font = GLUT_BITMAP_HELVETICA_18) {
-    glRasterPos2f(x, y);
-    for (char c : s) glutBitmapCharacter(font, c);
+void stopJobWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        jobStopping = true;
+    }
+    jobWake.notify_all();
+    for (std::thread& worker : jobWorkers) worker.join();
+    jobWorkers.clear();
 }
 
-void drawCenteredText(const std::string& s, float centerX, float y,
-    float charWidth, void* font = GLUT_BITMAP_HELVETICA_18) {
-    float approxWidth = s.size() * charWidth;
-    float startX = centerX - approxWidth * 0.5f;
-    drawText(s, startX, y, font);
+void initJobSystem() {
+    int threads = jobThreads > 0 ? jobThreads : static_cast<int>(std::thread::hardware_concurrency());
+    jobDeques.emplace_back(new JobDeque);
+    for (int i = 1; i < threads; ++i) {
+        jobDeques.emplace_back(new JobDeque);
+        jobWorkers.emplace_back(jobWorkerLoop, static_cast<size_t>(i));
+    }
+    if (!jobWorkers.empty()) atexit(stopJobWorkers);  // GLUT leaves its main loop through exit()
 }
 
-// Draw large text using stroke fonts (much bigger than bitmap fonts)
-void drawLargeStrokeText(const std::string& s, float centerX, float y, float scale) {
-    glPushMatrix();
-    
-    // Calculate text width first (before scaling)
-    float textWidth = 0.0f;
-    for (char c : s) {
-        textWidth += glutStrokeWidth(GLUT_STROKE_ROMAN, c);
+// Call body(first, last) over [0, count) in chunks of grain items; chunk
+// boundaries are always multiples of grain, but with no workers (or one
+// chunk) the whole range goes to a single call
+template <typename Body>
+void parallelFor(size_t count, const Body& body, size_t grain = jobGrain) {
+    const size_t chunks = (count + grain - 1) / grain;
+    if (jobWorkers.empty() || chunks <= 1) {
+        if (count > 0) body(0, count);
+        return;
     }
-    
-    // Translate to center position, then scale, then offset by half text width
-    glTranslatef(centerX, y, 0.0f);
-    glScalef(scale, scale, 1.0f);
-    glTranslatef(-textWidth * 0.5f, 0.0f, 0.0f);
-    
-    // Draw text with stroke font
-    for (char c : s) {
-        glutStrokeCharacter(GLUT_STROKE_ROMAN, c);
+    JobBatch batch;
+    batch.run = [](const void* f, size_t first, size_t last) { (*static_cast<const Body*>(f))(first, last); };
+    batch.body = &body;
+    batch.chunksLeft = chunks;
+    for (size_t c = 0; c < chunks; ++c) {
+        JobDeque& deque = *jobDeques[c % jobDeques.size()];
+        std::lock_guard<std::mutex> lock(deque.mutex);
+        deque.chunks.push_back({ &batch, c * grain, std::min(count, (c + 1) * grain) });
     }
-    
-    glPopMatrix();
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        ++jobGeneration;
+    }
+    jobWake.notify_all();
+    runJobs(0);
+    std::unique_lock<std::mutex> lock(jobMutex);
+    jobDone.wait(lock, [&] { return batch.chunksLeft.load() == 0; });
 }
 
 // -------------------------------------------------------------
-// Sound effect functions
+// Render backend
 // -------------------------------------------------------------
-void playSound(const char* soundFile) {
-#ifdef _WIN32
-    // Extract just the filename if a path was provided
-    std::string filename = soundFile;
-    size_t lastSlash = filename.find_last_of("\\/");
-    if (lastSlash != std::string::npos) {
-        filename = filename.substr(lastSlash + 1);
-    }
-    
-    // Try multiple path options
-    std::string fullPath;
-    BOOL result = FALSE;
-    
-    // First try: Music folder in current directory (same as project.cpp)
-    fullPath = "Music/" + filename;
-    result = PlaySound(fullPath.c_str(), NULL, SND_FILENAME | SND_ASYNC | SND_NODEFAULT);
-    if (result) {
-        return;  // Success
+// BACKEND_IMMEDIATE is the original glBegin/glEnd path. BACKEND_BATCHED collects
+// every primitive (already transformed to world space, one color per vertex)
+// into a CPU buffer and draws it with a few VBO draws per frame, using only
+// GL 3.3 core-profile entry points (VAO, VBO, GLSL 330 core). BACKEND_SOFTWARE
+// collects the same buffer and rasterizes it on the CPU.
+enum RenderBackend { BACKEND_IMMEDIATE, BACKEND_BATCHED, BACKEND_SOFTWARE };
+RenderBackend renderBackend = BACKEND_IMMEDIATE;  // Selected in initRenderer()
+bool forceImmediateMode = false;                  // --immediate command-line flag
+
+float viewportLeftX = -40.0f;     // Current viewport left X (updated in reshape)
+float viewportRightX = 40.0f;     // Current viewport right X (updated in reshape)
+float viewportBottomY = 0.0f;     // Current viewport bottom Y (0 except while split view draws a close-up)
+float unitsPerPixel = 0.08f;      // World units covered by one window pixel (updated in reshape)
+float renderUnitsPerPixel = 0.08f; // Same, for one pixel of the current render target (differs under dynamic resolution)
+
+struct RenderStats {
+    int drawCalls;                // GL draw calls issued this frame
+    int vertices;                 // Vertices submitted this frame
+};
+RenderStats renderStats = { 0, 0 };
+
+// Headless mode (--headless): there is no GLUT window, so main() drives idle()
+// and display() itself on a simulated clock and renders into an offscreen target
+bool headlessMode = false;
+double headlessClockSeconds = 0.0; // Stands in for the real clock, advanced one frame at a time
+int headlessFps = 60;             // --fps: simulated frame rate
+
+double frameSeconds = 0.0;        // Clock time between the last two frames (HUD frame rate)
+
+// Seconds on a monotonic high-resolution clock (the simulated one when headless)
+double clockSeconds() {
+    if (headlessMode) return headlessClockSeconds;
+    static const auto origin = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count();
+}
+
+// GL 3.3 entry points are not exported by every platform's GL library
+// (opengl32.dll stops at 1.1), so they are loaded at runtime.
+#define GL33_FUNCTIONS(X) \
+    X(PFNGLGENBUFFERSPROC, GenBuffers) \
+    X(PFNGLDELETEBUFFERSPROC, DeleteBuffers) \
+    X(PFNGLBINDBUFFERPROC, BindBuffer) \
+    X(PFNGLBUFFERDATAPROC, BufferData) \
+    X(PFNGLGENVERTEXARRAYSPROC, GenVertexArrays) \
+    X(PFNGLBINDVERTEXARRAYPROC, BindVertexArray) \
+    X(PFNGLENABLEVERTEXATTRIBARRAYPROC, EnableVertexAttribArray) \
+    X(PFNGLVERTEXATTRIBPOINTERPROC, VertexAttribPointer) \
+    X(PFNGLVERTEXATTRIBIPOINTERPROC, VertexAttribIPointer) \
+    X(PFNGLCREATESHADERPROC, CreateShader) \
+    X(PFNGLSHADERSOURCEPROC, ShaderSource) \
+    X(PFNGLCOMPILESHADERPROC, CompileShader) \
+    X(PFNGLGETSHADERIVPROC, GetShaderiv) \
+    X(PFNGLGETSHADERINFOLOGPROC, GetShaderInfoLog) \
+    X(PFNGLDELETESHADERPROC, DeleteShader) \
+    X(PFNGLCREATEPROGRAMPROC, CreateProgram) \
+    X(PFNGLATTACHSHADERPROC, AttachShader) \
+    X(PFNGLBINDATTRIBLOCATIONPROC, BindAttribLocation) \
+    X(PFNGLLINKPROGRAMPROC, LinkProgram) \
+    X(PFNGLGETPROGRAMIVPROC, GetProgramiv) \
+    X(PFNGLGETPROGRAMINFOLOGPROC, GetProgramInfoLog) \
+    X(PFNGLUSEPROGRAMPROC, UseProgram) \
+    X(PFNGLGETUNIFORMLOCATIONPROC, GetUniformLocation) \
+    X(PFNGLUNIFORM4FPROC, Uniform4f) \
+    X(PFNGLGENFRAMEBUFFERSPROC, GenFramebuffers) \
+    X(PFNGLBINDFRAMEBUFFERPROC, BindFramebuffer) \
+    X(PFNGLFRAMEBUFFERTEXTURE2DPROC, FramebufferTexture2D) \
+    X(PFNGLDELETEFRAMEBUFFERSPROC, DeleteFramebuffers) \
+    X(PFNGLCHECKFRAMEBUFFERSTATUSPROC, CheckFramebufferStatus) \
+    X(PFNGLUNIFORM1FPROC, Uniform1f) \
+    X(PFNGLUNIFORM3FPROC, Uniform3f) \
+    X(PFNGLDRAWARRAYSINSTANCEDPROC, DrawArraysInstanced) \
+    X(PFNGLVERTEXATTRIBDIVISORPROC, VertexAttribDivisor) \
+    X(PFNGLMAPBUFFERRANGEPROC, MapBufferRange) \
+    X(PFNGLUNMAPBUFFERPROC, UnmapBuffer) \
+    X(PFNGLBLITFRAMEBUFFERPROC, BlitFramebuffer) \
+    X(PFNGLGENQUERIESPROC, GenQueries) \
+    X(PFNGLBEGINQUERYPROC, BeginQuery) \
+    X(PFNGLENDQUERYPROC, EndQuery) \
+    X(PFNGLGETQUERYOBJECTIVPROC, GetQueryObjectiv) \
+    X(PFNGLGETQUERYOBJECTUI64VPROC, GetQueryObjectui64v)
+
+namespace gl33 {
+#define GL33_DECLARE(type, name) type name = nullptr;
+    GL33_FUNCTIONS(GL33_DECLARE)
+#undef GL33_DECLARE
+
+    GLUTproc getProc(const char* name) {
+#ifdef HAVE_HEADLESS_EGL
+        if (headlessMode) return reinterpret_cast<GLUTproc>(eglGetProcAddress(name));
+#endif
+        return glutGetProcAddress(name);
     }
-    
-    // Second try: directly in current directory
-    fullPath = filename;
-    result = PlaySound(fullPath.c_str(), NULL, SND_FILENAME | SND_ASYNC | SND_NODEFAULT);
-    if (result) {
-        return;  // Success
+
+    bool load() {
+        bool ok = true;
+#define GL33_LOAD(type, name) \
+        name = reinterpret_cast<type>(getProc("gl" #name)); \
+        if (!name) ok = false;
+        GL33_FUNCTIONS(GL33_LOAD)
+#undef GL33_LOAD
+        return ok;
     }
-    
-    // Third try: relative to executable directory
-    char exePath[MAX_PATH];
-    GetModuleFileNameA(NULL, exePath, MAX_PATH);
-    std::string exeDir = exePath;
-    size_t lastSlash2 = exeDir.find_last_of("\\/");
-    if (lastSlash2 != std::string::npos) {
-        exeDir = exeDir.substr(0, lastSlash2 + 1);
-        // Try in Music folder relative to exe
-        fullPath = exeDir + "Music/" + filename;
-        result = PlaySound(fullPath.c_str(), NULL, SND_FILENAME | SND_ASYNC | SND_NODEFAULT);
-        if (result) {
-            return;  // Success
+
+    // Returns 0 (and prints the info log) if either stage fails to compile or link
+    GLuint buildProgram(const char* vertexSrc, const char* fragmentSrc,
+        const std::vector<std::string>& attribNames) {
+        GLuint stages[2] = { CreateShader(GL_VERTEX_SHADER), CreateShader(GL_FRAGMENT_SHADER) };
+        const char* sources[2] = { vertexSrc, fragmentSrc };
+        GLuint program = CreateProgram();
+        for (int i = 0; i < 2; ++i) {
+            ShaderSource(stages[i], 1, &sources[i], nullptr);
+            CompileShader(stages[i]);
+            GLint ok = GL_FALSE;
+            GetShaderiv(stages[i], GL_COMPILE_STATUS, &ok);
+            if (!ok) {
+                char log[1024];
+                GetShaderInfoLog(stages[i], sizeof(log), nullptr, log);
+                std::cerr << "Shader compile failed: " << log << std::endl;
+                return 0;
+            }
+            AttachShader(program, stages[i]);
         }
-        // Try directly in exe directory
-        fullPath = exeDir + filename;
-        result = PlaySound(fullPath.c_str(), NULL, SND_FILENAME | SND_ASYNC | SND_NODEFAULT);
-        if (result) {
-            return;  // Success
+        for (size_t i = 0; i < attribNames.size(); ++i) {
+            BindAttribLocation(program, static_cast<GLuint>(i), attribNames[i].c_str());
+        }
+        LinkProgram(program);
+        DeleteShader(stages[0]);
+        DeleteShader(stages[1]);
+        GLint ok = GL_FALSE;
+        GetProgramiv(program, GL_LINK_STATUS, &ok);
+        if (!ok) {
+            char log[1024];
+            GetProgramInfoLog(program, sizeof(log), nullptr, log);
+            std::cerr << "Shader link failed: " << log << std::endl;
+            return 0;
         }
+        return program;
     }
-    
-    // Fourth try: absolute path from project root (fallback)
-    fullPath = "E:/Projects/Computer Graphics/Computer Graphics/Computer-Graphics-main/Music/" + filename;
-    PlaySound(fullPath.c_str(), NULL, SND_FILENAME | SND_ASYNC | SND_NODEFAULT);
-#endif
+} // namespace gl33
+
+// -------------------------------------------------------------
+// 2D transform stack (CPU side)
+// -------------------------------------------------------------
+// Batched vertices are transformed on the CPU so a whole frame can go out in
+// one draw; in immediate mode every call is mirrored onto the GL matrix stack.
+// The state is per thread so draw lists can be recorded on worker threads.
+struct Transform2D {
+    float a, b;    // first column  (x axis)
+    float c, d;    // second column (y axis)
+    float tx, ty;  // translation
+};
+const Transform2D IDENTITY_TRANSFORM = { 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f };
+thread_local Transform2D currentTransform = IDENTITY_TRANSFORM;
+thread_local std::vector<Transform2D> transformStack;
+
+inline void transformPoint(float x, float y, float& outX, float& outY) {
+    const Transform2D& m = currentTransform;
+    outX = m.a * x + m.c * y + m.tx;
+    outY = m.b * x + m.d * y + m.ty;
 }
 
-void playSoundSync(const char* soundFile) {
-#ifdef _WIN32
-    // Play sound synchronously (blocks until done)
-    PlaySound(soundFile, NULL, SND_FILENAME | SND_SYNC);
-#endif
+void resetTransform() {
+    currentTransform = IDENTITY_TRANSFORM;
+    transformStack.clear();
 }
 
-void stopSound() {
-#ifdef _WIN32
-    // Stop any currently playing sound
-    PlaySound(NULL, NULL, 0);
-#endif
+void pushTransform() {
+    transformStack.push_back(currentTransform);
+    if (renderBackend == BACKEND_IMMEDIATE) glPushMatrix();
 }
 
-// -------------------------------------------------------------
-// Circle drawing helper for moon and clouds
-// -------------------------------------------------------------
-void drawCircle(float cx, float cy, float r, const Color& fill, int segments = 40) {
-    setColor(fill);
-    glBegin(GL_TRIANGLE_FAN);
-    glVertex2f(cx, cy);  // center
-    for (int i = 0; i <= segments; ++i) {
-        float angle = 2.0f * 3.14159265358979323846f * i / segments;
-        glVertex2f(cx + r * cosf(angle), cy + r * sinf(angle));
+void popTransform() {
+    if (!transformStack.empty()) {
+        currentTransform = transformStack.back();
+        transformStack.pop_back();
     }
-    glEnd();
+    if (renderBackend == BACKEND_IMMEDIATE) glPopMatrix();
 }
 
-// -------------------------------------------------------------
-// Moon drawing
-// -------------------------------------------------------------
-void drawMoon() {
-    float moonX = 3.0f;      // slightly right of center
-    float moonY = viewportTopY * 0.90f;  // 90% of viewport height (dynamically adjusts, leaves space at top)
-    
-    // #region agent log
-    {
-        std::ostringstream json;
-        json << "{\"moonX\":" << moonX << ",\"moonY\":" << moonY << ",\"viewportTopY\":" << viewportTopY << "}";
-        debugLog("project.cpp:128", "Moon position (dynamic)", json.str(), "run3", "D");
-    }
-    // #endregion
-    
-    // Moon glow halo (slightly larger, darker)
-    drawCircle(moonX, moonY, 1.3f, MOON_GLOW, 40);
-    
-    // Main moon
-    drawCircle(moonX, moonY, 1.0f, MOON_COLOR, 40);
+void translateTransform(float x, float y) {
+    Transform2D& m = currentTransform;
+    m.tx += m.a * x + m.c * y;
+    m.ty += m.b * x + m.d * y;
+    if (renderBackend == BACKEND_IMMEDIATE) glTranslatef(x, y, 0.0f);
 }
 
-// -------------------------------------------------------------
-// Stars drawing
-// -------------------------------------------------------------
-void drawStars() {
-    // Scale factor: convert from original [0, 20] range to current viewport range
-    float scaleFactor = viewportTopY / 20.0f;
-    
-    // Predefined star positions (original Y values in [0, 20] range, will be scaled)
-    struct Star { float x; float origY; const Color* color; float size; };
-    
-    Star stars[] = {
-        // Bright stars (original Y values)
-        { -35.0f, 16.5f, &STAR_BRIGHT, 0.08f },
-        { -30.0f, 18.0f, &STAR_BRIGHT, 0.08f },
-        { -25.0f, 15.5f, &STAR_BRIGHT, 0.08f },
-        { -15.0f, 17.5f, &STAR_BRIGHT, 0.08f },
-        { -10.0f, 16.0f, &STAR_BRIGHT, 0.08f },
-        { 5.0f, 18.5f, &STAR_BRIGHT, 0.08f },
-        { 10.0f, 15.0f, &STAR_BRIGHT, 0.08f },
-        { 15.0f, 17.0f, &STAR_BRIGHT, 0.08f },
-        { 25.0f, 16.5f, &STAR_BRIGHT, 0.08f },
-        { 30.0f, 18.0f, &STAR_BRIGHT, 0.08f },
-        { 35.0f, 15.5f, &STAR_BRIGHT, 0.08f },
-        
-        // Medium stars
-        { -32.0f, 14.0f, &STAR_MEDIUM, 0.06f },
-        { -28.0f, 17.0f, &STAR_MEDIUM, 0.06f },
-        { -20.0f, 16.0f, &STAR_MEDIUM, 0.06f },
-        { -18.0f, 13.5f, &STAR_MEDIUM, 0.06f },
-        { -12.0f, 18.0f, &STAR_MEDIUM, 0.06f },
-        { -8.0f, 14.5f, &STAR_MEDIUM, 0.06f },
-        { -5.0f, 17.0f, &STAR_MEDIUM, 0.06f },
-        { 0.0f, 15.5f, &STAR_MEDIUM, 0.06f },
-        { 8.0f, 18.0f, &STAR_MEDIUM, 0.06f },
-        { 12.0f, 14.0f, &STAR_MEDIUM, 0.06f },
-        { 18.0f, 16.5f, &STAR_MEDIUM, 0.06f },
-        { 22.0f, 17.5f, &STAR_MEDIUM, 0.06f },
-        { 28.0f, 14.5f, &STAR_MEDIUM, 0.06f },
-        { 32.0f, 16.0f, &STAR_MEDIUM, 0.06f },
-        
-        // Dim stars
-        { -33.0f, 15.0f, &STAR_DIM, 0.05f },
-        { -27.0f, 13.0f, &STAR_DIM, 0.05f },
-        { -22.0f, 18.0f, &STAR_DIM, 0.05f },
-        { -16.0f, 15.0f, &STAR_DIM, 0.05f },
-        { -14.0f, 12.5f, &STAR_DIM, 0.05f },
-        { -6.0f, 16.5f, &STAR_DIM, 0.05f },
-        { -3.0f, 13.0f, &STAR_DIM, 0.05f },
-        { 3.0f, 16.0f, &STAR_DIM, 0.05f },
-        { 6.0f, 13.5f, &STAR_DIM, 0.05f },
-        { 14.0f, 17.0f, &STAR_DIM, 0.05f },
-        { 20.0f, 14.0f, &STAR_DIM, 0.05f },
-        { 27.0f, 15.5f, &STAR_DIM, 0.05f },
-        { 33.0f, 17.0f, &STAR_DIM, 0.05f }
-    };
-    
-    int numStars = sizeof(stars) / sizeof(stars[0]);
-    for (int i = 0; i < numStars; ++i) {
-        float scaledY = stars[i].origY * scaleFactor;
-        drawCircle(stars[i].x, scaledY, stars[i].size, *(stars[i].color), 20);
-    }
+void rotateTransform(float degrees) {
+    float rad = degrees * 3.14159265358979323846f / 180.0f;
+    float cs = cosf(rad), sn = sinf(rad);
+    Transform2D& m = currentTransform;
+    float a = m.a * cs + m.c * sn;
+    float b = m.b * cs + m.d * sn;
+    float c = m.c * cs - m.a * sn;
+    float d = m.d * cs - m.b * sn;
+    m.a = a; m.b = b; m.c = c; m.d = d;
+    if (renderBackend == BACKEND_IMMEDIATE) glRotatef(degrees, 0.0f, 0.0f, 1.0f);
+}
+
+void scaleTransform(float sx, float sy) {
+    Transform2D& m = currentTransform;
+    m.a *= sx; m.b *= sx;
+    m.c *= sy; m.d *= sy;
+    if (renderBackend == BACKEND_IMMEDIATE) glScalef(sx, sy, 1.0f);
 }
 
 // -------------------------------------------------------------
-// Cloud drawing
+// Batched renderer
 // -------------------------------------------------------------
-void drawCloud(float cx, float cy, float scale) {
-    // Create cloud using overlapping circles
-    float r1 = 0.6f * scale;
-    float r2 = 0.5f * scale;
-    float r3 = 0.55f * scale;
-    float r4 = 0.45f * scale;
-    float r5 = 0.5f * scale;
-    
-    drawCircle(cx - 0.4f * scale, cy, r1, CLOUD_COLOR, 30);
-    drawCircle(cx + 0.2f * scale, cy, r2, CLOUD_COLOR, 30);
-    drawCircle(cx + 0.6f * scale, cy, r3, CLOUD_COLOR, 30);
-    drawCircle(cx - 0.1f * scale, cy + 0.2f * scale, r4, CLOUD_COLOR, 30);
-    drawCircle(cx + 0.4f * scale, cy + 0.15f * scale, r5, CLOUD_COLOR, 30);
+struct BatchVertex {
+    float x, y;        // world-space position
+    float r, g, b, a;  // per-vertex color
+};
+
+GLuint batchProgram = 0;
+GLuint batchVAO = 0;
+GLuint batchVBO = 0;
+GLint batchViewLoc = -1;
+
+const char* BATCH_VERTEX_SHADER =
+    "#version 330 core\n"
+    "in vec2 aPos;\n"
+    "in vec4 aColor;\n"
+    "uniform vec4 uView;  // left, right, bottom, top of the world window\n"
+    "out vec4 vColor;\n"
+    "void main() {\n"
+    "    vec2 ndc = (aPos - uView.xz) / (uView.yw - uView.xz) * 2.0 - 1.0;\n"
+    "    gl_Position = vec4(ndc, 0.0, 1.0);\n"
+    "    vColor = aColor;\n"
+    "}\n";
+
+const char* BATCH_FRAGMENT_SHADER =
+    "#version 330 core\n"
+    "in vec4 vColor;\n"
+    "out vec4 fragColor;\n"
+    "void main() {\n"
+    "    fragColor = vColor;\n"
+    "}\n";
+
+bool gl33Available = false;  // Context is 3.3+ and every gl33:: entry point loaded
+
+bool loadGL33() {
+    const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    int major = 0, minor = 0;
+    if (!version || sscanf(version, "%d.%d", &major, &minor) != 2) return false;
+    if (major < 3 || (major == 3 && minor < 3)) return false;
+    return gl33::load();
 }
 
-void initializeCloudYPositions() {
-    // Initialize random Y positions for each cloud (in top area of screen)
-    // Random Y between 85% and 95% of viewport top
-    for (int i = 0; i < 6; ++i) {
+bool initBatchRenderer() {
+    batchProgram = gl33::buildProgram(BATCH_VERTEX_SHADER, BATCH_FRAGMENT_SHADER, { "aPos", "aColor" });
+    if (!batchProgram) return false;
+    batchViewLoc = gl33::GetUniformLocation(batchProgram, "uView");
+
+    gl33::GenVertexArrays(1, &batchVAO);
+    gl33::GenBuffers(1, &batchVBO);
+    gl33::BindVertexArray(batchVAO);
+    gl33::BindBuffer(GL_ARRAY_BUFFER, batchVBO);
+    gl33::EnableVertexAttribArray(0);
+    gl33::VertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(BatchVertex),
+        reinterpret_cast<const void*>(offsetof(BatchVertex, x)));
+    gl33::EnableVertexAttribArray(1);
+    gl33::VertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(BatchVertex),
+        reinterpret_cast<const void*>(offsetof(BatchVertex, r)));
+    gl33::BindVertexArray(0);
+    gl33::BindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+// Draw one run of an uploaded geometry array
+void drawGeometryRun(size_t first, size_t count) {
+    gl33::UseProgram(batchProgram);
+    gl33::Uniform4f(batchViewLoc, viewportLeftX, viewportRightX, viewportBottomY, viewportTopY);
+    gl33::BindVertexArray(batchVAO);
+    glDrawArrays(GL_TRIANGLES, static_cast<GLint>(first), static_cast<GLsizei>(count));
+    gl33::BindVertexArray(0);
+    gl33::UseProgram(0);
+
+    renderStats.drawCalls++;
+    renderStats.vertices += static_cast<int>(count);
+}
+
+// -------------------------------------------------------------
+// Software rasterizer
+// -------------------------------------------------------------
+// BACKEND_SOFTWARE (--software) collects the same world-space triangles as the
+// batched path (lines already expanded to quads) but never hands them to GL.
+// At the end of the frame each triangle is set up once in fixed point and
+// binned into screen tiles; the job system then hands out whole tiles, so every
+// pixel has one owner and a tile's triangles are drawn in submission order.
+// Batch geometry is opaque with one color per triangle, so the covered part
+// of each pixel row is a single span, solved exactly from the three edge
+// equations and filled with SIMD stores.
+const int SOFT_TILE_SIZE = 64;
+const int SOFT_SUBPIXEL_BITS = 8;
+const int64_t SOFT_ONE = 1 << SOFT_SUBPIXEL_BITS;
+const int64_t SOFT_HALF = SOFT_ONE / 2;
+
+struct SoftTriangle {
+    int64_t a[3], b[3], c[3];    // Inside where a*x + b*y + c >= 0 for all three edges (fill rule folded into c)
+    int minX, minY, maxX, maxY;  // Pixel bounds, clipped to the framebuffer
+    uint32_t color;
+};
+
+bool forceSoftwareMode = false;          // --software command-line flag
+std::vector<uint32_t> softwareFramebuffer;  // RGBA8, bottom row first like glReadPixels
+int softwareWidth = 0, softwareHeight = 0;
+uint32_t softwareClearColor = 0;
+std::vector<SoftTriangle> softwareTriangles;
+std::vector<std::vector<uint32_t>> softwareTileBins;
+int softwareTilesX = 0, softwareTilesY = 0;
+
+// Byte order r, g, b, a in memory on little-endian machines
+inline uint32_t packRgba(float r, float g, float b) {
+    auto byte = [](float v) { return static_cast<uint32_t>(std::max(0.0f, std::min(1.0f, v)) * 255.0f + 0.5f); };
+    return byte(r) | (byte(g) << 8) | (byte(b) << 16) | 0xFF000000u;
+}
+
+inline int64_t floorDiv(int64_t n, int64_t d) {  // d > 0
+    return n >= 0 ? n / d : -((-n + d - 1) / d);
+}
+
+inline int64_t ceilDiv(int64_t n, int64_t d) {   // d > 0
+    return -floorDiv(-n, d);
+}
+
+inline void fillSpan(uint32_t* dst, int count, uint32_t color) {
+#if defined(__AVX__)
+    const __m256i color8 = _mm256_set1_epi32(static_cast<int>(color));
+    for (; count >= 8; count -= 8, dst += 8) _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), color8);
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i color4 = _mm_set1_epi32(static_cast<int>(color));
+    for (; count >= 4; count -= 4, dst += 4) _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), color4);
+#endif
+    while (count-- > 0) *dst++ = color;
+}
+
+// Fixed-point edge setup. Returns false for triangles that cover no pixel centre.
+bool setupSoftTriangle(const BatchVertex* v, SoftTriangle& t) {
+    const double scaleX = softwareWidth / static_cast<double>(viewportRightX - viewportLeftX);
+    const double scaleY = softwareHeight / static_cast<double>(viewportTopY);
+    const double limit = 1 << 18;  // Pixels; keeps every edge product well inside 64 bits
+    int64_t x[3], y[3];
+    for (int i = 0; i < 3; ++i) {
+        double px = (v[i].x - viewportLeftX) * scaleX, py = v[i].y * scaleY;
+        if (!(fabs(px) < limit && fabs(py) < limit)) return false;
+        x[i] = llround(px * SOFT_ONE);
+        y[i] = llround(py * SOFT_ONE);
+    }
+    int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (area == 0) return false;
+    if (area < 0) { std::swap(x[1], x[2]); std::swap(y[1], y[2]); }
+
+    // Pixel p is sampled at p + 0.5
+    int64_t minX = std::min({ x[0], x[1], x[2] }), maxX = std::max({ x[0], x[1], x[2] });
+    int64_t minY = std::min({ y[0], y[1], y[2] }), maxY = std::max({ y[0], y[1], y[2] });
+    t.minX = static_cast<int>(std::max<int64_t>(0, ceilDiv(minX - SOFT_HALF, SOFT_ONE)));
+    t.maxX = static_cast<int>(std::min<int64_t>(softwareWidth - 1, floorDiv(maxX - SOFT_HALF, SOFT_ONE)));
+    t.minY = static_cast<int>(std::max<int64_t>(0, ceilDiv(minY - SOFT_HALF, SOFT_ONE)));
+    t.maxY = static_cast<int>(std::min<int64_t>(softwareHeight - 1, floorDiv(maxY - SOFT_HALF, SOFT_ONE)));
+    if (t.minX > t.maxX || t.minY > t.maxY) return false;
+
+    for (int i = 0; i < 3; ++i) {
+        int j = (i + 1) % 3;
+        int64_t dx = x[j] - x[i], dy = y[j] - y[i];
+        t.a[i] = -dy;
+        t.b[i] = dx;
+        t.c[i] = dy * x[i] - dx * y[i];
+        // A shared edge runs opposite ways in its two triangles, so exactly one
+        // owns it; left and bottom edges own their samples, as in Mesa
+        bool ownsEdge = dy < 0 || (dy == 0 && dx > 0);
+        if (!ownsEdge) t.c[i] -= 1;
+    }
+    t.color = packRgba(v[0].r, v[0].g, v[0].b);
+    return true;
+}
+
+void rasterizeSoftTile(int tile) {
+    const int x0 = (tile % softwareTilesX) * SOFT_TILE_SIZE;
+    const int y0 = (tile / softwareTilesX) * SOFT_TILE_SIZE;
+    const int x1 = std::min(x0 + SOFT_TILE_SIZE, softwareWidth) - 1;
+    const int y1 = std::min(y0 + SOFT_TILE_SIZE, softwareHeight) - 1;
+    uint32_t* pixels = softwareFramebuffer.data();
+    for (int y = y0; y <= y1; ++y) fillSpan(pixels + static_cast<size_t>(y) * softwareWidth + x0, x1 - x0 + 1, softwareClearColor);
+
+    for (uint32_t index : softwareTileBins[tile]) {
+        const SoftTriangle& t = softwareTriangles[index];
+        const int left = std::max(x0, t.minX), right = std::min(x1, t.maxX);
+        const int bottom = std::max(y0, t.minY), top = std::min(y1, t.maxY);
+        for (int y = bottom; y <= top; ++y) {
+            const int64_t sampleY = y * SOFT_ONE + SOFT_HALF;
+            int64_t lo = left, hi = right;
+            for (int e = 0; e < 3; ++e) {
+                // Edge value at pixel x is step * x + k
+                int64_t step = t.a[e] * SOFT_ONE;
+                int64_t k = t.a[e] * SOFT_HALF + t.b[e] * sampleY + t.c[e];
+                if (step > 0) lo = std::max(lo, ceilDiv(-k, step));
+                else if (step < 0) hi = std::min(hi, floorDiv(k, -step));
+                else if (k < 0) hi = lo - 1;
+            }
+            if (lo <= hi) {
+                fillSpan(pixels + static_cast<size_t>(y) * softwareWidth + lo, static_cast<int>(hi - lo + 1), t.color);
+            }
+        }
+    }
+}
+
+void beginSoftwareFrame(const Color& clearColor) {
+    if (softwareWidth != winW || softwareHeight != winH) {
+        softwareWidth = winW;
+        softwareHeight = winH;
+        softwareFramebuffer.assign(static_cast<size_t>(winW) * winH, 0);
+        softwareTilesX = (winW + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+        softwareTilesY = (winH + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+        softwareTileBins.assign(static_cast<size_t>(softwareTilesX) * softwareTilesY, {});
+    }
+    softwareClearColor = packRgba(clearColor.r, clearColor.g, clearColor.b);
+}
+
+// Bin the frame's triangles, then rasterize every tile across the job system
+void rasterizeSoftwareFrame(const std::vector<BatchVertex>& vertices) {
+    softwareTriangles.clear();
+    for (std::vector<uint32_t>& bin : softwareTileBins) bin.clear();
+    for (size_t i = 0; i + 2 < vertices.size(); i += 3) {
+        SoftTriangle t;
+        if (!setupSoftTriangle(&vertices[i], t)) continue;
+        uint32_t index = static_cast<uint32_t>(softwareTriangles.size());
+        softwareTriangles.push_back(t);
+        for (int ty = t.minY / SOFT_TILE_SIZE; ty <= t.maxY / SOFT_TILE_SIZE; ++ty) {
+            for (int tx = t.minX / SOFT_TILE_SIZE; tx <= t.maxX / SOFT_TILE_SIZE; ++tx) {
+                softwareTileBins[ty * softwareTilesX + tx].push_back(index);
+            }
+        }
+    }
+
+    parallelFor(softwareTileBins.size(), [](size_t first, size_t last) {
+        for (size_t tile = first; tile < last; ++tile) rasterizeSoftTile(static_cast<int>(tile));
+    }, 1);
+
+    renderStats.drawCalls++;
+    renderStats.vertices += static_cast<int>(vertices.size());
+}
+
+// Windowed software mode still needs GL for one thing: putting the image on screen
+void presentSoftwareFrame() {
+    if (headlessMode) return;
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    glRasterPos2f(-1.0f, -1.0f);
+    glDrawPixels(softwareWidth, softwareHeight, GL_RGBA, GL_UNSIGNED_BYTE, softwareFramebuffer.data());
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+}
+
+// -------------------------------------------------------------
+// Prop instancing
+// -------------------------------------------------------------
+// Repeated props (windows, bushes, trees, street lights, rockets, particles)
+// are stored once as a mesh in prop space and drawn with one instanced call
+// per run of same-type props, each instance supplying its own offset, scale,
+// rotation and color. Runs are kept in submission order relative to batched
+// geometry (see Draw lists), so painter's order is unchanged.
+enum PropType {
+    PROP_CITY_WINDOW,
+    PROP_DIU_WINDOW,
+    PROP_CITY_BUSH,
+    PROP_DIU_BUSH,
+    PROP_TREE,
+    PROP_STREET_LIGHT,
+    PROP_ROCKET,
+    PROP_PARTICLE,
+    PROP_SMOKE_PUFF,
+    NUM_PROP_TYPES
+};
+
+struct PropVertex {
+    float x, y;        // position in prop space (scaled per instance)
+    float px, py;      // extra offset in window pixels (keeps outlines at their line width)
+    float r, g, b;     // baked color
+    float tint;        // 1 = take the instance color instead of the baked one
+};
+
+struct PropInstance {
+    float x, y;        // world-space origin
+    float sx, sy;      // world-space scale
+    float cs, sn;      // rotation (cosine and sine of the angle)
+    float r, g, b;     // instance color
+};
+
+std::vector<PropVertex> propMeshVertices;   // Every prop mesh, back to back
+int propMeshFirst[NUM_PROP_TYPES] = {};
+int propMeshCount[NUM_PROP_TYPES] = {};
+bool propInstancingEnabled = false;         // Set by initPropInstancing()
+bool disablePropInstancing = false;         // --no-instancing command-line flag
+
+GLuint propProgram = 0;
+GLuint propVAO = 0;
+GLuint propMeshVBO = 0;
+GLuint propInstanceVBO = 0;
+GLint propViewLoc = -1;
+GLint propPixelLoc = -1;
+
+const char* PROP_VERTEX_SHADER =
+    "#version 330 core\n"
+    "in vec2 aPos;\n"
+    "in vec2 aPixel;\n"
+    "in vec4 aColor;        // rgb + tint\n"
+    "in vec4 iOffsetScale;  // per instance: x, y, sx, sy\n"
+    "in vec2 iRotation;     // per instance: cos, sin\n"
+    "in vec3 iColor;        // per instance\n"
+    "uniform vec4 uView;\n"
+    "uniform float uUnitsPerPixel;\n"
+    "out vec4 vColor;\n"
+    "void main() {\n"
+    "    mat2 rotation = mat2(iRotation.x, iRotation.y, -iRotation.y, iRotation.x);\n"
+    "    vec2 world = iOffsetScale.xy + rotation * (aPos * iOffsetScale.zw + aPixel * uUnitsPerPixel);\n"
+    "    vec2 ndc = (world - uView.xz) / (uView.yw - uView.xz) * 2.0 - 1.0;\n"
+    "    gl_Position = vec4(ndc, 0.0, 1.0);\n"
+    "    vColor = vec4(mix(aColor.rgb, iColor, aColor.a), 1.0);\n"
+    "}\n";
+
+// Upload the prop meshes built by initPropInstancing() and set up the
+// instanced vertex layout
+bool initPropRenderer() {
+    propProgram = gl33::buildProgram(PROP_VERTEX_SHADER, BATCH_FRAGMENT_SHADER,
+        { "aPos", "aPixel", "aColor", "iOffsetScale", "iRotation", "iColor" });
+    if (!propProgram) return false;
+    propViewLoc = gl33::GetUniformLocation(propProgram, "uView");
+    propPixelLoc = gl33::GetUniformLocation(propProgram, "uUnitsPerPixel");
+
+    gl33::GenVertexArrays(1, &propVAO);
+    gl33::GenBuffers(1, &propMeshVBO);
+    gl33::GenBuffers(1, &propInstanceVBO);
+    gl33::BindVertexArray(propVAO);
+
+    gl33::BindBuffer(GL_ARRAY_BUFFER, propMeshVBO);
+    gl33::BufferData(GL_ARRAY_BUFFER, propMeshVertices.size() * sizeof(PropVertex),
+        propMeshVertices.data(), GL_STATIC_DRAW);
+    gl33::EnableVertexAttribArray(0);
+    gl33::VertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(PropVertex),
+        reinterpret_cast<const void*>(offsetof(PropVertex, x)));
+    gl33::EnableVertexAttribArray(1);
+    gl33::VertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(PropVertex),
+        reinterpret_cast<const void*>(offsetof(PropVertex, px)));
+    gl33::EnableVertexAttribArray(2);
+    gl33::VertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(PropVertex),
+        reinterpret_cast<const void*>(offsetof(PropVertex, r)));
+
+    gl33::EnableVertexAttribArray(3);
+    gl33::VertexAttribDivisor(3, 1);
+    gl33::EnableVertexAttribArray(4);
+    gl33::VertexAttribDivisor(4, 1);
+    gl33::EnableVertexAttribArray(5);
+    gl33::VertexAttribDivisor(5, 1);
+
+    gl33::BindVertexArray(0);
+    gl33::BindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+// Draw instances [first, first + count) of the uploaded instance buffer with
+// one instanced call; the per-instance attributes start at the run's slice
+void drawPropRun(int type, size_t first, size_t count) {
+    gl33::UseProgram(propProgram);
+    gl33::Uniform4f(propViewLoc, viewportLeftX, viewportRightX, viewportBottomY, viewportTopY);
+    gl33::Uniform1f(propPixelLoc, unitsPerPixel);
+    gl33::BindVertexArray(propVAO);
+    gl33::BindBuffer(GL_ARRAY_BUFFER, propInstanceVBO);
+    const size_t base = first * sizeof(PropInstance);
+    gl33::VertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(PropInstance),
+        reinterpret_cast<const void*>(base + offsetof(PropInstance, x)));
+    gl33::VertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(PropInstance),
+        reinterpret_cast<const void*>(base + offsetof(PropInstance, cs)));
+    gl33::VertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(PropInstance),
+        reinterpret_cast<const void*>(base + offsetof(PropInstance, r)));
+    gl33::DrawArraysInstanced(GL_TRIANGLES, propMeshFirst[type], propMeshCount[type], static_cast<GLsizei>(count));
+    gl33::BindVertexArray(0);
+    gl33::BindBuffer(GL_ARRAY_BUFFER, 0);
+    gl33::UseProgram(0);
+
+    renderStats.drawCalls++;
+    renderStats.vertices += propMeshCount[type] * static_cast<int>(count);
+}
+
+// -------------------------------------------------------------
+// SDF effects
+// -------------------------------------------------------------
+// Explosions and the moon glow are drawn as one quad each. The fragment
+// shader evaluates the same rings the circle version stacks up, as distance
+// fields with a one-pixel soft edge, from a few per-instance parameters.
+// Consecutive effects share one instanced draw.
+//
+// Firecracker bursts are one instance each too, drawn by a second program as
+// --sparks points: the vertex shader evaluates spark gl_VertexID of the
+// burst in the same closed form drawFireworkSparks() uses on the CPU (see
+// Firecracker Functions), so nothing per spark is recorded or uploaded.
+enum EffectKind { EFFECT_EXPLOSION, EFFECT_BURST, EFFECT_GLOW };
+
+struct EffectInstance {
+    float x, y;          // world-space center
+    float scale;         // world units per effect unit (from the current transform)
+    float extent;        // quad half-size in effect units
+    float kind;          // EffectKind
+    float param;         // time for explosions and bursts, inner radius for glows
+    float r, g, b;       // main color (burst sparks at full light)
+    float r2, g2, b2;    // secondary color (explosion inner ring, glow disc)
+    uint32_t seed;       // burst pattern
+};
+
+int fireworkSparks = 2000;                // --sparks: sparks per burst
+const int MAX_SPARKS = 100000;
+const float SPARK_DRAG = 2.0f;            // k, per unit of burst time
+const float SPARK_GRAVITY = 1.5f;         // g, world units per burst time squared
+const float BURST_RADIUS = 3.5f;          // How far the fastest sparks coast
+
+bool sdfEffectsEnabled = false;    // Set by initEffectRenderer()
+bool disableSdfEffects = false;    // --no-sdf-effects command-line flag
+
+GLuint effectProgram = 0;
+GLuint effectVAO = 0;
+GLuint effectVBO = 0;
+GLint effectViewLoc = -1;
+GLint effectPixelLoc = -1;
+
+GLuint burstProgram = 0;
+GLuint burstVAO = 0;
+GLint burstViewLoc = -1;
+GLint burstPixelLoc = -1;
+GLint burstSparksLoc = -1;
+
+const char* EFFECT_VERTEX_SHADER =
+    "#version 330 core\n"
+    "in vec4 iPlacement;  // x, y, scale, extent\n"
+    "in vec2 iShape;      // kind, param\n"
+    "in vec3 iColor;\n"
+    "in vec3 iColor2;\n"
+    "uniform vec4 uView;\n"
+    "uniform float uUnitsPerPixel;\n"
+    "out vec2 vLocal;\n"
+    "flat out vec4 vShape;  // kind, param, effect units per pixel, extent\n"
+    "flat out vec3 vColor;\n"
+    "flat out vec3 vColor2;\n"
+    "const vec2 CORNERS[6] = vec2[6](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),\n"
+    "                                vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));\n"
+    "void main() {\n"
+    "    float pixel = uUnitsPerPixel / iPlacement.z;\n"
+    "    vLocal = CORNERS[gl_VertexID] * (iPlacement.w + 2.0 * pixel);\n"
+    "    vec2 world = iPlacement.xy + vLocal * iPlacement.z;\n"
+    "    vec2 ndc = (world - uView.xz) / (uView.yw - uView.xz) * 2.0 - 1.0;\n"
+    "    gl_Position = vec4(ndc, 0.0, 1.0);\n"
+    "    vShape = vec4(iShape, pixel, iPlacement.w);\n"
+    "    vColor = iColor;\n"
+    "    vColor2 = iColor2;\n"
+    "}\n";
+
+const char* EFFECT_FRAGMENT_SHADER =
+    "#version 330 core\n"
+    "in vec2 vLocal;\n"
+    "flat in vec4 vShape;\n"
+    "flat in vec3 vColor;\n"
+    "flat in vec3 vColor2;\n"
+    "out vec4 fragColor;\n"
+    "float pixel;\n"
+    "float disc(float d, float r) { return clamp((r - d) / pixel + 0.5, 0.0, 1.0); }\n"
+    "vec4 over(vec4 dst, vec3 c, float coverage) {\n"
+    "    return vec4(mix(dst.rgb, c, coverage), max(dst.a, coverage));\n"
+    "}\n"
+    "void main() {\n"
+    "    int kind = int(vShape.x + 0.5);\n"
+    "    float param = vShape.y;\n"
+    "    pixel = vShape.z;\n"
+    "    float d = length(vLocal);\n"
+    "    vec4 c = vec4(0.0);\n"
+    "    if (kind == 0) {  // Explosion: orange, yellow and white rings\n"
+    "        float radius = 3.0 * param;\n"
+    "        float fade = 1.0 - param / 2.0;\n"
+    "        if (fade > 0.0) c = over(c, vColor * fade, disc(d, radius));\n"
+    "        if (fade > 0.3) c = over(c, vColor2 * fade, disc(d, radius * 0.6));\n"
+    "        if (fade > 0.5) c = over(c, vec3(1.0, 1.0, 0.5) * fade, disc(d, radius * 0.3));\n"
+    "    } else {  // Glow: halo out to the extent, disc of radius param on top\n"
+    "        c = over(c, vColor, disc(d, vShape.w));\n"
+    "        c = over(c, vColor2, disc(d, param));\n"
+    "    }\n"
+    "    fragColor = vec4(c.rgb * c.a, c.a);  // Premultiplied\n"
+    "}\n";
+
+// Keep in step with drawFireworkSparks() and hashUint()
+const char* BURST_VERTEX_SHADER =
+    "#version 330 core\n"
+    "in vec4 iPlacement;  // x, y, scale, extent\n"
+    "in vec2 iShape;      // kind, burst time\n"
+    "in vec3 iColor;\n"
+    "in uint iSeed;\n"
+    "uniform vec4 uView;\n"
+    "uniform float uUnitsPerPixel;\n"
+    "uniform vec4 uSparks;  // sparks per burst, drag k, gravity g, burst radius\n"
+    "flat out vec3 vColor;\n"
+    "uint hashUint(uint x) {\n"
+    "    x ^= x >> 16; x *= 0x7feb352du;\n"
+    "    x ^= x >> 15; x *= 0x846ca68bu;\n"
+    "    return x ^ (x >> 16);\n"
+    "}\n"
+    "float hashUnit(uint x) { return float(hashUint(x) >> 8) * (1.0 / 16777216.0); }\n"
+    "void main() {\n"
+    "    uint i = uint(gl_VertexID);\n"
+    "    uint h = iSeed ^ (i * 0x9e3779b9u);\n"
+    "    float time = iShape.y;\n"
+    "    float fade = 1.0 - time / (1.2 + 0.8 * hashUnit(h + 2u));\n"
+    "    vColor = vec3(0.0);\n"
+    "    gl_PointSize = 1.0;\n"
+    "    gl_Position = vec4(2.0, 2.0, 2.0, 1.0);  // Burnt out: off screen\n"
+    "    if (fade <= 0.0) return;\n"
+    "    float k = uSparks.y;\n"
+    "    float drift = (1.0 - exp(-k * time)) / k;\n"
+    "    float fall = uSparks.z * (time - drift) / k;\n"
+    "    float angle = (float(i) + hashUnit(h)) * (6.2831853 / uSparks.x);\n"
+    "    float z = 2.0 * hashUnit(h + 1u) - 1.0;\n"
+    "    float speed = uSparks.w * k * sqrt(1.0 - z * z);\n"
+    "    vec2 local = vec2(cos(angle), sin(angle)) * speed * drift - vec2(0.0, fall);\n"
+    "    vec2 world = iPlacement.xy + local * iPlacement.z;\n"
+    "    vec2 ndc = (world - uView.xz) / (uView.yw - uView.xz) * 2.0 - 1.0;\n"
+    "    gl_Position = vec4(ndc, 0.0, 1.0);\n"
+    "    gl_PointSize = max(1.0, 2.0 * (0.03 + 0.03 * fade) * iPlacement.z / uUnitsPerPixel);\n"
+    "    uint twinkleFrame = uint(time * 30.0) * 0x85ebca6bu;\n"
+    "    vColor = iColor * fade * (0.6 + 0.4 * hashUnit(h ^ twinkleFrame));\n"
+    "}\n";
+
+const char* BURST_FRAGMENT_SHADER =
+    "#version 330 core\n"
+    "flat in vec3 vColor;\n"
+    "out vec4 fragColor;\n"
+    "void main() {\n"
+    "    fragColor = vec4(vColor, 1.0);  // Opaque squares, like the CPU sparks\n"
+    "}\n";
+
+bool initEffectRenderer() {
+    effectProgram = gl33::buildProgram(EFFECT_VERTEX_SHADER, EFFECT_FRAGMENT_SHADER,
+        { "iPlacement", "iShape", "iColor", "iColor2" });
+    if (!effectProgram) return false;
+    effectViewLoc = gl33::GetUniformLocation(effectProgram, "uView");
+    effectPixelLoc = gl33::GetUniformLocation(effectProgram, "uUnitsPerPixel");
+
+    // No mesh: the quad corners come from gl_VertexID
+    gl33::GenVertexArrays(1, &effectVAO);
+    gl33::GenBuffers(1, &effectVBO);
+    gl33::BindVertexArray(effectVAO);
+    for (GLuint attrib = 0; attrib < 4; ++attrib) {
+        gl33::EnableVertexAttribArray(attrib);
+        gl33::VertexAttribDivisor(attrib, 1);
+    }
+    gl33::BindVertexArray(0);
+
+    // Bursts read the same instance buffer; the spark index is gl_VertexID
+    burstProgram = gl33::buildProgram(BURST_VERTEX_SHADER, BURST_FRAGMENT_SHADER,
+        { "iPlacement", "iShape", "iColor", "iSeed" });
+    if (!burstProgram) return false;
+    burstViewLoc = gl33::GetUniformLocation(burstProgram, "uView");
+    burstPixelLoc = gl33::GetUniformLocation(burstProgram, "uUnitsPerPixel");
+    burstSparksLoc = gl33::GetUniformLocation(burstProgram, "uSparks");
+    gl33::GenVertexArrays(1, &burstVAO);
+    gl33::BindVertexArray(burstVAO);
+    for (GLuint attrib = 0; attrib < 4; ++attrib) {
+        gl33::EnableVertexAttribArray(attrib);
+        gl33::VertexAttribDivisor(attrib, 1);
+    }
+    gl33::BindVertexArray(0);
+    return true;
+}
+
+// Draw effects [first, first + count) of the uploaded effect buffer with one instanced call
+void drawEffectRun(size_t first, size_t count) {
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    gl33::UseProgram(effectProgram);
+    gl33::Uniform4f(effectViewLoc, viewportLeftX, viewportRightX, viewportBottomY, viewportTopY);
+    gl33::Uniform1f(effectPixelLoc, renderUnitsPerPixel);
+    gl33::BindVertexArray(effectVAO);
+    gl33::BindBuffer(GL_ARRAY_BUFFER, effectVBO);
+    const size_t base = first * sizeof(EffectInstance);
+    gl33::VertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(EffectInstance),
+        reinterpret_cast<const void*>(base + offsetof(EffectInstance, x)));
+    gl33::VertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(EffectInstance),
+        reinterpret_cast<const void*>(base + offsetof(EffectInstance, kind)));
+    gl33::VertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(EffectInstance),
+        reinterpret_cast<const void*>(base + offsetof(EffectInstance, r)));
+    gl33::VertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(EffectInstance),
+        reinterpret_cast<const void*>(base + offsetof(EffectInstance, r2)));
+    gl33::DrawArraysInstanced(GL_TRIANGLES, 0, 6, static_cast<GLsizei>(count));
+    gl33::BindVertexArray(0);
+    gl33::BindBuffer(GL_ARRAY_BUFFER, 0);
+    gl33::UseProgram(0);
+    glDisable(GL_BLEND);
+
+    renderStats.drawCalls++;
+    renderStats.vertices += 6 * static_cast<int>(count);
+}
+
+// Draw bursts [first, first + count) of the uploaded effect buffer, every spark of them, with one call
+void drawBurstRun(size_t first, size_t count) {
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    gl33::UseProgram(burstProgram);
+    gl33::Uniform4f(burstViewLoc, viewportLeftX, viewportRightX, viewportBottomY, viewportTopY);
+    gl33::Uniform1f(burstPixelLoc, renderUnitsPerPixel);
+    gl33::Uniform4f(burstSparksLoc, static_cast<float>(fireworkSparks), SPARK_DRAG, SPARK_GRAVITY, BURST_RADIUS);
+    gl33::BindVertexArray(burstVAO);
+    gl33::BindBuffer(GL_ARRAY_BUFFER, effectVBO);
+    const size_t base = first * sizeof(EffectInstance);
+    gl33::VertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(EffectInstance),
+        reinterpret_cast<const void*>(base + offsetof(EffectInstance, x)));
+    gl33::VertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(EffectInstance),
+        reinterpret_cast<const void*>(base + offsetof(EffectInstance, kind)));
+    gl33::VertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(EffectInstance),
+        reinterpret_cast<const void*>(base + offsetof(EffectInstance, r)));
+    gl33::VertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(EffectInstance),
+        reinterpret_cast<const void*>(base + offsetof(EffectInstance, seed)));
+    gl33::DrawArraysInstanced(GL_POINTS, 0, fireworkSparks, static_cast<GLsizei>(count));
+    gl33::BindVertexArray(0);
+    gl33::BindBuffer(GL_ARRAY_BUFFER, 0);
+    gl33::UseProgram(0);
+    glDisable(GL_PROGRAM_POINT_SIZE);
+
+    renderStats.drawCalls++;
+    renderStats.vertices += fireworkSparks * static_cast<int>(count);
+}
+
+// -------------------------------------------------------------
+// Textured sprites
+// -------------------------------------------------------------
+// Quads sampling a premultiplied-alpha texture (cells drawn opaque on a clear
+// background, or white glyph masks), tinted by one color per run. Used by
+// the crowd atlas and the glyph atlas; consecutive quads with the same
+// texture and tint are drawn with one call.
+struct SpriteVertex {
+    float x, y;  // world-space position
+    float u, v;  // atlas texture coordinates
+};
+
+GLuint spriteProgram = 0;
+GLuint spriteVAO = 0;
+GLuint spriteVBO = 0;
+GLint spriteViewLoc = -1;
+GLint spriteTintLoc = -1;
+
+const char* SPRITE_VERTEX_SHADER =
+    "#version 330 core\n"
+    "in vec2 aPos;\n"
+    "in vec2 aUV;\n"
+    "uniform vec4 uView;\n"
+    "out vec2 vUV;\n"
+    "void main() {\n"
+    "    vec2 ndc = (aPos - uView.xz) / (uView.yw - uView.xz) * 2.0 - 1.0;\n"
+    "    gl_Position = vec4(ndc, 0.0, 1.0);\n"
+    "    vUV = aUV;\n"
+    "}\n";
+
+const char* SPRITE_FRAGMENT_SHADER =
+    "#version 330 core\n"
+    "in vec2 vUV;\n"
+    "uniform sampler2D uTexture;\n"
+    "uniform vec4 uTint;\n"
+    "out vec4 fragColor;\n"
+    "void main() {\n"
+    "    fragColor = texture(uTexture, vUV) * uTint;\n"
+    "}\n";
+
+// Safe to call more than once; returns whether the sprite program is usable
+bool initSpriteRenderer() {
+    if (spriteProgram) return true;
+    spriteProgram = gl33::buildProgram(SPRITE_VERTEX_SHADER, SPRITE_FRAGMENT_SHADER, { "aPos", "aUV" });
+    if (!spriteProgram) return false;
+    spriteViewLoc = gl33::GetUniformLocation(spriteProgram, "uView");
+    spriteTintLoc = gl33::GetUniformLocation(spriteProgram, "uTint");
+
+    gl33::GenVertexArrays(1, &spriteVAO);
+    gl33::GenBuffers(1, &spriteVBO);
+    gl33::BindVertexArray(spriteVAO);
+    gl33::BindBuffer(GL_ARRAY_BUFFER, spriteVBO);
+    gl33::EnableVertexAttribArray(0);
+    gl33::VertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteVertex),
+        reinterpret_cast<const void*>(offsetof(SpriteVertex, x)));
+    gl33::EnableVertexAttribArray(1);
+    gl33::VertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteVertex),
+        reinterpret_cast<const void*>(offsetof(SpriteVertex, u)));
+    gl33::BindVertexArray(0);
+    gl33::BindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+// Draw vertices [first, first + count) of the uploaded sprite buffer with one call
+void drawSpriteRun(size_t first, size_t count, GLuint texture, const Color& tint) {
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    gl33::UseProgram(spriteProgram);
+    gl33::Uniform4f(spriteViewLoc, viewportLeftX, viewportRightX, viewportBottomY, viewportTopY);
+    gl33::Uniform4f(spriteTintLoc, tint.r, tint.g, tint.b, 1.0f);
+    gl33::BindVertexArray(spriteVAO);
+    glDrawArrays(GL_TRIANGLES, static_cast<GLint>(first), static_cast<GLsizei>(count));
+    gl33::BindVertexArray(0);
+    gl33::UseProgram(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_BLEND);
+
+    renderStats.drawCalls++;
+    renderStats.vertices += static_cast<int>(count);
+}
+
+// -------------------------------------------------------------
+// Draw lists
+// -------------------------------------------------------------
+// Batched drawing is recorded, not issued: geometry, prop instances, effects
+// and sprites are appended to the active draw list, and every change of kind
+// (or of prop type, sprite texture or tint) starts a new run. Submitting a
+// list uploads each of its arrays once and draws the runs in order, one call
+// each. The GL thread records into mainDrawList and submits it whenever GL
+// state has to change (flushBatch); worker threads record into lists of
+// their own, which the GL thread submits afterwards in layer order.
+enum DrawRunKind { RUN_GEOMETRY, RUN_PROPS, RUN_EFFECTS, RUN_BURSTS, RUN_SPRITES };
+
+struct DrawRun {
+    DrawRunKind kind;
+    size_t first, count;  // Range in the list's array for this kind (bursts are effects)
+    int propType;         // RUN_PROPS
+    GLuint texture;       // RUN_SPRITES
+    Color tint;           // RUN_SPRITES
+};
+
+struct DrawList {
+    std::vector<BatchVertex> vertices;
+    std::vector<PropInstance> instances;
+    std::vector<EffectInstance> effects;
+    std::vector<SpriteVertex> sprites;
+    std::vector<DrawRun> runs;
+
+    bool empty() const { return runs.empty(); }
+
+    void clear() {  // Keeps the capacity for the next frame
+        vertices.clear();
+        instances.clear();
+        effects.clear();
+        sprites.clear();
+        runs.clear();
+    }
+
+    // The run new items of this kind go into, starting one if the last run differs
+    DrawRun& runFor(DrawRunKind kind, size_t first, int propType = -1, GLuint texture = 0,
+        const Color& tint = { 1.0f, 1.0f, 1.0f }) {
+        if (!runs.empty()) {
+            DrawRun& last = runs.back();
+            bool same = last.kind == kind && last.propType == propType && last.texture == texture &&
+                last.tint.r == tint.r && last.tint.g == tint.g && last.tint.b == tint.b;
+            if (same) return last;
+        }
+        runs.push_back({ kind, first, 0, propType, texture, tint });
+        return runs.back();
+    }
+};
+
+DrawList mainDrawList;
+thread_local DrawList* activeDrawList = &mainDrawList;
+
+// Split view records the whole frame before drawing any of it. While
+// recordingFrame is set, flushBatch() seals the main list into the frame's
+// steps instead of drawing it, submitted lists are queued as steps, and GL
+// passes that are not draw lists (the star field) are queued as callbacks.
+struct FrameStep {
+    DrawList* list;      // Recorded draws, or
+    void (*pass)();      // a GL pass to run as is
+    bool keep;           // The list outlives the frame (a static layer), so it is not cleared
+};
+
+bool recordingFrame = false;
+std::vector<FrameStep> frameSteps;
+std::deque<DrawList> sealedDrawLists;  // The GL thread's lists for this frame (a deque keeps them in place)
+size_t sealedDrawListsUsed = 0;
+
+// Put a list's arrays in the shared buffers, ready for drawDrawListRuns()
+void uploadDrawList(const DrawList& list) {
+    auto upload = [](GLuint buffer, const void* data, size_t bytes) {
+        if (bytes == 0) return;
+        gl33::BindBuffer(GL_ARRAY_BUFFER, buffer);
+        gl33::BufferData(GL_ARRAY_BUFFER, bytes, data, GL_STREAM_DRAW);
+    };
+    upload(batchVBO, list.vertices.data(), list.vertices.size() * sizeof(BatchVertex));
+    upload(propInstanceVBO, list.instances.data(), list.instances.size() * sizeof(PropInstance));
+    upload(effectVBO, list.effects.data(), list.effects.size() * sizeof(EffectInstance));
+    upload(spriteVBO, list.sprites.data(), list.sprites.size() * sizeof(SpriteVertex));
+    gl33::BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void drawDrawListRuns(const DrawList& list) {
+    for (const DrawRun& run : list.runs) {
+        if (run.count == 0) continue;
+        switch (run.kind) {
+        case RUN_GEOMETRY: drawGeometryRun(run.first, run.count); break;
+        case RUN_PROPS:    drawPropRun(run.propType, run.first, run.count); break;
+        case RUN_EFFECTS:  drawEffectRun(run.first, run.count); break;
+        case RUN_BURSTS:   drawBurstRun(run.first, run.count); break;
+        case RUN_SPRITES:  drawSpriteRun(run.first, run.count, run.texture, run.tint); break;
+        }
+    }
+}
+
+// Upload a recorded list and draw its runs in order (GL thread only). The
+// software backend has no GL to draw with; it takes the geometry over into
+// mainDrawList and rasterizes the lot at the end of the frame.
+void submitDrawList(DrawList& list) {
+    if (renderBackend == BACKEND_SOFTWARE) {
+        if (&list != &mainDrawList) {
+            mainDrawList.vertices.insert(mainDrawList.vertices.end(), list.vertices.begin(), list.vertices.end());
+            list.clear();
+        }
+        return;
+    }
+    if (list.empty()) return;
+    if (recordingFrame) {
+        frameSteps.push_back({ &list, nullptr, false });
+        return;
+    }
+    uploadDrawList(list);
+    drawDrawListRuns(list);
+    list.clear();
+}
+
+// Draw whatever the GL thread has recorded so far
+void flushBatch() {
+    if (renderBackend == BACKEND_SOFTWARE) return;  // Rasterized once, at the end of the frame
+    if (recordingFrame) {
+        if (mainDrawList.empty()) return;
+        if (sealedDrawListsUsed == sealedDrawLists.size()) sealedDrawLists.emplace_back();
+        DrawList& sealed = sealedDrawLists[sealedDrawListsUsed++];
+        std::swap(sealed, mainDrawList);  // Main takes over the sealed list's (cleared) storage
+        frameSteps.push_back({ &sealed, nullptr, false });
+        return;
+    }
+    submitDrawList(mainDrawList);
+}
+
+// Run a GL pass after everything recorded so far (or queue it, in split view)
+void submitPass(void (*pass)()) {
+    flushBatch();
+    if (recordingFrame) frameSteps.push_back({ nullptr, pass, false });
+    else pass();
+}
+
+inline void batchWorldVertex(float x, float y, const Color& c) {
+    DrawList& list = *activeDrawList;
+    list.runFor(RUN_GEOMETRY, list.vertices.size()).count++;
+    list.vertices.push_back({ x, y, c.r, c.g, c.b, 1.0f });
+}
+
+inline void batchVertex(float x, float y, const Color& c) {
+    float wx, wy;
+    transformPoint(x, y, wx, wy);
+    batchWorldVertex(wx, wy, c);
+}
+
+inline void batchTriangle(float x1, float y1, float x2, float y2, float x3, float y3, const Color& c) {
+    batchVertex(x1, y1, c);
+    batchVertex(x2, y2, c);
+    batchVertex(x3, y3, c);
+}
+
+// Lines become quads whose width is measured in window pixels, like glLineWidth,
+// but never thinner than one render-target pixel so they don't break up when
+// dynamic resolution scales the target down
+void batchLine(float x1, float y1, float x2, float y2, const Color& c, float lineW) {
+    float wx1, wy1, wx2, wy2;
+    transformPoint(x1, y1, wx1, wy1);
+    transformPoint(x2, y2, wx2, wy2);
+    float dx = wx2 - wx1, dy = wy2 - wy1;
+    float len = sqrtf(dx * dx + dy * dy);
+    if (len <= 0.0f) return;
+    float half = 0.5f * std::max(lineW * unitsPerPixel, renderUnitsPerPixel);
+    float nx = -dy / len * half, ny = dx / len * half;
+    batchWorldVertex(wx1 + nx, wy1 + ny, c);
+    batchWorldVertex(wx1 - nx, wy1 - ny, c);
+    batchWorldVertex(wx2 - nx, wy2 - ny, c);
+    batchWorldVertex(wx1 + nx, wy1 + ny, c);
+    batchWorldVertex(wx2 - nx, wy2 - ny, c);
+    batchWorldVertex(wx2 + nx, wy2 + ny, c);
+}
+
+// Queue sprite quads (a triangle list); a new texture or tint starts a new run
+void submitSprites(const SpriteVertex* vertices, size_t count, GLuint texture, const Color& tint) {
+    DrawList& list = *activeDrawList;
+    list.runFor(RUN_SPRITES, list.sprites.size(), -1, texture, tint).count += count;
+    list.sprites.insert(list.sprites.end(), vertices, vertices + count);
+}
+
+thread_local Color currentColor = { 1.0f, 1.0f, 1.0f };
+
+// Immediate mode: the last color and line width sent to GL, so repeated
+// helper calls with the same state skip the GL call
+Color appliedColor = { 1.0f, 1.0f, 1.0f };
+float appliedLineWidth = 1.0f;
+
+inline void setColor(const Color& c) {
+    currentColor = c;
+    if (renderBackend != BACKEND_IMMEDIATE) return;
+    if (c.r == appliedColor.r && c.g == appliedColor.g && c.b == appliedColor.b) return;
+    glColor3f(c.r, c.g, c.b);
+    appliedColor = c;
+}
+
+inline void setLineWidth(float lineW) {
+    if (lineW == appliedLineWidth) return;
+    glLineWidth(lineW);
+    appliedLineWidth = lineW;
+}
+
+// Text and other immediate-only drawing: flush pending geometry first and put
+// the CPU transform on the GL stack so raster positions land in the same place.
+void beginImmediateDraw() {
+    if (renderBackend == BACKEND_IMMEDIATE) return;
+    flushBatch();
+    const Transform2D& m = currentTransform;
+    GLfloat matrix[16] = {
+        m.a,  m.b,  0.0f, 0.0f,
+        m.c,  m.d,  0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f,
+        m.tx, m.ty, 0.0f, 1.0f
+    };
+    glMatrixMode(GL_MODELVIEW);
+    glLoadMatrixf(matrix);
+    glColor3f(currentColor.r, currentColor.g, currentColor.b);
+}
+
+// -------------------------------------------------------------
+// Static layer cache
+// -------------------------------------------------------------
+// Layers that only change on resize, building destruction or restart are
+// rendered once into framebuffer-object textures and then composited with
+// one textured quad each per frame.
+enum SceneLayer { LAYER_SKY, LAYER_CAMPUS, NUM_CACHED_LAYERS };
+
+struct CachedLayer {
+    GLuint fbo;
+    GLuint texture;
+    int width, height;  // Texture size (matches the window)
+    bool dirty;         // Needs re-rendering before the next composite
+};
+
+CachedLayer cachedLayers[NUM_CACHED_LAYERS] = {};
+bool layerCacheEnabled = false;   // Set in initRenderer() when framebuffer objects are usable
+bool disableLayerCache = false;   // --no-layer-cache command-line flag
+
+GLuint compositeProgram = 0;
+GLuint compositeVAO = 0;
+GLuint compositeVBO = 0;
+
+const char* COMPOSITE_VERTEX_SHADER =
+    "#version 330 core\n"
+    "in vec2 aPos;\n"
+    "out vec2 vUV;\n"
+    "void main() {\n"
+    "    vUV = aPos * 0.5 + 0.5;\n"
+    "    gl_Position = vec4(aPos, 0.0, 1.0);\n"
+    "}\n";
+
+const char* COMPOSITE_FRAGMENT_SHADER =
+    "#version 330 core\n"
+    "in vec2 vUV;\n"
+    "uniform sampler2D uTexture;\n"
+    "out vec4 fragColor;\n"
+    "void main() {\n"
+    "    fragColor = texture(uTexture, vUV);\n"
+    "}\n";
+
+bool initLayerCache() {
+    for (int i = 0; i < NUM_CACHED_LAYERS; ++i) {
+        CachedLayer& layer = cachedLayers[i];
+        gl33::GenFramebuffers(1, &layer.fbo);
+        glGenTextures(1, &layer.texture);
+        layer.width = layer.height = 0;
+        layer.dirty = true;
+    }
+
+    if (renderBackend == BACKEND_BATCHED) {
+        compositeProgram = gl33::buildProgram(COMPOSITE_VERTEX_SHADER, COMPOSITE_FRAGMENT_SHADER, { "aPos" });
+        if (!compositeProgram) return false;
+
+        const float quad[8] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+        gl33::GenVertexArrays(1, &compositeVAO);
+        gl33::GenBuffers(1, &compositeVBO);
+        gl33::BindVertexArray(compositeVAO);
+        gl33::BindBuffer(GL_ARRAY_BUFFER, compositeVBO);
+        gl33::BufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+        gl33::EnableVertexAttribArray(0);
+        gl33::VertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), nullptr);
+        gl33::BindVertexArray(0);
+        gl33::BindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    return true;
+}
+
+// Split view draws the frame through several cameras, and a texture cached at
+// one camera's scale would come out blurred in the close-ups, so there the
+// static layers are cached as recorded draw lists instead: world-space
+// geometry, re-recorded on the same invalidations.
+DrawList staticLayerLists[NUM_CACHED_LAYERS];
+bool staticLayerListDirty[NUM_CACHED_LAYERS] = { true, true };
+
+void invalidateLayer(SceneLayer id) {
+    cachedLayers[id].dirty = true;
+    staticLayerListDirty[id] = true;
+}
+
+void invalidateLayerCache() {
+    for (int i = 0; i < NUM_CACHED_LAYERS; ++i) {
+        cachedLayers[i].dirty = true;
+        staticLayerListDirty[i] = true;
+    }
+}
+
+void drawStaticLayerList(SceneLayer id, void (*drawLayer)()) {
+    DrawList& list = staticLayerLists[id];
+    if (staticLayerListDirty[id]) {
+        list.clear();
+        activeDrawList = &list;
+        resetTransform();
+        drawLayer();
+        activeDrawList = &mainDrawList;
+        resetTransform();
+        staticLayerListDirty[id] = false;
+    }
+    flushBatch();
+    if (recordingFrame) {
+        frameSteps.push_back({ &list, nullptr, true });
+    } else {
+        uploadDrawList(list);
+        drawDrawListRuns(list);
+    }
+}
+
+// Re-render one layer into its texture. Returns false if the framebuffer is unusable.
+bool renderLayerToTexture(SceneLayer id, void (*drawLayer)(), const Color& clearColor, float clearAlpha) {
+    CachedLayer& layer = cachedLayers[id];
+    if (layer.width != winW || layer.height != winH) {
+        glBindTexture(GL_TEXTURE_2D, layer.texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, winW, winH, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        layer.width = winW;
+        layer.height = winH;
+    }
+
+    // Whatever is bound now (the window, or an offscreen target) is restored afterwards
+    GLint prevFramebuffer = 0;
+    GLint prevViewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, prevViewport);
+
+    gl33::BindFramebuffer(GL_FRAMEBUFFER, layer.fbo);
+    gl33::FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, layer.texture, 0);
+    bool complete = gl33::CheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (complete) {
+        glViewport(0, 0, layer.width, layer.height);
+        glClearColor(clearColor.r, clearColor.g, clearColor.b, clearAlpha);
+        glClear(GL_COLOR_BUFFER_BIT);
+        resetTransform();
+        drawLayer();
+        flushBatch();
+        layer.dirty = false;
+    }
+
+    gl33::BindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(prevFramebuffer));
+    glViewport(prevViewport[0], prevViewport[1], prevViewport[2], prevViewport[3]);
+    return complete;
+}
+
+// Draw a cached layer over the whole render target. Transparent layers are
+// blended (premultiplied alpha, since everything is drawn opaque on a clear
+// background); opaque ones simply replace what is there.
+void compositeLayer(SceneLayer id, bool transparent) {
+    flushBatch();
+    glBindTexture(GL_TEXTURE_2D, cachedLayers[id].texture);
+    if (transparent) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+    if (renderBackend == BACKEND_BATCHED) {
+        gl33::UseProgram(compositeProgram);
+        gl33::BindVertexArray(compositeVAO);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        gl33::BindVertexArray(0);
+        gl33::UseProgram(0);
+    } else {
+        glMatrixMode(GL_PROJECTION);
+        glPushMatrix();
+        glLoadIdentity();
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        glLoadIdentity();
+        glEnable(GL_TEXTURE_2D);
+        setColor({1.0f, 1.0f, 1.0f});
+        glBegin(GL_QUADS);
+        glTexCoord2f(0.0f, 0.0f); glVertex2f(-1.0f, -1.0f);
+        glTexCoord2f(1.0f, 0.0f); glVertex2f(1.0f, -1.0f);
+        glTexCoord2f(1.0f, 1.0f); glVertex2f(1.0f, 1.0f);
+        glTexCoord2f(0.0f, 1.0f); glVertex2f(-1.0f, 1.0f);
+        glEnd();
+        glDisable(GL_TEXTURE_2D);
+        glPopMatrix();
+        glMatrixMode(GL_PROJECTION);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
+    }
+
+    if (transparent) glDisable(GL_BLEND);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    renderStats.drawCalls++;
+    renderStats.vertices += 4;
+}
+
+void initRenderer() {
+    if (forceSoftwareMode) {
+        renderBackend = BACKEND_SOFTWARE;  // No GL at all; the layer cache and shader effects stay off
+        return;
+    }
+    renderBackend = BACKEND_IMMEDIATE;
+    gl33Available = loadGL33();
+    if (!forceImmediateMode) {
+        if (gl33Available && initBatchRenderer()) {
+            renderBackend = BACKEND_BATCHED;
+        } else {
+            std::cerr << "GL 3.3 batched renderer unavailable, using immediate mode" << std::endl;
+        }
+    }
+    layerCacheEnabled = gl33Available && !disableLayerCache && initLayerCache();
+}
+
+// -------------------------------------------------------------
+// Dynamic resolution
+// -------------------------------------------------------------
+// --dynamic-res renders the scene into an offscreen target at resolutionScale
+// times the window size and upscales it into the window with one linear blit;
+// the stats HUD is drawn afterwards at full resolution. The GPU time of each
+// scene pass is measured with a ring of timer queries (read back a few frames
+// late so nothing stalls), smoothed with a moving average, and the scale is
+// nudged towards the size whose fill cost fits the target frame time. Wall
+// clock frame time is no use here: under vsync it never drops below the
+// refresh interval, so there would be no signal to scale back up on.
+bool dynamicResolution = false;        // --dynamic-res
+float dynamicResMinScale = 0.5f;       // --min-scale
+float dynamicResMaxScale = 1.0f;       // --max-scale
+float dynamicResTargetMs = 14.0f;      // --target-ms: GPU budget, leaving headroom under a 60 Hz frame
+float resolutionScale = 1.0f;          // Current scale of the scene target
+float sceneGpuMsAverage = 0.0f;        // Moving average of the measured scene pass time
+
+GLuint sceneFramebuffer = 0;
+GLuint sceneColorTexture = 0;
+int sceneTextureW = 0, sceneTextureH = 0;  // Allocated at the max scale so scaling never reallocates
+int sceneW = 0, sceneH = 0;                // Part of the texture used this frame
+GLint sceneOutputFramebuffer = 0;          // Where the upscaled frame goes (window or headless target)
+bool scenePassActive = false;
+
+const int FRAME_TIMER_QUERIES = 4;
+GLuint frameTimerQueries[FRAME_TIMER_QUERIES];
+int frameTimerNext = 0;                // Next query to begin
+int frameTimerPending = 0;             // Queries ended but not yet read back
+bool frameTimerRunning = false;
+
+// Batched backend only: immediate mode's bitmap text and glLineWidth are sized
+// in render-target pixels, so they would grow as the scale drops
+bool initDynamicResolution() {
+    if (renderBackend != BACKEND_BATCHED) return false;
+    gl33::GenFramebuffers(1, &sceneFramebuffer);
+    glGenTextures(1, &sceneColorTexture);
+    gl33::GenQueries(FRAME_TIMER_QUERIES, frameTimerQueries);
+    if (dynamicResMaxScale < dynamicResMinScale) std::swap(dynamicResMinScale, dynamicResMaxScale);
+    resolutionScale = dynamicResMaxScale;
+    return true;
+}
+
+// Fill cost goes with the pixel count, i.e. the square of the scale. Steps
+// are capped at 5% a frame and a small dead band around the target keeps the
+// scale from hunting back and forth.
+void updateResolutionScale(float gpuMs) {
+    sceneGpuMsAverage = (sceneGpuMsAverage > 0.0f) ? sceneGpuMsAverage * 0.9f + gpuMs * 0.1f : gpuMs;
+    float ratio = dynamicResTargetMs / std::max(sceneGpuMsAverage, 0.01f);
+    if (ratio > 0.95f && ratio < 1.05f) return;
+    float wanted = resolutionScale * sqrtf(ratio);
+    wanted = std::min(std::max(wanted, resolutionScale * 0.95f), resolutionScale * 1.05f);
+    resolutionScale = std::min(std::max(wanted, dynamicResMinScale), dynamicResMaxScale);
+}
+
+// Read back every finished timer query, oldest first
+void collectFrameTimers() {
+    while (frameTimerPending > 0) {
+        GLuint query = frameTimerQueries[(frameTimerNext - frameTimerPending + FRAME_TIMER_QUERIES) % FRAME_TIMER_QUERIES];
+        GLint available = 0;
+        gl33::GetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+        GLuint64 nanoseconds = 0;
+        gl33::GetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+        frameTimerPending--;
+        updateResolutionScale(static_cast<float>(nanoseconds) * 1e-6f);
+    }
+}
+
+// Redirect drawing into the scaled scene target. Does nothing (and the scene
+// goes straight to the current framebuffer) unless --dynamic-res is active.
+// Returns false if the caller should clear the current framebuffer itself.
+bool beginScenePass(const Color& clearColor) {
+    if (!dynamicResolution) return false;
+    collectFrameTimers();
+
+    int maxW = std::max(1, static_cast<int>(ceilf(winW * dynamicResMaxScale)));
+    int maxH = std::max(1, static_cast<int>(ceilf(winH * dynamicResMaxScale)));
+    if (maxW != sceneTextureW || maxH != sceneTextureH) {
+        glBindTexture(GL_TEXTURE_2D, sceneColorTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, maxW, maxH, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        sceneTextureW = maxW;
+        sceneTextureH = maxH;
+    }
+    sceneW = std::min(sceneTextureW, std::max(1, static_cast<int>(winW * resolutionScale + 0.5f)));
+    sceneH = std::min(sceneTextureH, std::max(1, static_cast<int>(winH * resolutionScale + 0.5f)));
+
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &sceneOutputFramebuffer);
+    gl33::BindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+    gl33::FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sceneColorTexture, 0);
+    if (gl33::CheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Dynamic resolution target unusable, rendering at full size" << std::endl;
+        gl33::BindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(sceneOutputFramebuffer));
+        dynamicResolution = false;
+        return false;
+    }
+
+    frameTimerRunning = frameTimerPending < FRAME_TIMER_QUERIES;
+    if (frameTimerRunning) gl33::BeginQuery(GL_TIME_ELAPSED, frameTimerQueries[frameTimerNext]);
+
+    // Clearing the whole texture (not just the used part) keeps the blit's
+    // edge samples from picking up a frame drawn at a larger scale
+    glViewport(0, 0, sceneW, sceneH);
+    glClearColor(clearColor.r, clearColor.g, clearColor.b, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    renderUnitsPerPixel = unitsPerPixel * static_cast<float>(winW) / static_cast<float>(sceneW);
+    scenePassActive = true;
+    return true;
+}
+
+// Finish the scene and upscale it into the output framebuffer
+void endScenePass() {
+    if (!scenePassActive) return;
+    flushBatch();
+    if (frameTimerRunning) {
+        gl33::EndQuery(GL_TIME_ELAPSED);
+        frameTimerNext = (frameTimerNext + 1) % FRAME_TIMER_QUERIES;
+        frameTimerPending++;
+    }
+
+    gl33::BindFramebuffer(GL_READ_FRAMEBUFFER, sceneFramebuffer);
+    gl33::BindFramebuffer(GL_DRAW_FRAMEBUFFER, static_cast<GLuint>(sceneOutputFramebuffer));
+    gl33::BlitFramebuffer(0, 0, sceneW, sceneH, 0, 0, winW, winH, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    gl33::BindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(sceneOutputFramebuffer));
+    glViewport(0, 0, winW, winH);
+    renderUnitsPerPixel = unitsPerPixel;
+    renderStats.drawCalls++;
+    scenePassActive = false;
+}
+
+// -------------------------------------------------------------
+// Global helpers
+// -------------------------------------------------------------
+// Like batchLine(), while dynamic resolution has the target scaled down a
+// rect thinner than one of its pixels either way is widened to one, so
+// flagpoles and the like don't drop out. At full scale rects are drawn as given.
+void filledRect(float x1, float y1, float x2, float y2, const Color& c) {
+    if (renderBackend != BACKEND_IMMEDIATE) {
+        if (renderUnitsPerPixel > unitsPerPixel) {
+            const Transform2D& m = currentTransform;
+            float lenX = sqrtf(m.a * m.a + m.b * m.b);
+            float lenY = sqrtf(m.c * m.c + m.d * m.d);
+            if (lenX > 0.0f && fabsf(x2 - x1) * lenX < renderUnitsPerPixel) {
+                float mid = 0.5f * (x1 + x2);
+                float half = 0.5f * renderUnitsPerPixel / lenX;
+                x1 = mid - half;
+                x2 = mid + half;
+            }
+            if (lenY > 0.0f && fabsf(y2 - y1) * lenY < renderUnitsPerPixel) {
+                float mid = 0.5f * (y1 + y2);
+                float half = 0.5f * renderUnitsPerPixel / lenY;
+                y1 = mid - half;
+                y2 = mid + half;
+            }
+        }
+        batchTriangle(x1, y1, x2, y1, x2, y2, c);
+        batchTriangle(x1, y1, x2, y2, x1, y2, c);
+        return;
+    }
+    setColor(c);
+    glBegin(GL_QUADS);
+    glVertex2f(x1, y1);
+    glVertex2f(x2, y1);
+    glVertex2f(x2, y2);
+    glVertex2f(x1, y2);
+    glEnd();
+}
+
+void outlineRect(float x1, float y1, float x2, float y2,
+    const Color& c, float lineW = 2.0f) {
+    if (renderBackend != BACKEND_IMMEDIATE) {
+        batchLine(x1, y1, x2, y1, c, lineW);
+        batchLine(x2, y1, x2, y2, c, lineW);
+        batchLine(x2, y2, x1, y2, c, lineW);
+        batchLine(x1, y2, x1, y1, c, lineW);
+        return;
+    }
+    setColor(c);
+    setLineWidth(lineW);
+    glBegin(GL_LINE_LOOP);
+    glVertex2f(x1, y1);
+    glVertex2f(x2, y1);
+    glVertex2f(x2, y2);
+    glVertex2f(x1, y2);
+    glEnd();
+}
+
+// alias for city code
+void outlinedRect(float x1, float y1, float x2, float y2,
+    const Color& border, float lineW = 2.0f) {
+    outlineRect(x1, y1, x2, y2, border, lineW);
+}
+
+void framedRect(float x1, float y1, float x2, float y2,
+    const Color& fill, const Color& border, float lw = 2.0f) {
+    filledRect(x1, y1, x2, y2, fill);
+    outlineRect(x1, y1, x2, y2, border, lw);
+}
+
+void filledTriangle(float x1, float y1, float x2, float y2, float x3, float y3, const Color& c) {
+    if (renderBackend != BACKEND_IMMEDIATE) {
+        batchTriangle(x1, y1, x2, y2, x3, y3, c);
+        return;
+    }
+    setColor(c);
+    glBegin(GL_TRIANGLES);
+    glVertex2f(x1, y1);
+    glVertex2f(x2, y2);
+    glVertex2f(x3, y3);
+    glEnd();
+}
+
+void outlineTriangle(float x1, float y1, float x2, float y2, float x3, float y3,
+    const Color& c, float lineW = 1.0f) {
+    if (renderBackend != BACKEND_IMMEDIATE) {
+        batchLine(x1, y1, x2, y2, c, lineW);
+        batchLine(x2, y2, x3, y3, c, lineW);
+        batchLine(x3, y3, x1, y1, c, lineW);
+        return;
+    }
+    setColor(c);
+    setLineWidth(lineW);
+    glBegin(GL_LINE_LOOP);
+    glVertex2f(x1, y1);
+    glVertex2f(x2, y2);
+    glVertex2f(x3, y3);
+    glEnd();
+}
+
+// Convex polygon given as x,y pairs
+void filledPolygon(const float* xy, int count, const Color& c) {
+    if (renderBackend != BACKEND_IMMEDIATE) {
+        for (int i = 1; i + 1 < count; ++i) {
+            batchTriangle(xy[0], xy[1], xy[2 * i], xy[2 * i + 1], xy[2 * i + 2], xy[2 * i + 3], c);
+        }
+        return;
+    }
+    setColor(c);
+    glBegin(GL_POLYGON);
+    for (int i = 0; i < count; ++i) glVertex2f(xy[2 * i], xy[2 * i + 1]);
+    glEnd();
+}
+
+// Independent line segments given as x1,y1,x2,y2 quadruples
+void drawLines(const float* xy, int segments, const Color& c, float lineW = 1.0f) {
+    if (renderBackend != BACKEND_IMMEDIATE) {
+        for (int i = 0; i < segments; ++i) {
+            const float* s = xy + 4 * i;
+            batchLine(s[0], s[1], s[2], s[3], c, lineW);
+        }
+        return;
+    }
+    setColor(c);
+    setLineWidth(lineW);
+    glBegin(GL_LINES);
+    for (int i = 0; i < segments; ++i) {
+        glVertex2f(xy[4 * i], xy[4 * i + 1]);
+        glVertex2f(xy[4 * i + 2], xy[4 * i + 3]);
+    }
+    glEnd();
+}
+
+void drawLine(float x1, float y1, float x2, float y2, const Color& c, float lineW = 1.0f) {
+    float xy[4] = { x1, y1, x2, y2 };
+    drawLines(xy, 1, c, lineW);
+}
+
+// -------------------------------------------------------------
+// Built-in font
+// -------------------------------------------------------------
+// GLUT's fonts are unusable without glutInit, which headless mode never
+// calls, so text goes through these wrappers. When headless they draw a
+// 5x7 pixel font instead: as glBitmap glyphs for the bitmap fonts, and as
+// line segments joining neighbouring pixels for the stroke font.
+const unsigned char BUILTIN_FONT[95][5] = {  // ' ' through '~', one byte per column, bit 0 at the top
+    {0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x5F,0x00,0x00}, {0x00,0x07,0x00,0x07,0x00}, {0x14,0x7F,0x14,0x7F,0x14},
+    {0x24,0x2A,0x7F,0x2A,0x12}, {0x23,0x13,0x08,0x64,0x62}, {0x36,0x49,0x55,0x22,0x50}, {0x00,0x05,0x03,0x00,0x00},
+    {0x00,0x1C,0x22,0x41,0x00}, {0x00,0x41,0x22,0x1C,0x00}, {0x14,0x08,0x3E,0x08,0x14}, {0x08,0x08,0x3E,0x08,0x08},
+    {0x00,0x50,0x30,0x00,0x00}, {0x08,0x08,0x08,0x08,0x08}, {0x00,0x60,0x60,0x00,0x00}, {0x20,0x10,0x08,0x04,0x02},
+    {0x3E,0x51,0x49,0x45,0x3E}, {0x00,0x42,0x7F,0x40,0x00}, {0x42,0x61,0x51,0x49,0x46}, {0x21,0x41,0x45,0x4B,0x31},
+    {0x18,0x14,0x12,0x7F,0x10}, {0x27,0x45,0x45,0x45,0x39}, {0x3C,0x4A,0x49,0x49,0x30}, {0x01,0x71,0x09,0x05,0x03},
+    {0x36,0x49,0x49,0x49,0x36}, {0x06,0x49,0x49,0x29,0x1E}, {0x00,0x36,0x36,0x00,0x00}, {0x00,0x56,0x36,0x00,0x00},
+    {0x08,0x14,0x22,0x41,0x00}, {0x14,0x14,0x14,0x14,0x14}, {0x00,0x41,0x22,0x14,0x08}, {0x02,0x01,0x51,0x09,0x06},
+    {0x32,0x49,0x79,0x41,0x3E}, {0x7E,0x11,0x11,0x11,0x7E}, {0x7F,0x49,0x49,0x49,0x36}, {0x3E,0x41,0x41,0x41,0x22},
+    {0x7F,0x41,0x41,0x22,0x1C}, {0x7F,0x49,0x49,0x49,0x41}, {0x7F,0x09,0x09,0x09,0x01}, {0x3E,0x41,0x49,0x49,0x7A},
+    {0x7F,0x08,0x08,0x08,0x7F}, {0x00,0x41,0x7F,0x41,0x00}, {0x20,0x40,0x41,0x3F,0x01}, {0x7F,0x08,0x14,0x22,0x41},
+    {0x7F,0x40,0x40,0x40,0x40}, {0x7F,0x02,0x0C,0x02,0x7F}, {0x7F,0x04,0x08,0x10,0x7F}, {0x3E,0x41,0x41,0x41,0x3E},
+    {0x7F,0x09,0x09,0x09,0x06}, {0x3E,0x41,0x51,0x21,0x5E}, {0x7F,0x09,0x19,0x29,0x46}, {0x46,0x49,0x49,0x49,0x31},
+    {0x01,0x01,0x7F,0x01,0x01}, {0x3F,0x40,0x40,0x40,0x3F}, {0x1F,0x20,0x40,0x20,0x1F}, {0x3F,0x40,0x38,0x40,0x3F},
+    {0x63,0x14,0x08,0x14,0x63}, {0x07,0x08,0x70,0x08,0x07}, {0x61,0x51,0x49,0x45,0x43}, {0x00,0x7F,0x41,0x41,0x00},
+    {0x02,0x04,0x08,0x10,0x20}, {0x00,0x41,0x41,0x7F,0x00}, {0x04,0x02,0x01,0x02,0x04}, {0x40,0x40,0x40,0x40,0x40},
+    {0x00,0x01,0x02,0x04,0x00}, {0x20,0x54,0x54,0x54,0x78}, {0x7F,0x48,0x44,0x44,0x38}, {0x38,0x44,0x44,0x44,0x20},
+    {0x38,0x44,0x44,0x48,0x7F}, {0x38,0x54,0x54,0x54,0x18}, {0x08,0x7E,0x09,0x01,0x02}, {0x0C,0x52,0x52,0x52,0x3E},
+    {0x7F,0x08,0x04,0x04,0x78}, {0x00,0x44,0x7D,0x40,0x00}, {0x20,0x40,0x44,0x3D,0x00}, {0x7F,0x10,0x28,0x44,0x00},
+    {0x00,0x41,0x7F,0x40,0x00}, {0x7C,0x04,0x18,0x04,0x78}, {0x7C,0x08,0x04,0x04,0x78}, {0x38,0x44,0x44,0x44,0x38},
+    {0x7C,0x14,0x14,0x14,0x08}, {0x08,0x14,0x14,0x18,0x7C}, {0x7C,0x08,0x04,0x04,0x08}, {0x48,0x54,0x54,0x54,0x20},
+    {0x04,0x3F,0x44,0x40,0x20}, {0x3C,0x40,0x40,0x20,0x7C}, {0x1C,0x20,0x40,0x20,0x1C}, {0x3C,0x40,0x30,0x40,0x3C},
+    {0x44,0x28,0x10,0x28,0x44}, {0x0C,0x50,0x50,0x50,0x3C}, {0x44,0x64,0x54,0x4C,0x44}, {0x00,0x08,0x36,0x41,0x00},
+    {0x00,0x00,0x7F,0x00,0x00}, {0x00,0x41,0x36,0x08,0x00}, {0x08,0x04,0x08,0x10,0x08}
+};
+const float BUILTIN_STROKE_UNIT = 100.0f / 7.0f;  // Font units per pixel: caps as tall as GLUT's roman
+
+inline bool builtinPixel(int c, int column, int row) {
+    if (c < 32 || c > 126 || column < 0 || column >= 5 || row < 0 || row >= 7) return false;
+    return (BUILTIN_FONT[c - 32][column] >> row) & 1;
+}
+
+// The 18-point font is drawn at double size
+inline int builtinBitmapScale(void* font) {
+    return font == GLUT_BITMAP_HELVETICA_18 ? 2 : 1;
+}
+
+void builtinBitmapCharacter(void* font, int c) {
+    const int scale = builtinBitmapScale(font);
+    const int width = 5 * scale, height = 7 * scale;
+    const int rowBytes = (width + 31) / 32 * 4;  // Rows padded to the default unpack alignment
+    GLubyte bits[7 * 2 * 4] = {};
+    for (int y = 0; y < height; ++y) {
+        int row = 6 - y / scale;  // glBitmap rows run bottom to top
+        for (int x = 0; x < width; ++x) {
+            if (builtinPixel(c, x / scale, row)) bits[y * rowBytes + x / 8] |= 0x80 >> (x % 8);
+        }
+    }
+    glBitmap(width, height, 0.0f, 0.0f, 6.0f * scale, 0.0f, bits);
+}
+
+// Each lit pixel joins its lit neighbours to the right and below, and
+// diagonally where no orthogonal path already links them (x1, y1, x2, y2 in
+// font units, baseline at y = 0)
+void builtinStrokeSegments(int c, std::vector<float>& segments) {
+    const float u = BUILTIN_STROKE_UNIT;
+    auto segment = [&](float x1, float y1, float x2, float y2) {
+        segments.insert(segments.end(), { x1, y1, x2, y2 });
+    };
+    for (int row = 0; row < 7; ++row) {
+        for (int column = 0; column < 5; ++column) {
+            if (!builtinPixel(c, column, row)) continue;
+            float x = (column + 0.5f) * u, y = (6.5f - row) * u;
+            bool right = builtinPixel(c, column + 1, row);
+            bool below = builtinPixel(c, column, row + 1);
+            if (right) segment(x, y, x + u, y);
+            if (below) segment(x, y, x, y - u);
+            if (!right && !below && builtinPixel(c, column + 1, row + 1)) segment(x, y, x + u, y - u);
+            if (!below && !builtinPixel(c, column - 1, row) && builtinPixel(c, column - 1, row + 1)) {
+                segment(x, y, x - u, y - u);
+            }
+            bool lone = true;
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    if ((dx || dy) && builtinPixel(c, column + dx, row + dy)) lone = false;
+                }
+            }
+            if (lone) segment(x - 0.3f * u, y, x + 0.3f * u, y);
+        }
+    }
+}
+
+void builtinStrokeCharacter(int c) {
+    std::vector<float> segments;
+    builtinStrokeSegments(c, segments);
+    glBegin(GL_LINES);
+    for (size_t k = 0; k < segments.size(); k += 2) glVertex2f(segments[k], segments[k + 1]);
+    glEnd();
+    glTranslatef(6.0f * BUILTIN_STROKE_UNIT, 0.0f, 0.0f);
+}
+
+void bitmapCharacter(void* font, int c) {
+    if (headlessMode) builtinBitmapCharacter(font, c);
+    else glutBitmapCharacter(font, c);
+}
+
+int bitmapCharacterWidth(void* font, int c) {
+    return headlessMode ? 6 * builtinBitmapScale(font) : glutBitmapWidth(font, c);
+}
+
+int bitmapFontHeight(void* font) {
+    return headlessMode ? 10 * builtinBitmapScale(font) : glutBitmapHeight(font);
+}
+
+void strokeCharacter(int c) {
+    if (headlessMode) builtinStrokeCharacter(c);
+    else glutStrokeCharacter(GLUT_STROKE_ROMAN, c);
+}
+
+float strokeCharacterWidth(int c) {
+    return headlessMode ? 6.0f * BUILTIN_STROKE_UNIT : static_cast<float>(glutStrokeWidth(GLUT_STROKE_ROMAN, c));
+}
+
+// -------------------------------------------------------------
+// Text rendering
+// -------------------------------------------------------------
+// Glyphs are captured from the GLUT fonts once at startup: the bitmap fonts
+// into a white glyph atlas texture, the stroke font as line segments read
+// back through GL feedback mode. Laid-out strings are cached (by string and
+// font, or string and scale), so drawing text costs one textured draw or one
+// run of batched lines and no GLUT calls per frame.
+const int FIRST_GLYPH = 32;   // ' '
+const int NUM_GLYPHS = 95;    // through '~'
+const size_t MAX_CACHED_STRINGS = 256;  // Per cache; changing text (HUD numbers) would grow it forever
+
+struct BitmapFontAtlas {
+    void* font;
+    GLuint texture = 0;
+    int cellW = 0, cellH = 0;      // Cell size in pixels
+    int descent = 0;               // Baseline height inside a cell
+    int width = 0, height = 0;     // Texture size
+    int advance[NUM_GLYPHS] = {};
+    bool ready = false;
+    std::map<std::string, std::vector<SpriteVertex>> strings;  // Quads in pixels from the raster position
+
+    explicit BitmapFontAtlas(void* glutFont) : font(glutFont) {}
+};
+
+BitmapFontAtlas bitmapFonts[] = {
+    BitmapFontAtlas(GLUT_BITMAP_HELVETICA_18),
+    BitmapFontAtlas(GLUT_BITMAP_HELVETICA_12)
+};
+const int NUM_BITMAP_FONTS = sizeof(bitmapFonts) / sizeof(bitmapFonts[0]);
+
+struct StrokeGlyph {
+    std::vector<float> segments;  // x1, y1, x2, y2 in font units
+    float advance;
+};
+
+StrokeGlyph strokeGlyphs[NUM_GLYPHS];
+bool strokeFontReady = false;
+std::map<std::pair<std::string, float>, std::vector<float>> strokeStrings;  // Centered segments, scaled
+
+bool textCacheEnabled = false;   // Set by initTextRenderer()
+bool disableTextCache = false;   // --no-text-cache command-line flag
+std::vector<SpriteVertex> textVertices;
+
+inline bool isCachedGlyph(unsigned char c) {
+    return c >= FIRST_GLYPH && c < FIRST_GLYPH + NUM_GLYPHS;
+}
+
+// Rasterize every glyph of one bitmap font into its atlas with bitmapCharacter
+bool buildBitmapFontAtlas(BitmapFontAtlas& atlas) {
+    const int columns = 16;
+    int maxAdvance = 1;
+    for (int i = 0; i < NUM_GLYPHS; ++i) {
+        atlas.advance[i] = bitmapCharacterWidth(atlas.font, FIRST_GLYPH + i);
+        maxAdvance = std::max(maxAdvance, atlas.advance[i]);
+    }
+    int lineHeight = bitmapFontHeight(atlas.font);
+    atlas.cellW = maxAdvance + 4;            // Room for glyphs that overhang their advance
+    atlas.cellH = lineHeight + 4;
+    atlas.descent = (lineHeight + 3) / 4 + 2;
+    atlas.width = atlas.cellW * columns;
+    atlas.height = atlas.cellH * ((NUM_GLYPHS + columns - 1) / columns);
+
+    glGenTextures(1, &atlas.texture);
+    glBindTexture(GL_TEXTURE_2D, atlas.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlas.width, atlas.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLuint fbo = 0;
+    GLint prevFramebuffer = 0;
+    GLint prevViewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, prevViewport);
+    gl33::GenFramebuffers(1, &fbo);
+    gl33::BindFramebuffer(GL_FRAMEBUFFER, fbo);
+    gl33::FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, atlas.texture, 0);
+    bool complete = gl33::CheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (complete) {
+        glViewport(0, 0, atlas.width, atlas.height);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glMatrixMode(GL_PROJECTION);
+        glPushMatrix();
+        glLoadIdentity();
+        glOrtho(0.0, atlas.width, 0.0, atlas.height, -1.0, 1.0);
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        glLoadIdentity();
+        glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+        for (int i = 0; i < NUM_GLYPHS; ++i) {
+            glRasterPos2i((i % columns) * atlas.cellW + 2, (i / columns) * atlas.cellH + atlas.descent);
+            bitmapCharacter(atlas.font, FIRST_GLYPH + i);
+        }
+        glPopMatrix();
+        glMatrixMode(GL_PROJECTION);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
+    }
+    gl33::BindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(prevFramebuffer));
+    gl33::DeleteFramebuffers(1, &fbo);
+    glViewport(prevViewport[0], prevViewport[1], prevViewport[2], prevViewport[3]);
+    atlas.ready = complete;
+    return complete;
+}
+
+// Record every stroke glyph's line segments with GL feedback mode
+bool captureStrokeFont() {
+    const int feedbackSize = 16384;
+    std::vector<GLfloat> feedback(feedbackSize);
+    GLint prevViewport[4];
+    glGetIntegerv(GL_VIEWPORT, prevViewport);
+
+    // Map font units 1:1 onto a window big enough that nothing is clipped
+    const float half = 256.0f;
+    glViewport(0, 0, 2 * static_cast<int>(half), 2 * static_cast<int>(half));
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(-half, half, -half, half, -1.0, 1.0);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+
+    bool ok = true;
+    for (int i = 0; i < NUM_GLYPHS && ok; ++i) {
+        StrokeGlyph& glyph = strokeGlyphs[i];
+        glyph.advance = strokeCharacterWidth(FIRST_GLYPH + i);
+        glyph.segments.clear();
+
+        glLoadIdentity();
+        glFeedbackBuffer(feedbackSize, GL_2D, feedback.data());
+        glRenderMode(GL_FEEDBACK);
+        strokeCharacter(FIRST_GLYPH + i);
+        GLint count = glRenderMode(GL_RENDER);
+        if (count < 0) { ok = false; break; }  // Overflowed the buffer
+
+        for (GLint k = 0; k < count; ) {
+            GLint token = static_cast<GLint>(feedback[k++]);
+            if (token == GL_LINE_TOKEN || token == GL_LINE_RESET_TOKEN) {
+                for (int v = 0; v < 4; ++v) glyph.segments.push_back(feedback[k + v] - half);
+                k += 4;
+            } else if (token == GL_POLYGON_TOKEN) {
+                k += 1 + 2 * static_cast<GLint>(feedback[k]);
+            } else if (token == GL_PASS_THROUGH_TOKEN) {
+                k += 1;
+            } else {
+                k += 2;  // Point, bitmap and pixel tokens carry one vertex
+            }
+        }
+    }
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glViewport(prevViewport[0], prevViewport[1], prevViewport[2], prevViewport[3]);
+    strokeFontReady = ok;
+    return ok;
+}
+
+// The software backend has no GL to capture GLUT's glyphs with, so its
+// stroke text always comes from the built-in font
+void loadBuiltinStrokeFont() {
+    for (int i = 0; i < NUM_GLYPHS; ++i) {
+        strokeGlyphs[i].segments.clear();
+        builtinStrokeSegments(FIRST_GLYPH + i, strokeGlyphs[i].segments);
+        strokeGlyphs[i].advance = 6.0f * BUILTIN_STROKE_UNIT;
+    }
+    strokeFontReady = true;
+}
+
+void initTextRenderer() {
+    if (renderBackend == BACKEND_SOFTWARE) {
+        loadBuiltinStrokeFont();
+        textCacheEnabled = true;
+        return;
+    }
+    if (disableTextCache) return;
+    // Stroke text only needs feedback mode; the bitmap atlas needs the sprite program
+    captureStrokeFont();
+    if (renderBackend == BACKEND_BATCHED && initSpriteRenderer()) {
+        for (int i = 0; i < NUM_BITMAP_FONTS; ++i) buildBitmapFontAtlas(bitmapFonts[i]);
+    }
+    textCacheEnabled = true;
+}
+
+BitmapFontAtlas* findBitmapFont(void* font) {
+    if (!textCacheEnabled) return nullptr;
+    for (int i = 0; i < NUM_BITMAP_FONTS; ++i) {
+        if (bitmapFonts[i].font == font && bitmapFonts[i].ready) return &bitmapFonts[i];
+    }
+    return nullptr;
+}
+
+// Glyph quads for a string, in pixels from the raster position
+const std::vector<SpriteVertex>& layoutBitmapString(BitmapFontAtlas& atlas, const std::string& s) {
+    auto found = atlas.strings.find(s);
+    if (found != atlas.strings.end()) return found->second;
+    if (atlas.strings.size() >= MAX_CACHED_STRINGS) atlas.strings.clear();
+
+    std::vector<SpriteVertex>& quads = atlas.strings[s];
+    const int columns = atlas.width / atlas.cellW;
+    float du = 1.0f / atlas.width, dv = 1.0f / atlas.height;
+    float penX = 0.0f;
+    for (unsigned char c : s) {
+        if (!isCachedGlyph(c)) continue;
+        int i = c - FIRST_GLYPH;
+        float x1 = penX - 2.0f, y1 = static_cast<float>(-atlas.descent);
+        float x2 = x1 + atlas.cellW, y2 = y1 + atlas.cellH;
+        float u1 = (i % columns) * atlas.cellW * du, u2 = u1 + atlas.cellW * du;
+        float v1 = (i / columns) * atlas.cellH * dv, v2 = v1 + atlas.cellH * dv;
+        quads.push_back({ x1, y1, u1, v1 });
+        quads.push_back({ x2, y1, u2, v1 });
+        quads.push_back({ x2, y2, u2, v2 });
+        quads.push_back({ x1, y1, u1, v1 });
+        quads.push_back({ x2, y2, u2, v2 });
+        quads.push_back({ x1, y2, u1, v2 });
+        penX += atlas.advance[i];
+    }
+    return quads;
+}
+
+// Stroke segments for a string, scaled and centered on x = 0
+const std::vector<float>& layoutStrokeString(const std::string& s, float scale) {
+    auto key = std::make_pair(s, scale);
+    auto found = strokeStrings.find(key);
+    if (found != strokeStrings.end()) return found->second;
+    if (strokeStrings.size() >= MAX_CACHED_STRINGS) strokeStrings.clear();
+
+    float textWidth = 0.0f;
+    for (unsigned char c : s) {
+        if (isCachedGlyph(c)) textWidth += strokeGlyphs[c - FIRST_GLYPH].advance;
+    }
+
+    std::vector<float>& segments = strokeStrings[key];
+    float penX = -textWidth * 0.5f;
+    for (unsigned char c : s) {
+        if (!isCachedGlyph(c)) continue;
+        const StrokeGlyph& glyph = strokeGlyphs[c - FIRST_GLYPH];
+        for (size_t k = 0; k < glyph.segments.size(); k += 2) {
+            segments.push_back((penX + glyph.segments[k]) * scale);
+            segments.push_back(glyph.segments[k + 1] * scale);
+        }
+        penX += glyph.advance;
+    }
+    return segments;
+}
+
+// Software backend: built-in glyph pixels as rectangles, one per horizontal run
+void drawBuiltinText(const std::string& s, float x, float y, void* font) {
+    const int scale = builtinBitmapScale(font);
+    const float pixel = scale * unitsPerPixel;
+    float wx, wy;
+    transformPoint(x, y, wx, wy);
+    float originX = viewportLeftX + floorf((wx - viewportLeftX) / unitsPerPixel + 0.5f) * unitsPerPixel;
+    float originY = floorf(wy / unitsPerPixel + 0.5f) * unitsPerPixel;
+    for (unsigned char c : s) {
+        for (int row = 0; row < 7; ++row) {
+            float y1 = originY + (6 - row) * pixel, y2 = y1 + pixel;
+            for (int column = 0; column < 5; ) {
+                if (!builtinPixel(c, column, row)) { ++column; continue; }
+                int end = column;
+                while (builtinPixel(c, end, row)) ++end;
+                float x1 = originX + column * pixel, x2 = originX + end * pixel;
+                batchWorldVertex(x1, y1, currentColor);
+                batchWorldVertex(x2, y1, currentColor);
+                batchWorldVertex(x2, y2, currentColor);
+                batchWorldVertex(x1, y1, currentColor);
+                batchWorldVertex(x2, y2, currentColor);
+                batchWorldVertex(x1, y2, currentColor);
+                column = end;
+            }
+        }
+        originX += 6 * pixel;
+    }
+}
+
+void drawText(const std::string& s, float x, float y, void* font = GLUT_BITMAP_HELVETICA_18) {
+    if (renderBackend == BACKEND_SOFTWARE) {
+        drawBuiltinText(s, x, y, font);
+        return;
+    }
+    BitmapFontAtlas* atlas = findBitmapFont(font);
+    if (atlas) {
+        const std::vector<SpriteVertex>& quads = layoutBitmapString(*atlas, s);
+        // Snap the raster position to a pixel corner so glyph texels land on pixels
+        float wx, wy;
+        transformPoint(x, y, wx, wy);
+        float originX = viewportLeftX + floorf((wx - viewportLeftX) / unitsPerPixel + 0.5f) * unitsPerPixel;
+        float originY = floorf(wy / unitsPerPixel + 0.5f) * unitsPerPixel;
+        textVertices.clear();
+        for (const SpriteVertex& q : quads) {
+            textVertices.push_back({ originX + q.x * unitsPerPixel, originY + q.y * unitsPerPixel, q.u, q.v });
+        }
+        submitSprites(textVertices.data(), textVertices.size(), atlas->texture, currentColor);
+        return;
+    }
+
+    beginImmediateDraw();
+    glRasterPos2f(x, y);
+    for (char c : s) bitmapCharacter(font, c);
+}
+
+void drawCenteredText(const std::string& s, float centerX, float y,
+    float charWidth, void* font = GLUT_BITMAP_HELVETICA_18) {
+    float approxWidth = s.size() * charWidth;
+    float startX = centerX - approxWidth * 0.5f;
+    drawText(s, startX, y, font);
+}
+
+// Draw large text using stroke fonts (much bigger than bitmap fonts)
+void drawLargeStrokeText(const std::string& s, float centerX, float y, float scale, float lineW = 1.0f) {
+    if (textCacheEnabled && strokeFontReady) {
+        const std::vector<float>& segments = layoutStrokeString(s, scale);
+        pushTransform();
+        translateTransform(centerX, y);
+        drawLines(segments.data(), static_cast<int>(segments.size() / 4), currentColor, lineW);
+        popTransform();
+        return;
+    }
+
+    beginImmediateDraw();
+    setLineWidth(lineW);
+    glPushMatrix();
+
+    // Calculate text width first (before scaling)
+    float textWidth = 0.0f;
+    for (char c : s) {
+        textWidth += strokeCharacterWidth(c);
+    }
+
+    // Translate to center position, then scale, then offset by half text width
+    glTranslatef(centerX, y, 0.0f);
+    glScalef(scale, scale, 1.0f);
+    glTranslatef(-textWidth * 0.5f, 0.0f, 0.0f);
+
+    // Draw text with stroke font
+    for (char c : s) {
+        strokeCharacter(c);
+    }
+
+    glPopMatrix();
+}
+
+// -------------------------------------------------------------
+// Sound effect functions
+// -------------------------------------------------------------
+void playSound(const char* soundFile) {
+#ifdef _WIN32
+    // Extract just the filename if a path was provided
+    std::string filename = soundFile;
+    size_t lastSlash = filename.find_last_of("\\/");
+    if (lastSlash != std::string::npos) {
+        filename = filename.substr(lastSlash + 1);
+    }
+    
+    // Try multiple path options
+    std::string fullPath;
+    BOOL result = FALSE;
+    
+    // First try: Music folder in current directory (same as project.cpp)
+    fullPath = "Music/" + filename;
+    result = PlaySound(fullPath.c_str(), NULL, SND_FILENAME | SND_ASYNC | SND_NODEFAULT);
+    if (result) {
+        return;  // Success
+    }
+    
+    // Second try: directly in current directory
+    fullPath = filename;
+    result = PlaySound(fullPath.c_str(), NULL, SND_FILENAME | SND_ASYNC | SND_NODEFAULT);
+    if (result) {
+        return;  // Success
+    }
+    
+    // Third try: relative to executable directory
+    char exePath[MAX_PATH];
+    GetModuleFileNameA(NULL, exePath, MAX_PATH);
+    std::string exeDir = exePath;
+    size_t lastSlash2 = exeDir.find_last_of("\\/");
+    if (lastSlash2 != std::string::npos) {
+        exeDir = exeDir.substr(0, lastSlash2 + 1);
+        // Try in Music folder relative to exe
+        fullPath = exeDir + "Music/" + filename;
+        result = PlaySound(fullPath.c_str(), NULL, SND_FILENAME | SND_ASYNC | SND_NODEFAULT);
+        if (result) {
+            return;  // Success
+        }
+        // Try directly in exe directory
+        fullPath = exeDir + filename;
+        result = PlaySound(fullPath.c_str(), NULL, SND_FILENAME | SND_ASYNC | SND_NODEFAULT);
+        if (result) {
+            return;  // Success
+        }
+    }
+    
+    // Fourth try: absolute path from project root (fallback)
+    fullPath = "E:/Projects/Computer Graphics/Computer Graphics/Computer-Graphics-main/Music/" + filename;
+    PlaySound(fullPath.c_str(), NULL, SND_FILENAME | SND_ASYNC | SND_NODEFAULT);
+#endif
+}
+
+void playSoundSync(const char* soundFile) {
+#ifdef _WIN32
+    // Play sound synchronously (blocks until done)
+    PlaySound(soundFile, NULL, SND_FILENAME | SND_SYNC);
+#endif
+}
+
+void stopSound() {
+#ifdef _WIN32
+    // Stop any currently playing sound
+    PlaySound(NULL, NULL, 0);
+#endif
+}
+
+// -------------------------------------------------------------
+// Compile-time tessellation tables
+// -------------------------------------------------------------
+// Unit-circle cos/sin tables for every segment count the scene uses, built
+// by the compiler so no trig runs per vertex. UNIT_CIRCLE<N> holds N + 1
+// points (the last repeats the first) at angles 2*pi*i/N.
+namespace tess {
+    constexpr double PI = 3.14159265358979323846;
+
+    // Taylor series on [-pi, pi]; 13 terms keeps the error far below float precision
+    constexpr double sinSeries(double x) {
+        double term = x, sum = x;
+        for (int n = 1; n < 13; ++n) {
+            term *= -x * x / ((2.0 * n) * (2.0 * n + 1.0));
+            sum += term;
+        }
+        return sum;
+    }
+
+    constexpr double cosSeries(double x) {
+        double term = 1.0, sum = 1.0;
+        for (int n = 1; n < 13; ++n) {
+            term *= -x * x / ((2.0 * n - 1.0) * (2.0 * n));
+            sum += term;
+        }
+        return sum;
+    }
+
+    template <int N>
+    struct UnitCircle {
+        float cs[N + 1] = {};
+        float sn[N + 1] = {};
+
+        constexpr UnitCircle() {
+            for (int i = 0; i <= N; ++i) {
+                double angle = 2.0 * PI * (i % N) / N;
+                if (angle > PI) angle -= 2.0 * PI;
+                cs[i] = static_cast<float>(cosSeries(angle));
+                sn[i] = static_cast<float>(sinSeries(angle));
+            }
+        }
+    };
+
+    template <int N>
+    constexpr UnitCircle<N> UNIT_CIRCLE{};
+
+    // Non-template view so runtime segment counts can pick a table
+    struct CircleTable {
+        const float* cs;
+        const float* sn;
+        int segments;
+    };
+
+    template <int N>
+    constexpr CircleTable table() { return { UNIT_CIRCLE<N>.cs, UNIT_CIRCLE<N>.sn, N }; }
+
+    // Every count requested by a draw call, plus extra sizes for circle LOD
+    constexpr int SEGMENT_COUNTS[] = { 6, 8, 10, 12, 15, 20, 25, 30, 40, 48, 64, 96, 128, 192, 256 };
+    constexpr CircleTable TABLES[] = {
+        table<6>(), table<8>(), table<10>(), table<12>(), table<15>(),
+        table<20>(), table<25>(), table<30>(), table<40>(), table<48>(),
+        table<64>(), table<96>(), table<128>(), table<192>(), table<256>()
+    };
+    constexpr int NUM_TABLES = sizeof(TABLES) / sizeof(TABLES[0]);
+    static_assert(sizeof(SEGMENT_COUNTS) / sizeof(SEGMENT_COUNTS[0]) == NUM_TABLES, "table list mismatch");
+
+    // Smallest table with at least the requested number of segments
+    inline const CircleTable& circleTable(int segments) {
+        for (int i = 0; i < NUM_TABLES; ++i) {
+            if (TABLES[i].segments >= segments) return TABLES[i];
+        }
+        return TABLES[NUM_TABLES - 1];
+    }
+} // namespace tess
+
+// -------------------------------------------------------------
+// Circle drawing helper for moon and clouds
+// -------------------------------------------------------------
+// Circle LOD: instead of the hard-coded segment count, pick the smallest count
+// whose polygon stays within circleLodTolerance pixels of the true circle at
+// the current render-target scale (renderUnitsPerPixel) and transform.
+bool circleLodEnabled = true;          // --no-circle-lod keeps the hard-coded counts
+float circleLodTolerance = 0.1f;       // Max chord-to-arc distance, in pixels
+const int CIRCLE_LOD_MIN_SEGMENTS = 6;
+const int CIRCLE_LOD_MAX_SEGMENTS = 256;
+
+int circleSegmentsForRadius(float r, int requested) {
+    if (!circleLodEnabled) return requested;
+
+    const Transform2D& m = currentTransform;
+    float scale = sqrtf(fabsf(m.a * m.d - m.b * m.c));
+    float radiusPx = r * scale / renderUnitsPerPixel;
+    if (radiusPx <= circleLodTolerance) return CIRCLE_LOD_MIN_SEGMENTS;
+
+    // Sagitta of one segment: r * (1 - cos(step / 2)) <= tolerance
+    float halfStep = acosf(1.0f - circleLodTolerance / radiusPx);
+    int segments = static_cast<int>(ceilf(3.14159265358979323846f / halfStep));
+    if (segments < CIRCLE_LOD_MIN_SEGMENTS) segments = CIRCLE_LOD_MIN_SEGMENTS;
+    if (segments > CIRCLE_LOD_MAX_SEGMENTS) segments = CIRCLE_LOD_MAX_SEGMENTS;
+    return segments;
+}
+
+void drawCircle(float cx, float cy, float r, const Color& fill, int segments = 40) {
+    const tess::CircleTable& unit = tess::circleTable(circleSegmentsForRadius(r, segments));
+    if (renderBackend != BACKEND_IMMEDIATE) {
+        // Transform the center and the two radius vectors once, then every
+        // rim point is a scale-and-offset of the unit table
+        const Transform2D& m = currentTransform;
+        float wcx, wcy;
+        transformPoint(cx, cy, wcx, wcy);
+        float axX = m.a * r, axY = m.b * r;
+        float ayX = m.c * r, ayY = m.d * r;
+        float prevX = wcx + axX, prevY = wcy + axY;
+        for (int i = 1; i <= unit.segments; ++i) {
+            float x = wcx + unit.cs[i] * axX + unit.sn[i] * ayX;
+            float y = wcy + unit.cs[i] * axY + unit.sn[i] * ayY;
+            batchWorldVertex(wcx, wcy, fill);
+            batchWorldVertex(prevX, prevY, fill);
+            batchWorldVertex(x, y, fill);
+            prevX = x; prevY = y;
+        }
+        return;
+    }
+    setColor(fill);
+    glBegin(GL_TRIANGLE_FAN);
+    glVertex2f(cx, cy);  // center
+    for (int i = 0; i <= unit.segments; ++i) {
+        glVertex2f(cx + r * unit.cs[i], cy + r * unit.sn[i]);
+    }
+    glEnd();
+}
+
+// -------------------------------------------------------------
+// Prop meshes and submission
+// -------------------------------------------------------------
+PropType buildingPropType;  // Mesh currently being built by the prop* helpers
+
+void beginPropMesh(PropType type) {
+    buildingPropType = type;
+    propMeshFirst[type] = static_cast<int>(propMeshVertices.size());
+}
+
+void endPropMesh() {
+    propMeshCount[buildingPropType] =
+        static_cast<int>(propMeshVertices.size()) - propMeshFirst[buildingPropType];
+}
+
+inline void propVertex(float x, float y, float px, float py, const Color& c, float tint) {
+    propMeshVertices.push_back({ x, y, px, py, c.r, c.g, c.b, tint });
+}
+
+void propQuad(float x1, float y1, float x2, float y2, const Color& c, float tint = 0.0f) {
+    propVertex(x1, y1, 0.0f, 0.0f, c, tint);
+    propVertex(x2, y1, 0.0f, 0.0f, c, tint);
+    propVertex(x2, y2, 0.0f, 0.0f, c, tint);
+    propVertex(x1, y1, 0.0f, 0.0f, c, tint);
+    propVertex(x2, y2, 0.0f, 0.0f, c, tint);
+    propVertex(x1, y2, 0.0f, 0.0f, c, tint);
+}
+
+// Rectangle outline whose thickness stays lineW pixels at any instance scale
+void propFrame(float x1, float y1, float x2, float y2, const Color& c, float lineW) {
+    float h = 0.5f * lineW;
+    const float edges[4][6] = {
+        // from x,y    to x,y    pixel normal
+        { x1, y1, x2, y1, 0.0f, h },
+        { x2, y1, x2, y2, h, 0.0f },
+        { x2, y2, x1, y2, 0.0f, h },
+        { x1, y2, x1, y1, h, 0.0f }
+    };
+    for (const auto& e : edges) {
+        propVertex(e[0], e[1], e[4], e[5], c, 0.0f);
+        propVertex(e[0], e[1], -e[4], -e[5], c, 0.0f);
+        propVertex(e[2], e[3], -e[4], -e[5], c, 0.0f);
+        propVertex(e[0], e[1], e[4], e[5], c, 0.0f);
+        propVertex(e[2], e[3], -e[4], -e[5], c, 0.0f);
+        propVertex(e[2], e[3], e[4], e[5], c, 0.0f);
+    }
+}
+
+// Line whose thickness stays lineW pixels at any instance scale
+void propSegment(float x1, float y1, float x2, float y2, const Color& c, float lineW) {
+    float dx = x2 - x1, dy = y2 - y1;
+    float h = 0.5f * lineW / sqrtf(dx * dx + dy * dy);
+    float nx = -dy * h, ny = dx * h;
+    propVertex(x1, y1, nx, ny, c, 0.0f);
+    propVertex(x1, y1, -nx, -ny, c, 0.0f);
+    propVertex(x2, y2, -nx, -ny, c, 0.0f);
+    propVertex(x1, y1, nx, ny, c, 0.0f);
+    propVertex(x2, y2, -nx, -ny, c, 0.0f);
+    propVertex(x2, y2, nx, ny, c, 0.0f);
+}
+
+void propTriangleOutline(float x1, float y1, float x2, float y2, float x3, float y3, const Color& c, float lineW) {
+    propSegment(x1, y1, x2, y2, c, lineW);
+    propSegment(x2, y2, x3, y3, c, lineW);
+    propSegment(x3, y3, x1, y1, c, lineW);
+}
+
+void propCircle(float cx, float cy, float r, const Color& c, float tint, const tess::CircleTable& unit) {
+    for (int i = 0; i < unit.segments; ++i) {
+        propVertex(cx, cy, 0.0f, 0.0f, c, tint);
+        propVertex(cx + r * unit.cs[i], cy + r * unit.sn[i], 0.0f, 0.0f, c, tint);
+        propVertex(cx + r * unit.cs[i + 1], cy + r * unit.sn[i + 1], 0.0f, 0.0f, c, tint);
+    }
+}
+
+void propPolygon(const float* xy, int count, const Color& c, float tint = 0.0f) {
+    for (int i = 1; i + 1 < count; ++i) {
+        propVertex(xy[0], xy[1], 0.0f, 0.0f, c, tint);
+        propVertex(xy[2 * i], xy[2 * i + 1], 0.0f, 0.0f, c, tint);
+        propVertex(xy[2 * i + 2], xy[2 * i + 3], 0.0f, 0.0f, c, tint);
+    }
+}
+
+// Queue one prop, turned by the angle whose cosine and sine are cs and sn.
+// Returns false when the caller should draw it directly (instancing off, or a
+// transform the per-instance scale and rotation cannot express).
+bool submitProp(PropType type, float x, float y, float sx, float sy, const Color& c,
+    float cs = 1.0f, float sn = 0.0f) {
+    if (!propInstancingEnabled) return false;
+    const Transform2D& m = currentTransform;
+    if (m.b != 0.0f || m.c != 0.0f) return false;
+    if (sn != 0.0f && m.a != m.d) return false;  // Scale would shear a turned prop
+
+    float wx, wy;
+    transformPoint(x, y, wx, wy);
+    DrawList& list = *activeDrawList;
+    list.runFor(RUN_PROPS, list.instances.size(), type).count++;
+    list.instances.push_back({ wx, wy, sx * m.a, sy * m.d, cs, sn, c.r, c.g, c.b });
+    return true;
+}
+
+// Queue one SDF effect. Returns false when the caller should draw the circles itself.
+bool submitEffect(EffectKind kind, float x, float y, float extent, float param, const Color& c, const Color& c2) {
+    if (!sdfEffectsEnabled) return false;
+
+    const Transform2D& m = currentTransform;
+    float wx, wy;
+    transformPoint(x, y, wx, wy);
+    float scale = sqrtf(fabsf(m.a * m.d - m.b * m.c));
+    DrawList& list = *activeDrawList;
+    list.runFor(RUN_EFFECTS, list.effects.size()).count++;
+    list.effects.push_back({ wx, wy, scale, extent, static_cast<float>(kind), param,
+        c.r, c.g, c.b, c2.r, c2.g, c2.b, 0u });
+    return true;
+}
+
+// Queue a whole firecracker burst, sparks at full light colored c. Returns
+// false when the caller should draw the sparks itself.
+bool submitBurst(float x, float y, float time, uint32_t seed, const Color& c) {
+    if (!sdfEffectsEnabled) return false;
+
+    const Transform2D& m = currentTransform;
+    float wx, wy;
+    transformPoint(x, y, wx, wy);
+    float scale = sqrtf(fabsf(m.a * m.d - m.b * m.c));
+    DrawList& list = *activeDrawList;
+    list.runFor(RUN_BURSTS, list.effects.size()).count++;
+    list.effects.push_back({ wx, wy, scale, 0.0f, static_cast<float>(EFFECT_BURST), time,
+        c.r, c.g, c.b, 0.0f, 0.0f, 0.0f, seed });
+    return true;
+}
+
+// -------------------------------------------------------------
+// Moon drawing
+// -------------------------------------------------------------
+void drawMoon() {
+    float moonX = 3.0f;      // slightly right of center
+    float glowRadius = 1.3f;
+    float moonY = std::min(viewportTopY * 0.90f, viewportTopY - glowRadius);  // 90% of viewport height, glow kept on screen
+    
+    // #region agent log
+    {
+        std::ostringstream json;
+        json << "{\"moonX\":" << moonX << ",\"moonY\":" << moonY << ",\"viewportTopY\":" << viewportTopY << "}";
+        debugLog("project.cpp:128", "Moon position (dynamic)", json.str(), "run3", "D");
+    }
+    // #endregion
+    
+    if (submitEffect(EFFECT_GLOW, moonX, moonY, glowRadius, 1.0f, MOON_GLOW, MOON_COLOR)) return;
+
+    // Moon glow halo (slightly larger, darker)
+    drawCircle(moonX, moonY, glowRadius, MOON_GLOW, 40);
+    
+    // Main moon
+    drawCircle(moonX, moonY, 1.0f, MOON_COLOR, 40);
+}
+
+// -------------------------------------------------------------
+// Starfield
+// -------------------------------------------------------------
+// Stars are generated once from a seed and kept in a GPU buffer, so the whole
+// sky is one GL_POINTS draw. The y rescale for the current viewport and the
+// twinkle are computed in the shader from uniforms, so neither a resize nor
+// the animation touches the stars on the CPU. The first stars are the classic
+// hand-placed ones; --stars adds seeded stars up to the requested total.
+struct StarVertex {
+    float x, origY;          // origY is in the original [0, 20] range
+    float size;              // radius in world units
+    float phase;             // twinkle phase in radians (also picks the twinkle speed)
+    unsigned char r, g, b;
+    unsigned char twinkle;   // twinkle depth: 0 = steady, 255 = fades fully into the sky
+};
+
+struct ClassicStar { float x; float origY; const Color* color; float size; };
+
+const ClassicStar CLASSIC_STARS[] = {
+    // Bright stars (original Y values)
+    { -35.0f, 16.5f, &STAR_BRIGHT, 0.08f },
+    { -30.0f, 18.0f, &STAR_BRIGHT, 0.08f },
+    { -25.0f, 15.5f, &STAR_BRIGHT, 0.08f },
+    { -15.0f, 17.5f, &STAR_BRIGHT, 0.08f },
+    { -10.0f, 16.0f, &STAR_BRIGHT, 0.08f },
+    { 5.0f, 18.5f, &STAR_BRIGHT, 0.08f },
+    { 10.0f, 15.0f, &STAR_BRIGHT, 0.08f },
+    { 15.0f, 17.0f, &STAR_BRIGHT, 0.08f },
+    { 25.0f, 16.5f, &STAR_BRIGHT, 0.08f },
+    { 30.0f, 18.0f, &STAR_BRIGHT, 0.08f },
+    { 35.0f, 15.5f, &STAR_BRIGHT, 0.08f },
+
+    // Medium stars
+    { -32.0f, 14.0f, &STAR_MEDIUM, 0.06f },
+    { -28.0f, 17.0f, &STAR_MEDIUM, 0.06f },
+    { -20.0f, 16.0f, &STAR_MEDIUM, 0.06f },
+    { -18.0f, 13.5f, &STAR_MEDIUM, 0.06f },
+    { -12.0f, 18.0f, &STAR_MEDIUM, 0.06f },
+    { -8.0f, 14.5f, &STAR_MEDIUM, 0.06f },
+    { -5.0f, 17.0f, &STAR_MEDIUM, 0.06f },
+    { 0.0f, 15.5f, &STAR_MEDIUM, 0.06f },
+    { 8.0f, 18.0f, &STAR_MEDIUM, 0.06f },
+    { 12.0f, 14.0f, &STAR_MEDIUM, 0.06f },
+    { 18.0f, 16.5f, &STAR_MEDIUM, 0.06f },
+    { 22.0f, 17.5f, &STAR_MEDIUM, 0.06f },
+    { 28.0f, 14.5f, &STAR_MEDIUM, 0.06f },
+    { 32.0f, 16.0f, &STAR_MEDIUM, 0.06f },
+
+    // Dim stars
+    { -33.0f, 15.0f, &STAR_DIM, 0.05f },
+    { -27.0f, 13.0f, &STAR_DIM, 0.05f },
+    { -22.0f, 18.0f, &STAR_DIM, 0.05f },
+    { -16.0f, 15.0f, &STAR_DIM, 0.05f },
+    { -14.0f, 12.5f, &STAR_DIM, 0.05f },
+    { -6.0f, 16.5f, &STAR_DIM, 0.05f },
+    { -3.0f, 13.0f, &STAR_DIM, 0.05f },
+    { 3.0f, 16.0f, &STAR_DIM, 0.05f },
+    { 6.0f, 13.5f, &STAR_DIM, 0.05f },
+    { 14.0f, 17.0f, &STAR_DIM, 0.05f },
+    { 20.0f, 14.0f, &STAR_DIM, 0.05f },
+    { 27.0f, 15.5f, &STAR_DIM, 0.05f },
+    { 33.0f, 17.0f, &STAR_DIM, 0.05f }
+};
+const int NUM_CLASSIC_STARS = sizeof(CLASSIC_STARS) / sizeof(CLASSIC_STARS[0]);
+
+const int MAX_STARS = 1000000;
+int starCount = NUM_CLASSIC_STARS;   // --stars command-line option
+unsigned int starSeed = 1971;        // --star-seed command-line option
+
+std::vector<StarVertex> stars;
+bool starfieldOnGpu = false;         // Set by initStarfield() on the batched backend
+
+GLuint starProgram = 0;
+GLuint starVAO = 0;
+GLuint starVBO = 0;
+GLint starViewLoc = -1;
+GLint starYScaleLoc = -1;
+GLint starPixelLoc = -1;
+GLint starTimeLoc = -1;
+GLint starSkyLoc = -1;
+
+const char* STAR_VERTEX_SHADER =
+    "#version 330 core\n"
+    "in vec2 aPos;\n"
+    "in float aSize;\n"
+    "in float aPhase;\n"
+    "in vec4 aColor;  // rgb + twinkle depth\n"
+    "uniform vec4 uView;\n"
+    "uniform float uYScale;\n"
+    "uniform float uUnitsPerPixel;\n"
+    "uniform float uTime;\n"
+    "uniform vec3 uSky;\n"
+    "out vec3 vColor;\n"
+    "flat out int vRound;\n"
+    "void main() {\n"
+    "    vec2 world = vec2(aPos.x, aPos.y * uYScale);\n"
+    "    vec2 ndc = (world - uView.xz) / (uView.yw - uView.xz) * 2.0 - 1.0;\n"
+    "    gl_Position = vec4(ndc, 0.0, 1.0);\n"
+    "    gl_PointSize = max(2.0 * aSize / uUnitsPerPixel, 1.0);\n"
+    "    vRound = gl_PointSize > 1.5 ? 1 : 0;  // A pixel-sized point's one fragment can sit off its centre\n"
+    "    float rate = 1.0 + 2.0 * fract(aPhase * 0.618034);\n"
+    "    float fade = aColor.a * (0.5 + 0.5 * sin(uTime * rate + aPhase));\n"
+    "    vColor = mix(aColor.rgb, uSky, fade);\n"
+    "}\n";
+
+const char* STAR_FRAGMENT_SHADER =
+    "#version 330 core\n"
+    "in vec3 vColor;\n"
+    "flat in int vRound;\n"
+    "out vec4 fragColor;\n"
+    "void main() {\n"
+    "    vec2 d = gl_PointCoord * 2.0 - 1.0;\n"
+    "    if (vRound != 0 && dot(d, d) > 1.0) discard;  // Round stars\n"
+    "    fragColor = vec4(vColor, 1.0);\n"
+    "}\n";
+
+// Small self-contained generator so a seed gives the same sky on every platform
+float starRandom(unsigned int& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+inline unsigned char toByte(float v) {
+    return static_cast<unsigned char>(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+void generateStars() {
+    unsigned int state = starSeed ? starSeed : 1u;
+    stars.clear();
+    stars.reserve(starCount);
+
+    for (int i = 0; i < NUM_CLASSIC_STARS && i < starCount; ++i) {
+        const ClassicStar& c = CLASSIC_STARS[i];
+        float phase = starRandom(state) * 6.2831853f;
+        stars.push_back({ c.x, c.origY, c.size, phase,
+            toByte(c.color->r), toByte(c.color->g), toByte(c.color->b), 60 });
+    }
+
+    // Seeded stars cover the widest supported aspect; the shader clips the rest
+    while (static_cast<int>(stars.size()) < starCount) {
+        float x = -80.0f + 160.0f * starRandom(state);
+        float origY = 12.0f + 7.5f * starRandom(state);
+        float u = starRandom(state);
+        float size = 0.02f + 0.05f * u * u * u;  // Mostly faint, a few bright
+        float brightness = starRandom(state);
+        Color c = {
+            STAR_DIM.r + (STAR_BRIGHT.r - STAR_DIM.r) * brightness,
+            STAR_DIM.g + (STAR_BRIGHT.g - STAR_DIM.g) * brightness,
+            STAR_DIM.b + (STAR_BRIGHT.b - STAR_DIM.b) * brightness
+        };
+        float phase = starRandom(state) * 6.2831853f;
+        float twinkle = 0.15f + 0.6f * starRandom(state);
+        stars.push_back({ x, origY, size, phase, toByte(c.r), toByte(c.g), toByte(c.b), toByte(twinkle) });
+    }
+}
+
+void initStarfield() {
+    generateStars();
+    if (renderBackend != BACKEND_BATCHED) return;
+
+    starProgram = gl33::buildProgram(STAR_VERTEX_SHADER, STAR_FRAGMENT_SHADER,
+        { "aPos", "aSize", "aPhase", "aColor" });
+    if (!starProgram) return;
+    starViewLoc = gl33::GetUniformLocation(starProgram, "uView");
+    starYScaleLoc = gl33::GetUniformLocation(starProgram, "uYScale");
+    starPixelLoc = gl33::GetUniformLocation(starProgram, "uUnitsPerPixel");
+    starTimeLoc = gl33::GetUniformLocation(starProgram, "uTime");
+    starSkyLoc = gl33::GetUniformLocation(starProgram, "uSky");
+
+    gl33::GenVertexArrays(1, &starVAO);
+    gl33::GenBuffers(1, &starVBO);
+    gl33::BindVertexArray(starVAO);
+    gl33::BindBuffer(GL_ARRAY_BUFFER, starVBO);
+    gl33::BufferData(GL_ARRAY_BUFFER, stars.size() * sizeof(StarVertex), stars.data(), GL_STATIC_DRAW);
+    gl33::EnableVertexAttribArray(0);
+    gl33::VertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(StarVertex),
+        reinterpret_cast<const void*>(offsetof(StarVertex, x)));
+    gl33::EnableVertexAttribArray(1);
+    gl33::VertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(StarVertex),
+        reinterpret_cast<const void*>(offsetof(StarVertex, size)));
+    gl33::EnableVertexAttribArray(2);
+    gl33::VertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(StarVertex),
+        reinterpret_cast<const void*>(offsetof(StarVertex, phase)));
+    gl33::EnableVertexAttribArray(3);
+    gl33::VertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(StarVertex),
+        reinterpret_cast<const void*>(offsetof(StarVertex, r)));
+    gl33::BindVertexArray(0);
+    gl33::BindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // The GPU copy is all the renderer needs from here on
+    starfieldOnGpu = true;
+    starCount = static_cast<int>(stars.size());
+    std::vector<StarVertex>().swap(stars);
+}
+
+float starfieldYScale = 1.0f;  // Set by drawStars(); the GPU pass may run later, under another camera
+
+void drawStarfieldPass() {
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    glEnable(GL_POINT_SPRITE);  // gl_PointCoord in compatibility contexts
+    gl33::UseProgram(starProgram);
+    gl33::Uniform4f(starViewLoc, viewportLeftX, viewportRightX, viewportBottomY, viewportTopY);
+    gl33::Uniform1f(starYScaleLoc, starfieldYScale);
+    gl33::Uniform1f(starPixelLoc, renderUnitsPerPixel);
+    gl33::Uniform1f(starTimeLoc, view->starTwinkleTime);
+    gl33::Uniform3f(starSkyLoc, NIGHT_SKY.r, NIGHT_SKY.g, NIGHT_SKY.b);
+    gl33::BindVertexArray(starVAO);
+    glDrawArrays(GL_POINTS, 0, starCount);
+    gl33::BindVertexArray(0);
+    gl33::UseProgram(0);
+    glDisable(GL_POINT_SPRITE);
+    glDisable(GL_PROGRAM_POINT_SIZE);
+
+    renderStats.drawCalls++;
+    renderStats.vertices += starCount;
+}
+
+void drawStars() {
+    // Scale factor: convert from original [0, 20] range to current viewport range
+    float scaleFactor = viewportTopY / 20.0f;
+
+    if (starfieldOnGpu) {
+        starfieldYScale = scaleFactor;
+        submitPass(drawStarfieldPass);
+        return;
+    }
+
+    // Immediate mode: same stars and twinkle, one circle each
+    for (const StarVertex& star : stars) {
+        float rate = 1.0f + 2.0f * (star.phase * 0.618034f - floorf(star.phase * 0.618034f));
+        float fade = star.twinkle / 255.0f * (0.5f + 0.5f * sinf(view->starTwinkleTime * rate + star.phase));
+        Color c = {
+            star.r / 255.0f + (NIGHT_SKY.r - star.r / 255.0f) * fade,
+            star.g / 255.0f + (NIGHT_SKY.g - star.g / 255.0f) * fade,
+            star.b / 255.0f + (NIGHT_SKY.b - star.b / 255.0f) * fade
+        };
+        drawCircle(star.x, star.origY * scaleFactor, star.size, c, 20);
+    }
+}
+
+// -------------------------------------------------------------
+// Cloud drawing
+// -------------------------------------------------------------
+void drawCloud(float cx, float cy, float scale) {
+    // Create cloud using overlapping circles
+    float r1 = 0.6f * scale;
+    float r2 = 0.5f * scale;
+    float r3 = 0.55f * scale;
+    float r4 = 0.45f * scale;
+    float r5 = 0.5f * scale;
+    
+    drawCircle(cx - 0.4f * scale, cy, r1, CLOUD_COLOR, 30);
+    drawCircle(cx + 0.2f * scale, cy, r2, CLOUD_COLOR, 30);
+    drawCircle(cx + 0.6f * scale, cy, r3, CLOUD_COLOR, 30);
+    drawCircle(cx - 0.1f * scale, cy + 0.2f * scale, r4, CLOUD_COLOR, 30);
+    drawCircle(cx + 0.4f * scale, cy + 0.15f * scale, r5, CLOUD_COLOR, 30);
+}
+
+void initializeCloudYPositions() {
+    // Initialize random Y positions for each cloud (in top area of screen)
+    // Random Y between 85% and 95% of viewport top
+    for (int i = 0; i < 6; ++i) {
         float minY = viewportTopY * 0.85f;
         float maxY = viewportTopY * 0.95f;
         cloudYPositions[i] = minY + (rand() % 100) * (maxY - minY) / 100.0f;
@@ -484,47 +3291,79 @@ void drawClouds() {
     
     // Draw clouds with animated X positions (looping from left to right)
     for (int i = 0; i < 6; ++i) {
-        float cloudX = baseX[i] + cloudOffsetX;
+        float cloudX = baseX[i] + view->cloudOffsetX;
         // Loop clouds: when they go off the right side, wrap to left side
         if (cloudX > 40.0f) {
             cloudX -= cloudLoopWidth;
         }
-        drawCloud(cloudX, cloudYPositions[i], cloudScale[i]);
+        // The heights were picked for the first view; keep the top puff
+        // (0.65 * scale above the center) inside a shorter one, such as the
+        // split view's wide shot
+        float cloudY = std::min(cloudYPositions[i], viewportTopY - 0.65f * cloudScale[i]);
+        drawCloud(cloudX, cloudY, cloudScale[i]);
     }
 }
 
+// -------------------------------------------------------------
+// Campus layout
+// -------------------------------------------------------------
+// Where the props and building fronts stand. The drawing code and the campus
+// navigation grid both read these, so the ground people walk around always
+// matches the picture. Campus coordinates are relative to each university's
+// center.
+const float CITY_CENTER_X = -22.0f;
+const float DIU_CENTER_X = 22.0f;
+
+struct TreePlacement { float x, scale; };
+const TreePlacement TREES[] = {
+    { -28.0f, 1.0f }, { -26.0f, 0.9f }, { -24.0f, 1.1f },  // Left side (near City University)
+    { 24.0f, 1.0f }, { 26.0f, 0.9f }, { 28.0f, 1.1f },     // Right side (near DIU)
+    { -10.0f, 0.8f }, { 10.0f, 0.8f }                      // Center area
+};
+const float TREE_BASE_Y = 2.0f;
+const float TREE_TRUNK_HALF_WIDTH = 0.15f;   // Times the tree's scale
+
+const float STREET_LIGHT_XS[] = { -30.0f, -15.0f, 0.0f, 15.0f, 30.0f };
+const float STREET_LIGHT_BASE_Y = 2.2f;      // Just above the road
+const float STREET_LIGHT_POLE_HALF_WIDTH = 0.08f;
+
+struct BushPlacement { float x, y, width, height; };  // Campus coordinates, base center
+const BushPlacement CITY_BUSHES[] = {
+    { -8.5f, 1.0f, 2.0f, 1.1f }, { -6.5f, 1.0f, 2.4f, 1.2f },
+    { 6.5f, 1.0f, 2.4f, 1.2f }, { 8.5f, 1.0f, 2.0f, 1.1f }
+};
+const BushPlacement DIU_BUSHES[] = {  // At the foot of the wings
+    { -10.0f, 2.0f, 2.0f, 0.9f }, { -7.5f, 2.0f, 2.4f, 1.0f },
+    { 7.5f, 2.0f, 2.4f, 1.0f }, { 10.0f, 2.0f, 2.0f, 0.9f }
+};
+
+// Building fronts, campus coordinates: out to the widest part of the
+// building, open across the door
+const float CITY_ROOF_HALF_WIDTH = 9.4f;
+const float CITY_DOOR_HALF_WIDTH = 1.3f;
+const float CITY_DOOR_MULLION_HALF_WIDTH = 0.15f;  // Between the two door leaves
+const float DIU_WING_HALF_WIDTH = 12.0f;
+const float DIU_DOOR_HALF_WIDTH = 1.1f;
+const float DIU_STEP_HALF_WIDTH = 2.4f;
+const float DIU_STEP_Y1 = 1.7f, DIU_STEP_Y2 = 2.0f;
+
+// Rubble the collapsed City side blocks spill over the front of the
+// building, campus coordinates; the way to the door stays clear
+struct RubbleHeap { float x1, x2; };
+const RubbleHeap CITY_RUBBLE[] = { { -CITY_ROOF_HALF_WIDTH, -2.2f }, { 2.2f, CITY_ROOF_HALF_WIDTH } };
+
 // -------------------------------------------------------------
 // Environment Elements Drawing
 // -------------------------------------------------------------
 void drawBackgroundMountains() {
     // Draw mountain silhouettes in the background
-    setColor(MOUNTAIN_COLOR);
-    
     // Left mountains
-    glBegin(GL_TRIANGLES);
-    glVertex2f(-40.0f, 0.0f);
-    glVertex2f(-35.0f, 4.0f);
-    glVertex2f(-30.0f, 0.0f);
-    glEnd();
-    
-    glBegin(GL_TRIANGLES);
-    glVertex2f(-32.0f, 0.0f);
-    glVertex2f(-28.0f, 5.5f);
-    glVertex2f(-24.0f, 0.0f);
-    glEnd();
+    filledTriangle(-40.0f, 0.0f, -35.0f, 4.0f, -30.0f, 0.0f, MOUNTAIN_COLOR);
+    filledTriangle(-32.0f, 0.0f, -28.0f, 5.5f, -24.0f, 0.0f, MOUNTAIN_COLOR);
     
     // Right mountains
-    glBegin(GL_TRIANGLES);
-    glVertex2f(24.0f, 0.0f);
-    glVertex2f(28.0f, 5.0f);
-    glVertex2f(32.0f, 0.0f);
-    glEnd();
-    
-    glBegin(GL_TRIANGLES);
-    glVertex2f(30.0f, 0.0f);
-    glVertex2f(35.0f, 4.5f);
-    glVertex2f(40.0f, 0.0f);
-    glEnd();
+    filledTriangle(24.0f, 0.0f, 28.0f, 5.0f, 32.0f, 0.0f, MOUNTAIN_COLOR);
+    filledTriangle(30.0f, 0.0f, 35.0f, 4.5f, 40.0f, 0.0f, MOUNTAIN_COLOR);
 }
 
 void drawRoad() {
@@ -536,21 +3375,22 @@ void drawRoad() {
     filledRect(-40.0f, roadY, 40.0f, roadY + 0.4f, ROAD_COLOR);
     
     // Road markings (center line)
-    setColor(ROAD_LINE);
-    glLineWidth(1.0f);
-    glBegin(GL_LINES);
+    float dashes[38 * 4];
+    int numDashes = 0;
     for (float x = -38.0f; x < 38.0f; x += 2.0f) {
-        glVertex2f(x, roadY + 0.2f);
-        glVertex2f(x + 1.0f, roadY + 0.2f);
+        float* d = dashes + 4 * numDashes++;
+        d[0] = x;        d[1] = roadY + 0.2f;
+        d[2] = x + 1.0f; d[3] = roadY + 0.2f;
     }
-    glEnd();
-    glLineWidth(1.0f);
+    drawLines(dashes, numDashes, ROAD_LINE, 1.0f);
 }
 
 void drawStreetLight(float x, float y) {
+    if (submitProp(PROP_STREET_LIGHT, x, y, 1.0f, 1.0f, STREET_LIGHT_GLOW)) return;
+    
     // Street light pole
     setColor(STREET_LIGHT_POLE);
-    filledRect(x - 0.08f, y, x + 0.08f, y + 2.5f, STREET_LIGHT_POLE);
+    filledRect(x - STREET_LIGHT_POLE_HALF_WIDTH, y, x + STREET_LIGHT_POLE_HALF_WIDTH, y + 2.5f, STREET_LIGHT_POLE);
     
     // Light fixture
     filledRect(x - 0.3f, y + 2.5f, x + 0.3f, y + 2.7f, STREET_LIGHT_POLE);
@@ -563,21 +3403,16 @@ void drawStreetLight(float x, float y) {
 }
 
 void drawStreetLights() {
-    float roadY = 1.8f;
-    float lightY = roadY + 0.4f;
-    
     // Street lights along the road
-    drawStreetLight(-30.0f, lightY);
-    drawStreetLight(-15.0f, lightY);
-    drawStreetLight(0.0f, lightY);
-    drawStreetLight(15.0f, lightY);
-    drawStreetLight(30.0f, lightY);
+    for (float x : STREET_LIGHT_XS) drawStreetLight(x, STREET_LIGHT_BASE_Y);
 }
 
 void drawTree(float x, float y, float scale) {
+    if (submitProp(PROP_TREE, x, y, scale, scale, TREE_LEAVES)) return;
+    
     // Tree trunk
     setColor(TREE_TRUNK);
-    filledRect(x - 0.15f * scale, y, x + 0.15f * scale, y + 1.2f * scale, TREE_TRUNK);
+    filledRect(x - TREE_TRUNK_HALF_WIDTH * scale, y, x + TREE_TRUNK_HALF_WIDTH * scale, y + 1.2f * scale, TREE_TRUNK);
     
     // Tree leaves (circular)
     setColor(TREE_LEAVES);
@@ -588,19 +3423,7 @@ void drawTree(float x, float y, float scale) {
 
 void drawTrees() {
     // Trees around the buildings
-    // Left side (near City University)
-    drawTree(-28.0f, 2.0f, 1.0f);
-    drawTree(-26.0f, 2.0f, 0.9f);
-    drawTree(-24.0f, 2.0f, 1.1f);
-    
-    // Right side (near DIU)
-    drawTree(24.0f, 2.0f, 1.0f);
-    drawTree(26.0f, 2.0f, 0.9f);
-    drawTree(28.0f, 2.0f, 1.1f);
-    
-    // Center area
-    drawTree(-10.0f, 2.0f, 0.8f);
-    drawTree(10.0f, 2.0f, 0.8f);
+    for (const TreePlacement& tree : TREES) drawTree(tree.x, TREE_BASE_Y, tree.scale);
 }
 
 void drawVehicle(float x, float y) {
@@ -651,20 +3474,20 @@ void drawFlag(float x, float y, const Color& flagColor) {
     filledRect(x - 0.05f, y, x + 0.05f, y + 3.0f, FLAG_POLE);
     
     // Flag with waving animation
-    float waveOffset = sinf(flagWaveTime + x * 0.5f) * 0.3f;
+    float waveOffset = sinf(view->flagWaveTime + x * 0.5f) * 0.3f;
     
-    glPushMatrix();
-    glTranslatef(x, y + 3.0f, 0.0f);
+    pushTransform();
+    translateTransform(x, y + 3.0f);
     
-    setColor(flagColor);
-    glBegin(GL_QUADS);
-    glVertex2f(0.0f, 0.0f);
-    glVertex2f(1.2f + waveOffset, -0.2f);
-    glVertex2f(1.2f + waveOffset, -0.8f);
-    glVertex2f(0.0f, -0.6f);
-    glEnd();
+    float flag[8] = {
+        0.0f, 0.0f,
+        1.2f + waveOffset, -0.2f,
+        1.2f + waveOffset, -0.8f,
+        0.0f, -0.6f
+    };
+    filledPolygon(flag, 4, flagColor);
     
-    glPopMatrix();
+    popTransform();
 }
 
 void drawFlags() {
@@ -679,40 +3502,13 @@ void drawFlags() {
 // -------------------------------------------------------------
 // Rocket Animation
 // -------------------------------------------------------------
-void calculateRocketPosition(float t, float& x, float& y, float& angle) {
-    // Start point: DIU roof
-    float x1 = 22.0f, y1 = 16.8f;  // DIU roof top
-    // End point: City University roof
-    float x2 = -22.0f, y2 = 10.9f;  // City roof top
-    
-    // Linear X interpolation
-    x = x1 + t * (x2 - x1);
-    
-    // Parabolic Y with peak height (creates arc with ~4 unit peak)
-    float linearY = y1 + t * (y2 - y1);
-    float arcHeight = 4.0f * t * (1.0f - t);
-    y = linearY + arcHeight;
-    
-    // Calculate angle based on trajectory direction
-    // Use a small delta to approximate the tangent
-    float delta = 0.01f;
-    float tNext = t + delta;
-    if (tNext > 1.0f) tNext = 1.0f;
-    
-    float xNext = x1 + tNext * (x2 - x1);
-    float linearYNext = y1 + tNext * (y2 - y1);
-    float arcHeightNext = 4.0f * tNext * (1.0f - tNext);
-    float yNext = linearYNext + arcHeightNext;
-    
-    float dx = xNext - x;
-    float dy = yNext - y;
-    angle = atan2f(dy, dx) * 180.0f / 3.14159265358979323846f;  // Convert to degrees
-}
+// A rocket at (x, y) flying along the unit direction (dirX, dirY)
+void drawRocket(float x, float y, float dirX, float dirY) {
+    if (submitProp(PROP_ROCKET, x, y, 1.0f, 1.0f, ROCKET_BODY, dirX, dirY)) return;
 
-void drawRocket(float x, float y, float angle) {
-    glPushMatrix();
-    glTranslatef(x, y, 0.0f);
-    glRotatef(angle, 0.0f, 0.0f, 1.0f);
+    pushTransform();
+    translateTransform(x, y);
+    rotateTransform(atan2f(dirY, dirX) * 180.0f / 3.14159265358979323846f);
     
     // Rocket body (horizontal rectangle, pointing right initially)
     float bodyWidth = 2.0f;   // length (horizontal)
@@ -725,70 +3521,47 @@ void drawRocket(float x, float y, float angle) {
     
     // Nose cone (triangle at front/right)
     float noseLength = 0.4f;
-    setColor(ROCKET_NOSE);
-    glBegin(GL_TRIANGLES);
-    glVertex2f(bodyX2 + noseLength, 0.0f);        // tip (pointing right)
-    glVertex2f(bodyX2, bodyY1);                  // bottom base
-    glVertex2f(bodyX2, bodyY2);                   // top base
-    glEnd();
+    filledTriangle(bodyX2 + noseLength, 0.0f,   // tip (pointing right)
+                   bodyX2, bodyY1,              // bottom base
+                   bodyX2, bodyY2,              // top base
+                   ROCKET_NOSE);
     
     // Outline nose
-    setColor({0.0f, 0.0f, 0.0f});
-    glLineWidth(1.5f);
-    glBegin(GL_LINE_LOOP);
-    glVertex2f(bodyX2 + noseLength, 0.0f);
-    glVertex2f(bodyX2, bodyY1);
-    glVertex2f(bodyX2, bodyY2);
-    glEnd();
-    glLineWidth(1.0f);
+    outlineTriangle(bodyX2 + noseLength, 0.0f, bodyX2, bodyY1, bodyX2, bodyY2,
+                    {0.0f, 0.0f, 0.0f}, 1.5f);
     
     // Fins (3 triangular fins at back/left)
     float finSize = 0.3f;
     float finX = bodyX1;
-    setColor(ROCKET_FIN);
     
     // Top fin
-    glBegin(GL_TRIANGLES);
-    glVertex2f(finX, bodyY2);
-    glVertex2f(finX - finSize, bodyY2 + finSize * 0.5f);
-    glVertex2f(finX - finSize * 0.3f, bodyY2);
-    glEnd();
+    filledTriangle(finX, bodyY2,
+                   finX - finSize, bodyY2 + finSize * 0.5f,
+                   finX - finSize * 0.3f, bodyY2, ROCKET_FIN);
     
     // Bottom fin
-    glBegin(GL_TRIANGLES);
-    glVertex2f(finX, bodyY1);
-    glVertex2f(finX - finSize, bodyY1 - finSize * 0.5f);
-    glVertex2f(finX - finSize * 0.3f, bodyY1);
-    glEnd();
+    filledTriangle(finX, bodyY1,
+                   finX - finSize, bodyY1 - finSize * 0.5f,
+                   finX - finSize * 0.3f, bodyY1, ROCKET_FIN);
     
     // Left fin (center, pointing backward)
-    glBegin(GL_TRIANGLES);
-    glVertex2f(finX, 0.0f);
-    glVertex2f(finX - finSize, -finSize * 0.3f);
-    glVertex2f(finX - finSize, finSize * 0.3f);
-    glEnd();
+    filledTriangle(finX, 0.0f,
+                   finX - finSize, -finSize * 0.3f,
+                   finX - finSize, finSize * 0.3f, ROCKET_FIN);
     
     // Outline fins
-    setColor({0.0f, 0.0f, 0.0f});
-    glLineWidth(1.0f);
     // Top fin outline
-    glBegin(GL_LINE_LOOP);
-    glVertex2f(finX, bodyY2);
-    glVertex2f(finX - finSize, bodyY2 + finSize * 0.5f);
-    glVertex2f(finX - finSize * 0.3f, bodyY2);
-    glEnd();
+    outlineTriangle(finX, bodyY2,
+                    finX - finSize, bodyY2 + finSize * 0.5f,
+                    finX - finSize * 0.3f, bodyY2, {0.0f, 0.0f, 0.0f}, 1.0f);
     // Bottom fin outline
-    glBegin(GL_LINE_LOOP);
-    glVertex2f(finX, bodyY1);
-    glVertex2f(finX - finSize, bodyY1 - finSize * 0.5f);
-    glVertex2f(finX - finSize * 0.3f, bodyY1);
-    glEnd();
+    outlineTriangle(finX, bodyY1,
+                    finX - finSize, bodyY1 - finSize * 0.5f,
+                    finX - finSize * 0.3f, bodyY1, {0.0f, 0.0f, 0.0f}, 1.0f);
     // Left fin outline
-    glBegin(GL_LINE_LOOP);
-    glVertex2f(finX, 0.0f);
-    glVertex2f(finX - finSize, -finSize * 0.3f);
-    glVertex2f(finX - finSize, finSize * 0.3f);
-    glEnd();
+    outlineTriangle(finX, 0.0f,
+                    finX - finSize, -finSize * 0.3f,
+                    finX - finSize, finSize * 0.3f, {0.0f, 0.0f, 0.0f}, 1.0f);
     
     // Flame trail (behind rocket at left/back)
     float flameX = finX - finSize;
@@ -800,7 +3573,7 @@ void drawRocket(float x, float y, float angle) {
     // Small center (bright yellow)
     drawCircle(flameX, 0.0f, 0.15f, {1.0f, 1.0f, 0.5f}, 15);
     
-    glPopMatrix();
+    popTransform();
 }
 
 // -------------------------------------------------------------
@@ -824,8 +3597,8 @@ void calculateDronePosition(float t, bool direction, float& x, float& y) {
 }
 
 void drawDrone(float x, float y) {
-    glPushMatrix();
-    glTranslatef(x, y, 0.0f);
+    pushTransform();
+    translateTransform(x, y);
     
     // Drone body (central square)
     float bodySize = 0.6f;
@@ -846,89 +3619,278 @@ void drawDrone(float x, float y) {
     drawCircle(propOffset, -propOffset, propRadius, DRONE_PROP, 12);
     
     // Propeller arms (thin lines connecting body to propellers)
-    setColor({0.15f, 0.15f, 0.2f});
-    glLineWidth(1.0f);
-    glBegin(GL_LINES);
-    // Top-left arm
-    glVertex2f(-bodyHalf, bodyHalf);
-    glVertex2f(-propOffset, propOffset);
-    // Top-right arm
-    glVertex2f(bodyHalf, bodyHalf);
-    glVertex2f(propOffset, propOffset);
-    // Bottom-left arm
-    glVertex2f(-bodyHalf, -bodyHalf);
-    glVertex2f(-propOffset, -propOffset);
-    // Bottom-right arm
-    glVertex2f(bodyHalf, -bodyHalf);
-    glVertex2f(propOffset, -propOffset);
-    glEnd();
+    float arms[] = {
+        -bodyHalf, bodyHalf, -propOffset, propOffset,      // Top-left arm
+        bodyHalf, bodyHalf, propOffset, propOffset,        // Top-right arm
+        -bodyHalf, -bodyHalf, -propOffset, -propOffset,    // Bottom-left arm
+        bodyHalf, -bodyHalf, propOffset, -propOffset       // Bottom-right arm
+    };
+    drawLines(arms, 4, {0.15f, 0.15f, 0.2f}, 1.0f);
     
     // LED light (small circle in center)
     drawCircle(0.0f, 0.0f, 0.08f, DRONE_LIGHT, 10);
     
-    glPopMatrix();
+    popTransform();
 }
 
 // -------------------------------------------------------------
-// Destruction Effects
+// Particles
 // -------------------------------------------------------------
-struct DebrisParticle {
-    float x, y;
-    float vx, vy;  // velocity
-    float life;     // 0.0 to 1.0, decreases over time
-    float size;
+// Debris, smoke puffs and rocket exhaust live in one ParticlePool each. A
+// pool keeps every field in its own 32-byte aligned array (x, y, vx, vy,
+// life, size), so the update is one straight pass of 8-wide AVX or 4-wide
+// SSE arithmetic over the arrays, split into --job-grain chunks on the job
+// pool. Dead particles are swap-removed afterwards, keeping the live ones
+// packed at the front; the arrays keep their capacity, so after the first
+// burst the pools stop allocating. The simulation owns `particles`; each
+// published tick carries a copy, which drawing reads through
+// `viewParticles`.
+const size_t MAX_PARTICLES = 1 << 22;      // Per pool; further emits are dropped
+const int PARTICLE_DRAW_CHUNK = 1024;      // Particles per draw item
+int debrisCount = 30;                      // --debris: particles in the impact burst
+int smokeRate = 1;                         // --smoke-rate: puffs per tick from the ruins
+int exhaustRate = 4;                       // --exhaust-rate: particles per tick behind each rocket
+
+template <typename T>
+struct AlignedAllocator {
+    using value_type = T;
+    static const size_t ALIGNMENT = 32;    // One AVX register
+
+    AlignedAllocator() = default;
+    template <typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(ALIGNMENT)));
+    }
+    void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(ALIGNMENT)); }
+
+    template <typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template <typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
 };
 
-const int MAX_DEBRIS = 30;
-DebrisParticle debris[MAX_DEBRIS];
-bool debrisInitialized = false;
+using ParticleArray = std::vector<float, AlignedAllocator<float>>;
 
-void initializeDebris(float impactX, float impactY) {
-    for (int i = 0; i < MAX_DEBRIS; ++i) {
-        debris[i].x = impactX + (rand() % 100 - 50) * 0.1f;
-        debris[i].y = impactY + (rand() % 100 - 50) * 0.1f;
-        debris[i].vx = (rand() % 200 - 100) * 0.01f;
-        debris[i].vy = (rand() % 100) * 0.02f + 0.1f;  // upward and random
-        debris[i].life = 1.0f;
-        debris[i].size = 0.2f + (rand() % 50) * 0.01f;
+struct ParticlePool {
+    ParticleArray x, y;
+    ParticleArray vx, vy;              // Per tick at 60 Hz
+    ParticleArray life;                // 1.0 at birth; dead at 0
+    ParticleArray size;
+    float gravity, fade, grow;         // Per tick at 60 Hz: vy, life and size change
+
+    ParticlePool(float gravity, float fade, float grow) : gravity(gravity), fade(fade), grow(grow) {}
+
+    size_t count() const { return x.size(); }
+
+    void emit(float px, float py, float pvx, float pvy, float psize) {
+        if (count() >= MAX_PARTICLES) return;
+        x.push_back(px);
+        y.push_back(py);
+        vx.push_back(pvx);
+        vy.push_back(pvy);
+        life.push_back(1.0f);
+        size.push_back(psize);
+    }
+
+    void resize(size_t n) {
+        for (ParticleArray* a : { &x, &y, &vx, &vy, &life, &size }) a->resize(n);
+    }
+
+    void clear() { resize(0); }
+};
+
+struct ParticleSystem {
+    ParticlePool debris{ 0.01f, 0.01f, 0.0f };
+    ParticlePool smoke{ -0.0003f, 0.005f, 0.004f };   // Buoyant: rises faster as it spreads
+    ParticlePool exhaust{ 0.0f, 0.04f, -0.004f };
+    unsigned int seed = 1;             // Smoke and exhaust jitter; rand() stays with the debris and crowd
+
+    void clear() {
+        debris.clear();
+        smoke.clear();
+        exhaust.clear();
+        seed = 1;
+    }
+};
+
+ParticleSystem particles;                           // Live particles, advanced by stepSimulation()
+const ParticleSystem* viewParticles = &particles;   // Particles display() draws
+float particleLag = 0.0f;          // Ticks (at 60 Hz) the drawn frame is behind viewParticles
+
+// Move particles [first, last) on by timeScale ticks. The arrays are aligned,
+// but chunk edges needn't be, hence the unaligned loads.
+void updateParticleRange(ParticlePool& pool, size_t first, size_t last, float timeScale) {
+    float* x = pool.x.data();
+    float* y = pool.y.data();
+    float* vx = pool.vx.data();
+    float* vy = pool.vy.data();
+    float* life = pool.life.data();
+    float* size = pool.size.data();
+    const float gravity = pool.gravity * timeScale;
+    const float fade = pool.fade * timeScale;
+    const float grow = pool.grow * timeScale;
+    size_t i = first;
+#if defined(__AVX__)
+    const __m256 ts8 = _mm256_set1_ps(timeScale), gravity8 = _mm256_set1_ps(gravity);
+    const __m256 fade8 = _mm256_set1_ps(fade), grow8 = _mm256_set1_ps(grow);
+    for (; i + 8 <= last; i += 8) {
+        __m256 vy8 = _mm256_loadu_ps(vy + i);
+        _mm256_storeu_ps(x + i, _mm256_add_ps(_mm256_loadu_ps(x + i), _mm256_mul_ps(_mm256_loadu_ps(vx + i), ts8)));
+        _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(vy8, ts8)));
+        _mm256_storeu_ps(vy + i, _mm256_sub_ps(vy8, gravity8));
+        _mm256_storeu_ps(life + i, _mm256_sub_ps(_mm256_loadu_ps(life + i), fade8));
+        _mm256_storeu_ps(size + i, _mm256_add_ps(_mm256_loadu_ps(size + i), grow8));
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128 ts4 = _mm_set1_ps(timeScale), gravity4 = _mm_set1_ps(gravity);
+    const __m128 fade4 = _mm_set1_ps(fade), grow4 = _mm_set1_ps(grow);
+    for (; i + 4 <= last; i += 4) {
+        __m128 vy4 = _mm_loadu_ps(vy + i);
+        _mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(_mm_loadu_ps(vx + i), ts4)));
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(vy4, ts4)));
+        _mm_storeu_ps(vy + i, _mm_sub_ps(vy4, gravity4));
+        _mm_storeu_ps(life + i, _mm_sub_ps(_mm_loadu_ps(life + i), fade4));
+        _mm_storeu_ps(size + i, _mm_add_ps(_mm_loadu_ps(size + i), grow4));
+    }
+#endif
+    for (; i < last; ++i) {
+        x[i] += vx[i] * timeScale;
+        y[i] += vy[i] * timeScale;
+        vy[i] -= gravity;
+        life[i] -= fade;
+        size[i] += grow;
     }
-    debrisInitialized = true;
 }
 
-void updateDebris() {
-    if (!debrisInitialized) return;
-    
-    float timeScale = deltaTime / 0.0167f;  // Normalize to 60 FPS
-    for (int i = 0; i < MAX_DEBRIS; ++i) {
-        if (debris[i].life > 0.0f) {
-            debris[i].x += debris[i].vx * timeScale;
-            debris[i].y += debris[i].vy * timeScale;
-            debris[i].vy -= 0.01f * timeScale;  // gravity (frame-rate independent)
-            debris[i].life -= 0.01f * timeScale;  // fade out (frame-rate independent)
-            if (debris[i].life < 0.0f) debris[i].life = 0.0f;
+// Swap the last live particle into each dead one's slot
+void compactParticles(ParticlePool& pool) {
+    size_t n = pool.count();
+    for (size_t i = 0; i < n; ) {
+        if (pool.life[i] > 0.0f && pool.size[i] > 0.0f) {
+            ++i;
+            continue;
         }
+        --n;
+        pool.x[i] = pool.x[n];
+        pool.y[i] = pool.y[n];
+        pool.vx[i] = pool.vx[n];
+        pool.vy[i] = pool.vy[n];
+        pool.life[i] = pool.life[n];
+        pool.size[i] = pool.size[n];
     }
+    pool.resize(n);
 }
 
-void drawDebris() {
-    if (!debrisInitialized) return;
-    
-    for (int i = 0; i < MAX_DEBRIS; ++i) {
-        if (debris[i].life > 0.0f) {
-            float alpha = debris[i].life;
-            Color c = {DEBRIS_COLOR.r * alpha, DEBRIS_COLOR.g * alpha, DEBRIS_COLOR.b * alpha};
-            filledRect(debris[i].x - debris[i].size, debris[i].y - debris[i].size,
-                      debris[i].x + debris[i].size, debris[i].y + debris[i].size, c);
-        }
+void updateParticlePool(ParticlePool& pool, float timeScale) {
+    if (pool.count() == 0) return;
+    parallelFor(pool.count(), [&](size_t first, size_t last) {
+        updateParticleRange(pool, first, last, timeScale);
+    });
+    compactParticles(pool);
+}
+
+void updateParticles() {
+    float timeScale = deltaTime / 0.0167f;  // Normalize to 60 FPS
+    updateParticlePool(particles.debris, timeScale);
+    updateParticlePool(particles.smoke, timeScale);
+    updateParticlePool(particles.exhaust, timeScale);
+}
+
+// Particles [first, first + PARTICLE_DRAW_CHUNK) of a pool, backed off to the
+// drawn frame's time along their velocity (gravity over a fraction of a tick
+// is left out)
+template <typename DrawParticle>
+void drawParticleChunk(const ParticlePool& pool, size_t first, DrawParticle drawParticle) {
+    const size_t last = std::min(pool.count(), first + PARTICLE_DRAW_CHUNK);
+    const float lag = particleLag;
+    for (size_t i = first; i < last; ++i) {
+        float life = std::min(1.0f, pool.life[i] + pool.fade * lag);
+        drawParticle(pool.x[i] - pool.vx[i] * lag, pool.y[i] - pool.vy[i] * lag,
+            pool.size[i] - pool.grow * lag, life);
+    }
+}
+
+// -------------------------------------------------------------
+// Destruction Effects
+// -------------------------------------------------------------
+void initializeDebris(float impactX, float impactY) {
+    for (int i = 0; i < debrisCount; ++i) {
+        float x = impactX + (rand() % 100 - 50) * 0.1f;
+        float y = impactY + (rand() % 100 - 50) * 0.1f;
+        float vx = (rand() % 200 - 100) * 0.01f;
+        float vy = (rand() % 100) * 0.02f + 0.1f;  // upward and random
+        float size = 0.2f + (rand() % 50) * 0.01f;
+        particles.debris.emit(x, y, vx, vy, size);
+    }
+}
+
+// Puffs rising from the three smoke vents over the ruins
+void emitSmoke() {
+    const float ventX[3] = { -27.0f, -22.0f, -17.0f };
+    const float ventY = 8.5f;  // Collapsed roof
+    unsigned int& seed = particles.seed;
+    for (int i = 0; i < smokeRate; ++i) {
+        float x = ventX[static_cast<int>(starRandom(seed) * 3.0f) % 3] + (starRandom(seed) - 0.5f) * 0.6f;
+        float vx = (starRandom(seed) - 0.3f) * 0.02f;  // Drifts with the wind, mostly right
+        float vy = 0.03f + starRandom(seed) * 0.02f;
+        float size = 0.4f + starRandom(seed) * 0.1f;
+        particles.smoke.emit(x, ventY, vx, vy, size);
     }
 }
 
+// Sparks and soot left behind a rocket's tail, thrown backwards
+void emitExhaust(float rocketX, float rocketY, float dirX, float dirY) {
+    float tailX = rocketX - dirX * 1.3f, tailY = rocketY - dirY * 1.3f;  // Behind the fins
+    unsigned int& seed = particles.seed;
+    for (int i = 0; i < exhaustRate; ++i) {
+        float speed = 0.03f + starRandom(seed) * 0.04f;
+        float vx = -dirX * speed + (starRandom(seed) - 0.5f) * 0.04f;
+        float vy = -dirY * speed + (starRandom(seed) - 0.5f) * 0.04f;
+        float size = 0.12f + starRandom(seed) * 0.12f;
+        particles.exhaust.emit(tailX, tailY, vx, vy, size);
+    }
+}
+
+// Each particle is one prop instance where instancing is on: at a million
+// particles that is 36 bytes apiece instead of six transformed vertices
+void drawParticleSquare(float x, float y, float size, const Color& c) {
+    if (submitProp(PROP_PARTICLE, x, y, size, size, c)) return;
+    filledRect(x - size, y - size, x + size, y + size, c);
+}
+
+void drawDebris(size_t first) {
+    drawParticleChunk(viewParticles->debris, first, [](float x, float y, float size, float alpha) {
+        Color c = {DEBRIS_COLOR.r * alpha, DEBRIS_COLOR.g * alpha, DEBRIS_COLOR.b * alpha};
+        drawParticleSquare(x, y, size, c);
+    });
+}
+
+void drawSmokePuffs(size_t first) {
+    drawParticleChunk(viewParticles->smoke, first, [](float x, float y, float size, float alpha) {
+        Color smoke = {SMOKE_DARK.r * alpha, SMOKE_DARK.g * alpha, SMOKE_DARK.b * alpha};
+        if (submitProp(PROP_SMOKE_PUFF, x, y, size, size, smoke)) return;
+        drawCircle(x, y, size, smoke, 12);
+    });
+}
+
+// Exhaust cools from flame orange to soot as it fades
+void drawExhaust(size_t first) {
+    drawParticleChunk(viewParticles->exhaust, first, [](float x, float y, float size, float heat) {
+        Color c = {SMOKE_DARK.r + (FLAME_ORANGE.r - SMOKE_DARK.r) * heat,
+                   SMOKE_DARK.g + (FLAME_ORANGE.g - SMOKE_DARK.g) * heat,
+                   SMOKE_DARK.b + (FLAME_ORANGE.b - SMOKE_DARK.b) * heat};
+        drawParticleSquare(x, y, size, c);
+    });
+}
+
 void drawExplosion(float x, float y, float time) {
     if (time > 2.0f) return;  // Explosion lasts 2 seconds
     
     float maxRadius = 3.0f * time;  // Expand over time
     float fade = 1.0f - (time / 2.0f);  // Fade out
     
+    if (submitEffect(EFFECT_EXPLOSION, x, y, maxRadius, time, EXPLOSION_ORANGE, EXPLOSION_YELLOW)) return;
+    
     // Outer explosion (orange)
     if (fade > 0.0f) {
         Color outer = {EXPLOSION_ORANGE.r * fade, EXPLOSION_ORANGE.g * fade, EXPLOSION_ORANGE.b * fade};
@@ -955,125 +3917,133 @@ void drawFire(float x, float y, float baseWidth, float height, float flicker) {
     float flickerOffset = sinf(flicker * 10.0f) * 0.1f;
     
     // Base of fire (wider)
-    setColor(FIRE_RED);
-    glBegin(GL_TRIANGLES);
-    glVertex2f(x, y);  // base center
-    glVertex2f(x - baseWidth * 0.5f, y);
-    glVertex2f(x - baseWidth * 0.3f + flickerOffset, y + height * 0.3f);
-    glEnd();
+    filledTriangle(x, y,  // base center
+                   x - baseWidth * 0.5f, y,
+                   x - baseWidth * 0.3f + flickerOffset, y + height * 0.3f, FIRE_RED);
     
-    glBegin(GL_TRIANGLES);
-    glVertex2f(x, y);
-    glVertex2f(x + baseWidth * 0.5f, y);
-    glVertex2f(x + baseWidth * 0.3f - flickerOffset, y + height * 0.3f);
-    glEnd();
+    filledTriangle(x, y,
+                   x + baseWidth * 0.5f, y,
+                   x + baseWidth * 0.3f - flickerOffset, y + height * 0.3f, FIRE_RED);
     
     // Middle flame (orange)
-    setColor(FIRE_ORANGE);
-    glBegin(GL_TRIANGLES);
-    glVertex2f(x - baseWidth * 0.2f + flickerOffset * 0.5f, y + height * 0.3f);
-    glVertex2f(x + baseWidth * 0.2f - flickerOffset * 0.5f, y + height * 0.3f);
-    glVertex2f(x + flickerOffset, y + height * 0.7f);
-    glEnd();
+    filledTriangle(x - baseWidth * 0.2f + flickerOffset * 0.5f, y + height * 0.3f,
+                   x + baseWidth * 0.2f - flickerOffset * 0.5f, y + height * 0.3f,
+                   x + flickerOffset, y + height * 0.7f, FIRE_ORANGE);
     
     // Top flame (yellow)
-    setColor(FIRE_YELLOW);
-    glBegin(GL_TRIANGLES);
-    glVertex2f(x - baseWidth * 0.15f, y + height * 0.7f);
-    glVertex2f(x + baseWidth * 0.15f, y + height * 0.7f);
-    glVertex2f(x + flickerOffset * 0.5f, y + height);
-    glEnd();
-}
-
-void drawSmoke(float x, float y, float time, float baseRadius) {
-    // Multiple smoke puffs rising
-    for (int i = 0; i < 3; ++i) {
-        float offsetY = y + time * 2.0f + i * 0.5f;
-        float offsetX = x + sinf(time * 2.0f + i) * 0.3f;
-        float radius = baseRadius * (1.0f + time * 0.5f + i * 0.2f);
-        float alpha = 1.0f - (time * 0.3f + i * 0.1f);
-        if (alpha < 0.0f) alpha = 0.0f;
-        
-        Color smoke = {SMOKE_DARK.r * alpha, SMOKE_DARK.g * alpha, SMOKE_DARK.b * alpha};
-        drawCircle(offsetX, offsetY, radius, smoke, 20);
-    }
+    filledTriangle(x - baseWidth * 0.15f, y + height * 0.7f,
+                   x + baseWidth * 0.15f, y + height * 0.7f,
+                   x + flickerOffset * 0.5f, y + height, FIRE_YELLOW);
 }
 
 // -------------------------------------------------------------
 // Firecracker Functions
 // -------------------------------------------------------------
+// Shells fly as simulated state, but a burst keeps nothing per spark. Spark
+// i of a burst is a pure function of the shell's seed, i and the burst time:
+// its direction and speed come from hashing (seed, i), and its offset from
+// the burst point is the closed form of a ballistic arc under linear drag,
+//   drift(t) = (1 - e^(-k t)) / k,   offset = v drift(t) - (0, g (t - drift(t)) / k),
+// so drawing a burst is one pass over the spark indices, with nothing to
+// integrate, store or copy into the published tick. With SDF effects the
+// pass runs in the burst shader instead, so the spark constants live there.
+const int SPARK_DRAW_CHUNK = 1024;        // Sparks per draw item when drawn on the CPU
+
+// Integer hash with good avalanche (lowbias32), for per-spark randomness
+inline uint32_t hashUint(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+inline float hashUnit(uint32_t x) {
+    return (hashUint(x) >> 8) * (1.0f / 16777216.0f);
+}
+
 void initializeFirecrackers() {
     // Launch point: DIU rooftop
     float launchX = 22.0f;
     float launchY = 16.8f;
     
+    // Clear away the burnt-out batch
+    int finished = findArchetype(sim.world, ARCH_FIRECRACKER);
+    while (finished >= 0 && sim.world.archetypes[finished].size() > 0) {
+        despawnEntity(sim.world, sim.world.archetypes[finished].entities.back());
+    }
+    
     // Determine number of firecrackers (5-7)
     int numFirecrackers = 5 + (rand() % 3);  // Random between 5 and 7
+    ++sim.firecrackerBatches;
     
     for (int i = 0; i < numFirecrackers && i < MAX_FIRECRACKERS; ++i) {
-        firecrackers[i].x = launchX;
-        firecrackers[i].y = launchY;
-        firecrackers[i].travelDistance = 0.0f;
-        firecrackers[i].exploded = false;
-        firecrackers[i].explosionTime = 0.0f;
+        Archetype& shells = spawnEntity(sim.world, ARCH_FIRECRACKER);
+        const size_t row = shells.size() - 1;
+        Position& position = shells.positions[row];
+        Velocity& velocity = shells.velocities[row];
+        Shell& shell = shells.shells[row];
+        Burst& burst = shells.bursts[row];
+        burst.seed = hashUint(sim.firecrackerBatches * MAX_FIRECRACKERS + i);
+        position.x = launchX;
+        position.y = launchY;
+        shell.travelDistance = 0.0f;
+        burst.exploded = false;
+        burst.explosionTime = 0.0f;
         
         // Randomly assign trajectory type
-        firecrackers[i].trajectoryType = rand() % 3;  // 0, 1, or 2
+        shell.trajectoryType = rand() % 3;  // 0, 1, or 2
         
         // Set velocity based on trajectory type
-        if (firecrackers[i].trajectoryType == 0) {
+        if (shell.trajectoryType == 0) {
             // Type 0: Straight up - much higher velocity
-            firecrackers[i].vx = 0.0f;
-            firecrackers[i].vy = 0.25f + (rand() % 10) * 0.01f;  // 0.25 to 0.34 (much higher)
-            firecrackers[i].launchAngle = 90.0f;
-        } else if (firecrackers[i].trajectoryType == 1) {
+            velocity.vx = 0.0f;
+            velocity.vy = 0.25f + (rand() % 10) * 0.01f;  // 0.25 to 0.34 (much higher)
+            shell.launchAngle = 90.0f;
+        } else if (shell.trajectoryType == 1) {
             // Type 1: -x then up (left and up) - increased velocities
-            firecrackers[i].vx = -(0.08f + (rand() % 6) * 0.01f);  // -0.08 to -0.13
-            firecrackers[i].vy = 0.22f + (rand() % 8) * 0.01f;     // 0.22 to 0.29 (much higher)
-            firecrackers[i].launchAngle = 135.0f;  // Up-left
+            velocity.vx = -(0.08f + (rand() % 6) * 0.01f);  // -0.08 to -0.13
+            velocity.vy = 0.22f + (rand() % 8) * 0.01f;     // 0.22 to 0.29 (much higher)
+            shell.launchAngle = 135.0f;  // Up-left
         } else {
             // Type 2: +x then up (right and up) - increased velocities
-            firecrackers[i].vx = 0.08f + (rand() % 6) * 0.01f;   // 0.08 to 0.13
-            firecrackers[i].vy = 0.22f + (rand() % 8) * 0.01f;   // 0.22 to 0.29 (much higher)
-            firecrackers[i].launchAngle = 45.0f;  // Up-right
+            velocity.vx = 0.08f + (rand() % 6) * 0.01f;   // 0.08 to 0.13
+            velocity.vy = 0.22f + (rand() % 8) * 0.01f;   // 0.22 to 0.29 (much higher)
+            shell.launchAngle = 45.0f;  // Up-right
         }
         
         // Set max distance before explosion (random between 8.0 and 12.0 - much higher)
-        firecrackers[i].maxDistance = 8.0f + (rand() % 41) * 0.1f;  // 8.0 to 12.0 (much higher)
+        shell.maxDistance = 8.0f + (rand() % 41) * 0.1f;  // 8.0 to 12.0 (much higher)
         
         // Assign random color (red, yellow, blue, green)
         int colorType = rand() % 4;  // 0=red, 1=yellow, 2=blue, 3=green
         if (colorType == 0) {
-            firecrackers[i].color = FIRECRACKER_RED;
+            burst.color = FIRECRACKER_RED;
         } else if (colorType == 1) {
-            firecrackers[i].color = FIRECRACKER_YELLOW;
+            burst.color = FIRECRACKER_YELLOW;
         } else if (colorType == 2) {
-            firecrackers[i].color = FIRECRACKER_BLUE;
+            burst.color = FIRECRACKER_BLUE;
         } else {
-            firecrackers[i].color = FIRECRACKER_GREEN;
+            burst.color = FIRECRACKER_GREEN;
         }
     }
-    
-    // Mark remaining firecrackers as inactive
-    for (int i = numFirecrackers; i < MAX_FIRECRACKERS; ++i) {
-        firecrackers[i].exploded = true;
-        firecrackers[i].explosionTime = 2.1f;  // Mark as finished
-    }
 }
 
 bool areAllFirecrackersFinished() {
     // Check if all firecrackers have finished their explosion animations
-    for (int i = 0; i < MAX_FIRECRACKERS; ++i) {
-        // If firecracker hasn't exploded yet, or explosion is still animating, not finished
-        if (!firecrackers[i].exploded || firecrackers[i].explosionTime < 2.0f) {
-            return false;
+    bool finished = true;
+    forEachArchetype(sim.world, COMP_BURST, [&](const Archetype& shells) {
+        for (const Burst& burst : shells.bursts) {
+            // If firecracker hasn't exploded yet, or explosion is still animating, not finished
+            if (!burst.exploded || burst.explosionTime < 2.0f) finished = false;
         }
-    }
-    return true;
+    });
+    return finished;
 }
 
 void updateFirecrackers() {
-    if (!firecrackersActive) return;
+    if (!sim.firecrackersActive) return;
     
     // Check if all firecrackers have finished - if so, launch a new batch
     if (areAllFirecrackersFinished()) {
@@ -1082,38 +4052,46 @@ void updateFirecrackers() {
     
     float timeScale = deltaTime / 0.0167f;  // Normalize to 60 FPS (defined once for all firecrackers)
     
-    for (int i = 0; i < MAX_FIRECRACKERS; ++i) {
-        if (!firecrackers[i].exploded) {
-            // Update position (frame-rate independent)
-            firecrackers[i].x += firecrackers[i].vx * timeScale;
-            firecrackers[i].y += firecrackers[i].vy * timeScale;
-            
-            // Apply gravity (reduced downward acceleration for higher flight)
-            firecrackers[i].vy -= 0.0008f * timeScale;  // Slightly reduced gravity
-            
-            // Update travel distance (frame-rate independent)
-            float dx = firecrackers[i].vx * timeScale;
-            float dy = firecrackers[i].vy * timeScale;
-            firecrackers[i].travelDistance += sqrtf(dx * dx + dy * dy);
-            
-            // Check if firecracker should explode
-            if (firecrackers[i].travelDistance >= firecrackers[i].maxDistance) {
-                firecrackers[i].exploded = true;
-                firecrackers[i].explosionTime = 0.0f;
-            }
-        } else {
-            // Update explosion animation (frame-rate independent)
-            if (firecrackers[i].explosionTime < 2.0f) {
-                firecrackers[i].explosionTime += explosionSpeed * (deltaTime / 0.0167f);
+    forEachArchetype(sim.world, ARCH_FIRECRACKER, [&](Archetype& shells) {
+        parallelFor(shells.size(), [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                Position& position = shells.positions[i];
+                Velocity& velocity = shells.velocities[i];
+                Shell& shell = shells.shells[i];
+                Burst& burst = shells.bursts[i];
+                if (!burst.exploded) {
+                    // Update position (frame-rate independent)
+                    position.x += velocity.vx * timeScale;
+                    position.y += velocity.vy * timeScale;
+                
+                    // Apply gravity (reduced downward acceleration for higher flight)
+                    velocity.vy -= 0.0008f * timeScale;  // Slightly reduced gravity
+                
+                    // Update travel distance (frame-rate independent)
+                    float dx = velocity.vx * timeScale;
+                    float dy = velocity.vy * timeScale;
+                    shell.travelDistance += sqrtf(dx * dx + dy * dy);
+                
+                    // Check if firecracker should explode
+                    if (shell.travelDistance >= shell.maxDistance) {
+                        burst.exploded = true;
+                        burst.explosionTime = 0.0f;
+                    }
+                } else {
+                    // Update explosion animation (frame-rate independent)
+                    if (burst.explosionTime < 2.0f) {
+                        burst.explosionTime += explosionSpeed * (deltaTime / 0.0167f);
+                    }
+                }
             }
-        }
-    }
+        });
+    });
 }
 
 void drawFirecracker(float x, float y, const Color& color) {
     // Draw small firecracker body with random color
-    glPushMatrix();
-    glTranslatef(x, y, 0.0f);
+    pushTransform();
+    translateTransform(x, y);
     
     // Body with assigned color
     filledRect(-0.08f, -0.15f, 0.08f, 0.15f, color);
@@ -1126,88 +4104,697 @@ void drawFirecracker(float x, float y, const Color& color) {
     if (sparkColor.b > 1.0f) sparkColor.b = 1.0f;
     drawCircle(-0.12f, 0.0f, 0.03f, sparkColor, 8);
     
-    glPopMatrix();
+    popTransform();
 }
 
-void drawFirecrackerExplosion(float x, float y, float time, const Color& color) {
-    if (time > 2.0f) return;  // Explosion lasts 2 seconds
-    
-    float maxRadius = 2.0f * time;  // Expand over time (smaller than building explosion)
-    float fade = 1.0f - (time / 2.0f);  // Fade out
-    
-    if (fade <= 0.0f) return;
-    
-    // Outer explosion (using firecracker color) - largest
-    Color outerColor = {color.r * fade, color.g * fade, color.b * fade};
-    drawCircle(x, y, maxRadius, outerColor, 30);
-    
-    // Middle explosion (lighter version of color)
-    if (fade > 0.2f) {
-        float midRadius = maxRadius * 0.7f;
-        Color midColor = {color.r * 1.3f * fade, color.g * 1.3f * fade, color.b * 1.3f * fade};
-        if (midColor.r > 1.0f) midColor.r = 1.0f;
-        if (midColor.g > 1.0f) midColor.g = 1.0f;
-        if (midColor.b > 1.0f) midColor.b = 1.0f;
-        drawCircle(x, y, midRadius, midColor, 25);
+// Sparks [first, first + SPARK_DRAW_CHUNK) of the burst at (x, y). With SDF
+// effects the first call queues the whole burst for the burst shader instead.
+void drawFireworkSparks(float x0, float y0, const Burst& burst, int first) {
+    const float time = burst.explosionTime;
+    if (time > 2.0f) return;  // Burst lasts 2 units, like the shell explosions it replaced
+
+    // Terms shared by every spark of the burst
+    float drift = (1.0f - expf(-SPARK_DRAG * time)) / SPARK_DRAG;
+    float fall = SPARK_GRAVITY * (time - drift) / SPARK_DRAG;
+    float hot = std::max(0.0f, 1.0f - time * 4.0f);   // White-hot just after the burst
+    uint32_t twinkleFrame = static_cast<uint32_t>(time * 30.0f) * 0x85ebca6bu;
+    Color base = { std::min(1.0f, burst.color.r * 1.3f), std::min(1.0f, burst.color.g * 1.3f), std::min(1.0f, burst.color.b * 1.3f) };
+    base = { base.r + (1.0f - base.r) * hot, base.g + (1.0f - base.g) * hot, base.b + (1.0f - base.b) * hot };
+    if (submitBurst(x0, y0, time, burst.seed, base)) return;
+
+    const int last = std::min(fireworkSparks, first + SPARK_DRAW_CHUNK);
+    const float step = 6.2831853f / fireworkSparks;
+    for (int i = first; i < last; ++i) {
+        uint32_t h = burst.seed ^ (static_cast<uint32_t>(i) * 0x9e3779b9u);
+        float burnOut = 1.2f + 0.8f * hashUnit(h + 2);   // Burst time the spark dies at
+        float fade = 1.0f - time / burnOut;
+        if (fade <= 0.0f) continue;
+
+        float angle = (i + hashUnit(h)) * step;          // One spark per slice of the circle
+        float z = 2.0f * hashUnit(h + 1) - 1.0f;        // A shell of sparks seen side-on
+        float speed = BURST_RADIUS * SPARK_DRAG * sqrtf(1.0f - z * z);
+        float x = x0 + cosf(angle) * speed * drift;
+        float y = y0 + sinf(angle) * speed * drift - fall;
+
+        float light = fade * (0.6f + 0.4f * hashUnit(h ^ twinkleFrame));
+        float size = 0.03f + 0.03f * fade;
+        filledRect(x - size, y - size, x + size, y + size, { base.r * light, base.g * light, base.b * light });
     }
-    
-    // Inner explosion (even lighter/brighter version)
-    if (fade > 0.4f) {
-        float innerRadius = maxRadius * 0.5f;
-        Color innerColor = {color.r * 1.5f * fade, color.g * 1.5f * fade, color.b * 1.5f * fade};
-        if (innerColor.r > 1.0f) innerColor.r = 1.0f;
-        if (innerColor.g > 1.0f) innerColor.g = 1.0f;
-        if (innerColor.b > 1.0f) innerColor.b = 1.0f;
-        drawCircle(x, y, innerRadius, innerColor, 20);
+}
+
+// -------------------------------------------------------------
+// Missile Salvos
+// -------------------------------------------------------------
+// Each attack is a salvo of --salvo missiles, staged at once in sim.missiles
+// with their own launch time, launch point on DIU's roof, impact point on City
+// University and arc height (the first always flies the original arc from the
+// DIU sign to the City sign). Nothing about a staged missile changes: where it
+// is at any time, and the tangent of its arc there, follow in closed form, so
+// evaluateMissiles() places the whole pool in one pass of 8-wide AVX or 4-wide
+// SSE arithmetic. The simulation evaluates it every tick for the exhaust and
+// the impacts; display() evaluates it again at the drawn frame's clock, and
+// the rockets go out as instances of one prop mesh.
+const int MAX_MISSILES = 10000;
+const int MISSILE_DRAW_CHUNK = 256;       // Missiles per draw item
+const float SALVO_LAUNCH_WINDOW = 1.5f;   // Seconds over which a salvo leaves the roof
+int salvoSize = 1;                        // --salvo: missiles per salvo
+
+struct MissilePaths {                     // evaluateMissiles() output, per missile
+    ParticleArray x, y;
+    ParticleArray dirX, dirY;             // Unit tangent, pointing the way it flies
+    ParticleArray progress;               // 0 at launch, 1 at impact (below 0: not launched yet)
+};
+
+MissilePaths simMissilePaths;             // At the tick being run
+MissilePaths drawnMissilePaths;           // At the frame being drawn
+
+// Place every missile in `pool` at `time`. The arc is
+//   p(t) = from + t (to - from) + (0, 4 arc t (1 - t)),   t = progress in [0, 1]
+// and its tangent (to - from) + (0, 4 arc (1 - 2t)) gives the direction.
+void evaluateMissiles(const MissilePool& pool, float time, MissilePaths& out) {
+    const size_t n = pool.count();
+    for (ParticleArray* a : { &out.x, &out.y, &out.dirX, &out.dirY, &out.progress }) a->resize(n);
+    const float* launch = pool.launchTime.data();
+    const float* fromX = pool.fromX.data();
+    const float* fromY = pool.fromY.data();
+    const float* toX = pool.toX.data();
+    const float* toY = pool.toY.data();
+    const float* arc = pool.arc.data();
+    float* x = out.x.data();
+    float* y = out.y.data();
+    float* dirX = out.dirX.data();
+    float* dirY = out.dirY.data();
+    float* progress = out.progress.data();
+    const float rate = rocketSpeed / 0.0167f;  // Progress per second
+    size_t i = 0;
+#if defined(__AVX__)
+    const __m256 time8 = _mm256_set1_ps(time), rate8 = _mm256_set1_ps(rate);
+    const __m256 zero8 = _mm256_setzero_ps(), one8 = _mm256_set1_ps(1.0f);
+    const __m256 two8 = _mm256_set1_ps(2.0f), four8 = _mm256_set1_ps(4.0f);
+    for (; i + 8 <= n; i += 8) {
+        __m256 p = _mm256_mul_ps(_mm256_sub_ps(time8, _mm256_loadu_ps(launch + i)), rate8);
+        __m256 t = _mm256_min_ps(_mm256_max_ps(p, zero8), one8);
+        __m256 x0 = _mm256_loadu_ps(fromX + i), y0 = _mm256_loadu_ps(fromY + i);
+        __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(toX + i), x0);
+        __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(toY + i), y0);
+        __m256 h = _mm256_mul_ps(four8, _mm256_loadu_ps(arc + i));
+        __m256 lift = _mm256_mul_ps(_mm256_mul_ps(h, t), _mm256_sub_ps(one8, t));
+        __m256 ty = _mm256_add_ps(dy, _mm256_mul_ps(h, _mm256_sub_ps(one8, _mm256_mul_ps(two8, t))));
+        __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(ty, ty)));
+        _mm256_storeu_ps(x + i, _mm256_add_ps(x0, _mm256_mul_ps(t, dx)));
+        _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_add_ps(y0, _mm256_mul_ps(t, dy)), lift));
+        _mm256_storeu_ps(dirX + i, _mm256_div_ps(dx, len));
+        _mm256_storeu_ps(dirY + i, _mm256_div_ps(ty, len));
+        _mm256_storeu_ps(progress + i, p);
     }
-    
-    // Core (white/bright version)
-    if (fade > 0.6f) {
-        float coreRadius = maxRadius * 0.3f;
-        Color core = {1.0f * fade, 1.0f * fade, 1.0f * fade};
-        drawCircle(x, y, coreRadius, core, 15);
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128 time4 = _mm_set1_ps(time), rate4 = _mm_set1_ps(rate);
+    const __m128 zero4 = _mm_setzero_ps(), one4 = _mm_set1_ps(1.0f);
+    const __m128 two4 = _mm_set1_ps(2.0f), four4 = _mm_set1_ps(4.0f);
+    for (; i + 4 <= n; i += 4) {
+        __m128 p = _mm_mul_ps(_mm_sub_ps(time4, _mm_loadu_ps(launch + i)), rate4);
+        __m128 t = _mm_min_ps(_mm_max_ps(p, zero4), one4);
+        __m128 x0 = _mm_loadu_ps(fromX + i), y0 = _mm_loadu_ps(fromY + i);
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(toX + i), x0);
+        __m128 dy = _mm_sub_ps(_mm_loadu_ps(toY + i), y0);
+        __m128 h = _mm_mul_ps(four4, _mm_loadu_ps(arc + i));
+        __m128 lift = _mm_mul_ps(_mm_mul_ps(h, t), _mm_sub_ps(one4, t));
+        __m128 ty = _mm_add_ps(dy, _mm_mul_ps(h, _mm_sub_ps(one4, _mm_mul_ps(two4, t))));
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(ty, ty)));
+        _mm_storeu_ps(x + i, _mm_add_ps(x0, _mm_mul_ps(t, dx)));
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_add_ps(y0, _mm_mul_ps(t, dy)), lift));
+        _mm_storeu_ps(dirX + i, _mm_div_ps(dx, len));
+        _mm_storeu_ps(dirY + i, _mm_div_ps(ty, len));
+        _mm_storeu_ps(progress + i, p);
     }
-    
-    // Spark particles radiating outward (8 directions) - using color
-    int numSparks = 8;
-    float sparkRadius = 0.08f * fade;
-    Color sparkColor = {color.r * 1.2f * fade, color.g * 1.2f * fade, color.b * 1.2f * fade};
-    if (sparkColor.r > 1.0f) sparkColor.r = 1.0f;
-    if (sparkColor.g > 1.0f) sparkColor.g = 1.0f;
-    if (sparkColor.b > 1.0f) sparkColor.b = 1.0f;
-    for (int i = 0; i < numSparks; ++i) {
-        float angle = (i * 2.0f * 3.14159265358979323846f) / numSparks;
-        float sparkDist = maxRadius * 0.6f;
-        float sparkX = x + cosf(angle) * sparkDist;
-        float sparkY = y + sinf(angle) * sparkDist;
-        drawCircle(sparkX, sparkY, sparkRadius, sparkColor, 8);
+#endif
+    for (; i < n; ++i) {
+        float p = (time - launch[i]) * rate;
+        float t = std::min(std::max(p, 0.0f), 1.0f);
+        float dx = toX[i] - fromX[i], dy = toY[i] - fromY[i];
+        float h = 4.0f * arc[i];
+        float ty = dy + h * (1.0f - 2.0f * t);
+        float len = sqrtf(dx * dx + ty * ty);
+        x[i] = fromX[i] + t * dx;
+        y[i] = fromY[i] + t * dy + h * t * (1.0f - t);
+        dirX[i] = dx / len;
+        dirY[i] = ty / len;
+        progress[i] = p;
+    }
+}
+
+// Stage the next salvo; its first missile leaves the roof at `time`
+void launchSalvo(float time) {
+    MissilePool& pool = sim.missiles;
+    pool.launch(time, 22.0f, 16.8f, -22.0f, 10.9f, 1.0f);
+    const uint32_t salvo = static_cast<uint32_t>(sim.missileHitCount);
+    for (int i = 1; i < salvoSize && pool.count() < static_cast<size_t>(MAX_MISSILES); ++i) {
+        // The rest leave one by one from along the sign, for anywhere on the
+        // City roof, some arcing high
+        const uint32_t h = hashUint(salvo * MAX_MISSILES + i);
+        float delay = SALVO_LAUNCH_WINDOW * (i + hashUnit(h)) / salvoSize;
+        float fromX = 22.0f + 12.0f * (hashUnit(h + 1) - 0.5f);
+        float toX = -22.0f + 17.0f * (hashUnit(h + 2) - 0.5f);
+        float toY = fabsf(toX + 22.0f) < 3.0f ? 10.9f : 10.0f;  // The sign, or the roof on either side
+        pool.launch(time + delay, fromX, 16.8f, toX, toY, 0.5f + 5.5f * hashUnit(h + 3));
+    }
+}
+
+// Move the salvo on to `time`: exhaust from the missiles in the air, and the
+// ones that got there leave the pool. True once the last one has landed.
+bool updateMissiles(float time) {
+    MissilePool& pool = sim.missiles;
+    MissilePaths& paths = simMissilePaths;
+    evaluateMissiles(pool, time, paths);
+    for (size_t i = 0; i < pool.count(); ++i) {
+        if (paths.progress[i] > 0.0f && paths.progress[i] < 1.0f) {
+            emitExhaust(paths.x[i], paths.y[i], paths.dirX[i], paths.dirY[i]);
+        }
+    }
+    for (size_t i = pool.count(); i-- > 0; ) {
+        if (paths.progress[i] >= 1.0f) pool.remove(i);
+    }
+    return pool.count() == 0;
+}
+
+// Missiles [first, first + MISSILE_DRAW_CHUNK) of drawnMissilePaths
+void drawMissileChunk(size_t first) {
+    const MissilePaths& paths = drawnMissilePaths;
+    const size_t last = std::min(paths.x.size(), first + MISSILE_DRAW_CHUNK);
+    for (size_t i = first; i < last; ++i) {
+        if (paths.progress[i] <= 0.0f || paths.progress[i] >= 1.0f) continue;  // On the roof, or landed
+        drawRocket(paths.x[i], paths.y[i], paths.dirX[i], paths.dirY[i]);
+    }
+}
+
+// -------------------------------------------------------------
+// Campus Navigation
+// -------------------------------------------------------------
+// The ground people walk on, from the front of the grass (y = 1) to the foot
+// of the buildings (y = 3), is a grid of 0.1-unit cells. Tree trunks, street
+// light poles, bushes and building walls block cells; the doors don't. Each
+// goal has a flow field: a Dijkstra pass out from the goal cells (octile
+// steps, never cutting past a blocked corner) gives every cell its walking
+// distance to the goal, and each cell keeps the step its path starts with,
+// so any number of people find their way by reading the cell under their
+// feet. Ties go to straight steps, which keeps people on the road until
+// they turn in near the end. When cells close or open (the City building
+// coming down in rubble) the fields are repaired rather than rebuilt: only
+// the cells whose paths ran through a changed cell are cleared, and the
+// search restarts from the unaffected cells around them.
+bool flowFieldNavigation = true;          // --no-flow-field: walk straight along the road between the two campuses
+const float NAV_LEFT = -40.0f;            // Grid origin (world coordinates)
+const float NAV_BOTTOM = 1.0f;
+const float NAV_CELL = 0.1f;
+const int NAV_COLS = 800;
+const int NAV_ROWS = 20;
+const int NAV_CELLS = NAV_COLS * NAV_ROWS;
+const float NAV_TOP = NAV_BOTTOM + NAV_ROWS * NAV_CELL;
+const float NAV_UNREACHABLE = 1e30f;
+const float NAV_TIE = 0.01f;              // Paths this close in length (in cells) count as equally short
+const int8_t NAV_NO_STEP = -1;            // At the goal, or cut off from it
+
+enum NavGoal { NAV_CITY_ENTRANCE, NAV_DIU_FRONT, NAV_CELEBRATION, NUM_NAV_GOALS };
+
+struct NavRect { float x1, y1, x2, y2; };
+
+// City University's door has two leaves: people go in by the east one (the
+// side they come from) and out of the west one, and each way in front of a
+// leaf is its own lane, so the way in and the way out never meet head on
+const float CITY_DOOR_EAST_LEAF_X1 = CITY_CENTER_X + CITY_DOOR_MULLION_HALF_WIDTH;
+const float CITY_DOOR_EAST_LEAF_X2 = CITY_CENTER_X + CITY_DOOR_HALF_WIDTH;
+const float CITY_DOOR_LANE_Y = 2.4f;      // Where the lanes in front of the leaves start
+
+const NavRect NAV_GOAL_AREAS[NUM_NAV_GOALS] = {
+    { CITY_DOOR_EAST_LEAF_X1, 2.9f, CITY_DOOR_EAST_LEAF_X2, 3.0f },  // City University's door, east leaf
+    { DIU_CENTER_X - DIU_STEP_HALF_WIDTH, DIU_STEP_Y1, DIU_CENTER_X + DIU_STEP_HALF_WIDTH, 2.2f },  // DIU's front steps
+    { 18.0f, 2.1f, 26.0f, 2.81f },        // In front of DIU, where arriveAtDiu() picks the spots
+};
+
+// Per goal, the other way's lane: steps out of it cost NAV_LANE_COST times
+// as much, so it's only walked through when there's no other way
+const NavRect NAV_AVOID_AREAS[NUM_NAV_GOALS] = {
+    { 2.0f * CITY_CENTER_X - CITY_DOOR_EAST_LEAF_X2, CITY_DOOR_LANE_Y, 2.0f * CITY_CENTER_X - CITY_DOOR_EAST_LEAF_X1, 3.0f },  // Out of the west leaf
+    { CITY_DOOR_EAST_LEAF_X1, CITY_DOOR_LANE_Y, CITY_DOOR_EAST_LEAF_X2, 3.0f },  // Into the east leaf
+    { 0.0f, 0.0f, 0.0f, 0.0f },
+};
+const float NAV_LANE_COST = 8.0f;
+
+// The eight steps, straight ones first
+const int NAV_STEP_X[8] = { 1, -1, 0, 0, 1, -1, 1, -1 };
+const int NAV_STEP_Y[8] = { 0, 0, 1, -1, 1, 1, -1, -1 };
+const float NAV_STEP_COST[8] = { 1.0f, 1.0f, 1.0f, 1.0f, 1.41421356f, 1.41421356f, 1.41421356f, 1.41421356f };
+
+struct FlowField {
+    std::vector<float> cost;              // Per cell: walking distance to the goal, in cells
+    std::vector<int8_t> step;             // Per cell: first step of that walk
+    std::vector<uint8_t> avoid;           // Per cell: in the other way's lane (NAV_AVOID_AREAS)
+};
+
+struct CampusNav {
+    std::vector<uint8_t> blocked;         // Per cell
+    FlowField fields[NUM_NAV_GOALS];
+};
+
+typedef std::pair<float, int> NavOpen;    // Cost, cell
+typedef std::priority_queue<NavOpen, std::vector<NavOpen>, std::greater<NavOpen>> NavQueue;
+
+CampusNav campusNav;
+
+inline int navCell(int col, int row) { return row * NAV_COLS + col; }
+inline bool navInside(int col, int row) { return col >= 0 && col < NAV_COLS && row >= 0 && row < NAV_ROWS; }
+
+// Cell under a world position (-1 off the grid)
+inline int navCellAt(float x, float y) {
+    int col = static_cast<int>(floorf((x - NAV_LEFT) / NAV_CELL));
+    int row = static_cast<int>(floorf((y - NAV_BOTTOM) / NAV_CELL));
+    return navInside(col, row) ? navCell(col, row) : -1;
+}
+
+inline bool navBlockedAt(float x, float y) {
+    int cell = navCellAt(x, y);
+    return cell >= 0 && campusNav.blocked[cell];
+}
+
+// Cells a rectangle overlaps
+void navCellRange(const NavRect& r, int& col0, int& col1, int& row0, int& row1) {
+    col0 = std::max(0, static_cast<int>(floorf((r.x1 - NAV_LEFT) / NAV_CELL + 0.001f)));
+    col1 = std::min(NAV_COLS - 1, static_cast<int>(ceilf((r.x2 - NAV_LEFT) / NAV_CELL - 0.001f)) - 1);
+    row0 = std::max(0, static_cast<int>(floorf((r.y1 - NAV_BOTTOM) / NAV_CELL + 0.001f)));
+    row1 = std::min(NAV_ROWS - 1, static_cast<int>(ceilf((r.y2 - NAV_BOTTOM) / NAV_CELL - 0.001f)) - 1);
+}
+
+bool navRectHolds(const NavRect& r, int cell) {
+    int col0, col1, row0, row1;
+    navCellRange(r, col0, col1, row0, row1);
+    int col = cell % NAV_COLS, row = cell / NAV_COLS;
+    return col >= col0 && col <= col1 && row >= row0 && row <= row1;
+}
+
+// Step s from (col, row) stays on open ground (and doesn't squeeze past a corner)
+bool navStepOpen(int col, int row, int s) {
+    const int toCol = col + NAV_STEP_X[s], toRow = row + NAV_STEP_Y[s];
+    if (!navInside(col, row) || !navInside(toCol, toRow)) return false;
+    const std::vector<uint8_t>& blocked = campusNav.blocked;
+    if (blocked[navCell(col, row)] || blocked[navCell(toCol, toRow)]) return false;
+    return s < 4 || (!blocked[navCell(toCol, row)] && !blocked[navCell(col, toRow)]);
+}
+
+// Offer `cell` the walk that starts with step s (to a cell whose cost is known)
+void offerNavStep(FlowField& field, int cell, int s, NavQueue& open) {
+    const int to = cell + NAV_STEP_Y[s] * NAV_COLS + NAV_STEP_X[s];
+    const float cost = field.cost[to] + NAV_STEP_COST[s] * (field.avoid[cell] ? NAV_LANE_COST : 1.0f);
+    if (cost < field.cost[cell] - NAV_TIE) {
+        field.cost[cell] = cost;
+        field.step[cell] = static_cast<int8_t>(s);
+        open.push(NavOpen(cost, cell));
+    } else if (cost < field.cost[cell] + NAV_TIE && s < 4 && field.step[cell] >= 4) {
+        field.step[cell] = static_cast<int8_t>(s);  // Just as short, and straight
+    }
+}
+
+// Dijkstra out from the queued cells
+void propagateFlowField(FlowField& field, NavQueue& open) {
+    while (!open.empty()) {
+        const NavOpen top = open.top();
+        open.pop();
+        if (top.first > field.cost[top.second]) continue;  // Already reached more cheaply
+        const int col = top.second % NAV_COLS, row = top.second / NAV_COLS;
+        for (int s = 0; s < 8; ++s) {
+            // The neighbour whose step s lands here
+            const int fromCol = col - NAV_STEP_X[s], fromRow = row - NAV_STEP_Y[s];
+            if (navStepOpen(fromCol, fromRow, s)) offerNavStep(field, navCell(fromCol, fromRow), s, open);
+        }
+    }
+}
+
+void buildFlowField(NavGoal goal) {
+    FlowField& field = campusNav.fields[goal];
+    field.cost.assign(NAV_CELLS, NAV_UNREACHABLE);
+    field.step.assign(NAV_CELLS, NAV_NO_STEP);
+    field.avoid.assign(NAV_CELLS, 0);
+    for (int cell = 0; cell < NAV_CELLS; ++cell) field.avoid[cell] = navRectHolds(NAV_AVOID_AREAS[goal], cell);
+    NavQueue open;
+    int col0, col1, row0, row1;
+    navCellRange(NAV_GOAL_AREAS[goal], col0, col1, row0, row1);
+    for (int row = row0; row <= row1; ++row) {
+        for (int col = col0; col <= col1; ++col) {
+            const int cell = navCell(col, row);
+            if (campusNav.blocked[cell]) continue;
+            field.cost[cell] = 0.0f;
+            open.push(NavOpen(0.0f, cell));
+        }
+    }
+    propagateFlowField(field, open);
+}
+
+// Whether the walk from `cell` runs through `through` (or, when that one is
+// blocked, squeezes past it on a diagonal)
+bool navPathCrosses(const FlowField& field, int cell, int through) {
+    const int s = field.step[cell];
+    if (s == NAV_NO_STEP) return false;
+    const int col = cell % NAV_COLS, row = cell / NAV_COLS;
+    if (navCell(col + NAV_STEP_X[s], row + NAV_STEP_Y[s]) == through) return true;
+    return s >= 4 && campusNav.blocked[through] &&
+        (navCell(col + NAV_STEP_X[s], row) == through || navCell(col, row + NAV_STEP_Y[s]) == through);
+}
+
+// Bring a field up to date after the cells in `changed` closed or opened
+void repairFlowField(NavGoal goal, const std::vector<int>& changed) {
+    FlowField& field = campusNav.fields[goal];
+
+    // Clear the closed cells and every cell whose walk depended on them
+    std::vector<int> cleared;
+    for (int cell : changed) {
+        if (!campusNav.blocked[cell]) continue;
+        field.cost[cell] = NAV_UNREACHABLE;
+        field.step[cell] = NAV_NO_STEP;
+        cleared.push_back(cell);
+    }
+    for (size_t k = 0; k < cleared.size(); ++k) {
+        const int through = cleared[k];
+        const int col = through % NAV_COLS, row = through / NAV_COLS;
+        for (int y = row - 1; y <= row + 1; ++y) {
+            for (int x = col - 1; x <= col + 1; ++x) {
+                if (!navInside(x, y)) continue;
+                const int cell = navCell(x, y);
+                if (field.cost[cell] >= NAV_UNREACHABLE || !navPathCrosses(field, cell, through)) continue;
+                field.cost[cell] = NAV_UNREACHABLE;
+                field.step[cell] = NAV_NO_STEP;
+                cleared.push_back(cell);
+            }
+        }
+    }
+
+    // Search again from whatever borders the cleared cells and the opened
+    // ones; cells next to an opened cell are expanded again too, as it may
+    // have freed a corner they couldn't cut before
+    NavQueue open;
+    auto reseed = [&](int cell) {
+        if (campusNav.blocked[cell]) return;
+        if (navRectHolds(NAV_GOAL_AREAS[goal], cell)) {
+            field.cost[cell] = 0.0f;
+            field.step[cell] = NAV_NO_STEP;
+            open.push(NavOpen(0.0f, cell));
+            return;
+        }
+        const int col = cell % NAV_COLS, row = cell / NAV_COLS;
+        for (int s = 0; s < 8; ++s) {
+            if (navStepOpen(col, row, s)) offerNavStep(field, cell, s, open);
+        }
+    };
+    for (int cell : cleared) reseed(cell);
+    for (int cell : changed) {
+        if (campusNav.blocked[cell]) continue;
+        reseed(cell);
+        const int col = cell % NAV_COLS, row = cell / NAV_COLS;
+        for (int y = row - 1; y <= row + 1; ++y) {
+            for (int x = col - 1; x <= col + 1; ++x) {
+                if (navInside(x, y) && field.cost[navCell(x, y)] < NAV_UNREACHABLE) {
+                    open.push(NavOpen(field.cost[navCell(x, y)], navCell(x, y)));
+                }
+            }
+        }
+    }
+    propagateFlowField(field, open);
+}
+
+// Close (or open) the cells under a rectangle, noting the ones that changed
+void setNavBlocked(const NavRect& r, bool blocked, std::vector<int>* changed = nullptr) {
+    int col0, col1, row0, row1;
+    navCellRange(r, col0, col1, row0, row1);
+    for (int row = row0; row <= row1; ++row) {
+        for (int col = col0; col <= col1; ++col) {
+            uint8_t& cell = campusNav.blocked[navCell(col, row)];
+            if (cell == static_cast<uint8_t>(blocked)) continue;
+            cell = blocked;
+            if (changed) changed->push_back(navCell(col, row));
+        }
+    }
+}
+
+// Footprints of everything on the ground (the campus layout's trees, street
+// lights, bushes and building fronts), then the fields from scratch. A
+// footprint runs from the foot of a prop back as far as it stands in the way.
+void buildCampusNav() {
+    campusNav.blocked.assign(NAV_CELLS, 0);
+
+    for (const TreePlacement& t : TREES) {
+        const float halfW = TREE_TRUNK_HALF_WIDTH * t.scale;
+        setNavBlocked({ t.x - halfW, TREE_BASE_Y, t.x + halfW, TREE_BASE_Y + 0.3f }, true);
+    }
+    for (float x : STREET_LIGHT_XS) {
+        setNavBlocked({ x - STREET_LIGHT_POLE_HALF_WIDTH, STREET_LIGHT_BASE_Y,
+            x + STREET_LIGHT_POLE_HALF_WIDTH, STREET_LIGHT_BASE_Y + 0.2f }, true);
+    }
+
+    // Bushes: City's stand in front of the road, DIU's at the foot of its wings
+    for (const BushPlacement& b : CITY_BUSHES) {
+        const float x = CITY_CENTER_X + b.x;
+        setNavBlocked({ x - 0.5f * b.width, b.y, x + 0.5f * b.width, b.y + 0.5f }, true);
+    }
+    for (const BushPlacement& b : DIU_BUSHES) {
+        const float x = DIU_CENTER_X + b.x;
+        setNavBlocked({ x - 0.5f * b.width, b.y, x + 0.5f * b.width, b.y + 0.45f }, true);
+    }
+
+    // Building fronts along the back row, open at the doors
+    const float frontY = NAV_TOP - NAV_CELL;
+    setNavBlocked({ CITY_CENTER_X - CITY_ROOF_HALF_WIDTH, frontY, CITY_CENTER_X - CITY_DOOR_HALF_WIDTH, NAV_TOP }, true);
+    setNavBlocked({ CITY_CENTER_X - CITY_DOOR_MULLION_HALF_WIDTH, frontY, CITY_CENTER_X + CITY_DOOR_MULLION_HALF_WIDTH, NAV_TOP }, true);
+    setNavBlocked({ CITY_CENTER_X + CITY_DOOR_HALF_WIDTH, frontY, CITY_CENTER_X + CITY_ROOF_HALF_WIDTH, NAV_TOP }, true);
+    setNavBlocked({ DIU_CENTER_X - DIU_WING_HALF_WIDTH, frontY, DIU_CENTER_X - DIU_DOOR_HALF_WIDTH, NAV_TOP }, true);
+    setNavBlocked({ DIU_CENTER_X + DIU_DOOR_HALF_WIDTH, frontY, DIU_CENTER_X + DIU_WING_HALF_WIDTH, NAV_TOP }, true);
+
+    for (int goal = 0; goal < NUM_NAV_GOALS; ++goal) buildFlowField(static_cast<NavGoal>(goal));
+}
+
+// The collapsed side blocks spill rubble over the front of City University,
+// leaving a way through to the door
+void dropCityRubble() {
+    std::vector<int> changed;
+    for (const RubbleHeap& heap : CITY_RUBBLE) {
+        setNavBlocked({ CITY_CENTER_X + heap.x1, NAV_TOP - 0.5f, CITY_CENTER_X + heap.x2, NAV_TOP }, true, &changed);
+    }
+    for (int goal = 0; goal < NUM_NAV_GOALS; ++goal) repairFlowField(static_cast<NavGoal>(goal), changed);
+}
+
+NavGoal navGoalFor(PersonState state) {
+    switch (state) {
+    case PERSON_TO_CITY: return NAV_CITY_ENTRANCE;
+    case PERSON_TO_DIU: return NAV_DIU_FRONT;
+    default: return NAV_CELEBRATION;
+    }
+}
+
+bool atNavGoal(NavGoal goal, float x, float y) {
+    int cell = navCellAt(x, y);
+    return cell >= 0 && campusNav.fields[goal].cost[cell] == 0.0f;
+}
+
+// Unit direction to walk toward `goal` from (x, y); false at the goal, off
+// the grid, or where the goal can't be reached
+bool flowDirection(NavGoal goal, float x, float y, float& dx, float& dy) {
+    const int cell = navCellAt(x, y);
+    if (cell < 0) return false;
+    const FlowField& field = campusNav.fields[goal];
+    int s = field.step[cell];
+    if (campusNav.blocked[cell]) {
+        // Caught where something came down: out by the best open neighbour
+        const int col = cell % NAV_COLS, row = cell / NAV_COLS;
+        float best = NAV_UNREACHABLE;
+        for (int k = 0; k < 8; ++k) {
+            const int toCol = col + NAV_STEP_X[k], toRow = row + NAV_STEP_Y[k];
+            if (!navInside(toCol, toRow) || campusNav.blocked[navCell(toCol, toRow)]) continue;
+            const float cost = field.cost[navCell(toCol, toRow)] + NAV_STEP_COST[k];
+            if (cost < best) { best = cost; s = k; }
+        }
+    }
+    if (s == NAV_NO_STEP) return false;
+    dx = NAV_STEP_X[s] / NAV_STEP_COST[s];
+    dy = NAV_STEP_Y[s] / NAV_STEP_COST[s];
+    return true;
+}
+
+// -------------------------------------------------------------
+// Crowd
+// -------------------------------------------------------------
+// People move as agents. Each one heads for its goal (City University, then
+// back to DIU, then its own spot in front of DIU) along the campus flow
+// fields, is pushed away from anyone closer than two personal radii, and
+// sidesteps whoever is just ahead of it. Neighbours come from a uniform grid
+// hashed into buckets and rebuilt every tick with a counting sort, so an
+// agent only looks at the people in the 3x3 cells around it. The radius
+// shrinks as the crowd grows (the road doesn't), which keeps the neighbours
+// per agent about the same at any size. Agents read the positions from the
+// start of the tick and each writes only its own next position, so the tick
+// can be split across the job pool without changing the result.
+bool crowdAvoidance = true;               // --no-crowd-avoidance: walk straight through each other
+float crowdRadius = 0.3f;                 // Personal radius, set for the crowd size in initializePeople()
+const float CROWD_BAND_BOTTOM = 2.1f;     // Where people keep to on the road without the flow fields
+const float CROWD_BAND_TOP = 2.81f;
+const float CROWD_PUSH = 1.5f;            // Separation speed at full overlap, in walking speeds
+const float CROWD_SIDESTEP = 0.8f;        // Sidestep speed for someone right ahead, in walking speeds
+
+struct SpatialHash {
+    float cellSize = 1.0f;
+    uint32_t mask = 0;                    // Bucket count - 1 (a power of two)
+    std::vector<uint32_t> bucketStart;    // Per bucket: its first entry (plus one end marker)
+    std::vector<uint32_t> entries;        // Rows, grouped by bucket
+    std::vector<uint32_t> bucketOf;       // Per row
+    std::vector<int32_t> cellX, cellY;    // Per row
+    std::vector<uint32_t> fill;           // Scratch for the scatter
+};
+
+SpatialHash crowdHash;
+std::vector<Position> crowdNext;          // Positions at the end of the tick being run
+
+inline uint32_t cellBucket(int32_t cx, int32_t cy, uint32_t mask) {
+    return (static_cast<uint32_t>(cx) * 73856093u ^ static_cast<uint32_t>(cy) * 19349663u) & mask;
+}
+
+void buildSpatialHash(SpatialHash& hash, const std::vector<Position>& positions, float cellSize) {
+    const size_t n = positions.size();
+    uint32_t buckets = 64;
+    while (buckets < 2 * n) buckets <<= 1;
+    hash.cellSize = cellSize;
+    hash.mask = buckets - 1;
+    hash.bucketStart.assign(buckets + 1, 0);
+    hash.entries.resize(n);
+    hash.bucketOf.resize(n);
+    hash.cellX.resize(n);
+    hash.cellY.resize(n);
+
+    const float inv = 1.0f / cellSize;
+    for (size_t i = 0; i < n; ++i) {
+        hash.cellX[i] = static_cast<int32_t>(floorf(positions[i].x * inv));
+        hash.cellY[i] = static_cast<int32_t>(floorf(positions[i].y * inv));
+        hash.bucketOf[i] = cellBucket(hash.cellX[i], hash.cellY[i], hash.mask);
+        ++hash.bucketStart[hash.bucketOf[i] + 1];
+    }
+    for (uint32_t b = 0; b < buckets; ++b) hash.bucketStart[b + 1] += hash.bucketStart[b];
+    hash.fill.assign(hash.bucketStart.begin(), hash.bucketStart.end() - 1);
+    for (size_t i = 0; i < n; ++i) hash.entries[hash.fill[hash.bucketOf[i]]++] = static_cast<uint32_t>(i);
+}
+
+// Call f(j) for every other row in the 3x3 cells around row i. Buckets can
+// be shared by several cells, so entries are checked against the cell.
+template <typename F>
+void forEachNeighbour(const SpatialHash& hash, size_t i, F f) {
+    const int32_t cx = hash.cellX[i], cy = hash.cellY[i];
+    for (int32_t y = cy - 1; y <= cy + 1; ++y) {
+        for (int32_t x = cx - 1; x <= cx + 1; ++x) {
+            const uint32_t b = cellBucket(x, y, hash.mask);
+            for (uint32_t k = hash.bucketStart[b]; k < hash.bucketStart[b + 1]; ++k) {
+                const uint32_t j = hash.entries[k];
+                if (j != i && hash.cellX[j] == x && hash.cellY[j] == y) f(j);
+            }
+        }
+    }
+}
+
+// Where row i of the crowd is one tick from now, from everyone's positions now
+Position steerAgent(const Archetype& people, size_t i) {
+    const Position& p = people.positions[i];
+    const float speed = people.walkers[i].speed;
+    float vx = 0.0f, vy = 0.0f;  // Units per second
+    switch (people.personStates[i]) {
+    case PERSON_TO_CITY: vx = -speed; break;
+    case PERSON_TO_DIU: vx = speed; break;
+    case PERSON_CELEBRATING: {
+        // Slow down on arrival: full speed until half a unit out
+        float dx = people.goals[i].x - p.x, dy = people.goals[i].y - p.y;
+        float dist = sqrtf(dx * dx + dy * dy);
+        if (dist > 0.001f) {
+            float s = std::min(speed, dist * 2.0f);
+            vx = dx / dist * s;
+            vy = dy / dist * s;
+        }
+        break;
+    }
+    }
+    // Around whatever is in the way, by the field for the leg being walked
+    float flowX, flowY;
+    if (flowFieldNavigation && flowDirection(navGoalFor(people.personStates[i]), p.x, p.y, flowX, flowY)) {
+        vx = flowX * speed;
+        vy = flowY * speed;
+    }
+
+    if (crowdAvoidance) {
+        const float reach = 2.0f * crowdRadius;
+        const float heading = vx > 0.0f ? 1.0f : vx < 0.0f ? -1.0f : 0.0f;
+        float pushX = 0.0f, pushY = 0.0f;
+        forEachNeighbour(crowdHash, i, [&](uint32_t j) {
+            float ox = p.x - people.positions[j].x, oy = p.y - people.positions[j].y;
+            float side = oy != 0.0f ? (oy > 0.0f ? 1.0f : -1.0f) : (i < j ? 1.0f : -1.0f);
+            float d2 = ox * ox + oy * oy;
+            if (d2 < reach * reach) {
+                float d = sqrtf(d2);
+                float overlap = 1.0f - d / reach;
+                if (d > 1e-6f) {
+                    pushX += ox / d * overlap;
+                    pushY += oy / d * overlap;
+                } else {
+                    pushY += side;  // Exactly on top of each other: split up and down
+                }
+            }
+            float ahead = -ox * heading;
+            if (ahead > 0.0f && ahead < reach && fabsf(oy) < reach) {
+                pushY += side * (1.0f - ahead / reach) * (CROWD_SIDESTEP / CROWD_PUSH);
+            }
+        });
+        // However packed it gets, nobody gets shoved faster than the push speed
+        float push = sqrtf(pushX * pushX + pushY * pushY);
+        float scale = CROWD_PUSH * speed / std::max(1.0f, push);
+        vx += pushX * scale;
+        vy += pushY * scale;
+    }
+
+    Position next = { p.x + vx * deltaTime, p.y + vy * deltaTime };
+    if (!flowFieldNavigation) {
+        next.y = std::max(CROWD_BAND_BOTTOM, std::min(CROWD_BAND_TOP, next.y));
+        return next;
+    }
+    next.y = std::max(NAV_BOTTOM, std::min(NAV_TOP - 0.001f, next.y));
+    // Slide along anything in the way rather than step into it
+    if (navBlockedAt(next.x, next.y) && !navBlockedAt(p.x, p.y)) {
+        if (!navBlockedAt(next.x, p.y)) next.y = p.y;
+        else if (!navBlockedAt(p.x, next.y)) next.x = p.x;
+        else next = p;
     }
+    return next;
 }
 
 // -------------------------------------------------------------
 // People Animation Functions
 // -------------------------------------------------------------
 void initializePeople() {
-    numPeople = 30;  // Fixed 30 people
     float startX = 22.0f;  // DIU position
     float roadY = 1.8f;    // Road Y position
     
     // Calculate spacing - spread people out in a line from DIU
     // People will be positioned from DIU (x=22) going backwards
     float spacing = 1.2f;  // Distance between people (spacing for visibility)
+    if (numPeople > 30) spacing *= 29.0f / (numPeople - 1);  // Large crowds pack into the same 30-person line
+    crowdRadius = std::max(0.005f, 0.3f * std::min(1.0f, sqrtf(30.0f / numPeople)));
+    if (flowFieldNavigation) buildCampusNav();
     
     for (int i = 0; i < numPeople; ++i) {
+        Archetype& people = spawnEntity(sim.world, ARCH_PERSON);
+        const size_t row = people.size() - 1;
+        Position& position = people.positions[row];
+        Walker& walker = people.walkers[row];
+        
         // Position people with spacing, starting from DIU going backwards
         // First person at DIU (x=22), others spread behind
-        people[i].x = startX - (i * spacing);
+        position.x = startX - (i * spacing);
         // Add slight Y variation for more natural look
-        people[i].y = roadY + 0.3f + (rand() % 5) * 0.1f;  // On road, slight variation
-        people[i].walkCycle = (rand() % 100) / 100.0f;  // Random starting walk cycle
-        people[i].walkingToCity = true;
-        people[i].walkingToDIU = false;
-        people[i].stopped = false;
-        people[i].celebrating = false;
-        people[i].celebrationCycle = (rand() % 100) / 100.0f;  // Random starting celebration cycle
+        position.y = roadY + 0.3f + (rand() % 5) * 0.1f;  // On road, slight variation
+        walker.walkCycle = (rand() % 100) / 100.0f;  // Random starting walk cycle
+        people.personStates[row] = PERSON_TO_CITY;
+        people.celebrations[row].cycle = (rand() % 100) / 100.0f;  // Random starting celebration cycle
+        people.goals[row] = { -22.0f, position.y };
         
         // Calculate speed so the furthest person reaches City University in 10 seconds
         // Furthest person starts at: startX - ((numPeople-1) * spacing)
@@ -1217,73 +4804,96 @@ void initializePeople() {
         float distanceToTravel = furthestStartX - (-22.0f);
         float requiredSpeed = distanceToTravel / 10.0f;  // Reach in 10 seconds
         
-        // Use slightly faster speed to ensure they all arrive in time
-        people[i].speed = requiredSpeed * 1.1f;  // 10% faster to ensure arrival
+        // Use slightly faster speed to ensure they all arrive in time; some
+        // walk faster still, so there is someone to overtake
+        walker.speed = requiredSpeed * (1.1f + 0.2f * hashUnit(static_cast<uint32_t>(i) + 0x632be5abu));
         
         // Random shirt colors
-        int colorType = rand() % 4;
-        if (colorType == 0) {
-            people[i].shirtColor = {0.8f, 0.2f, 0.2f};  // Red
-        } else if (colorType == 1) {
-            people[i].shirtColor = {0.2f, 0.2f, 0.8f};  // Blue
-        } else if (colorType == 2) {
-            people[i].shirtColor = {0.2f, 0.8f, 0.2f};  // Green
-        } else {
-            people[i].shirtColor = {0.8f, 0.8f, 0.2f};  // Yellow
-        }
+        people.shirts[row] = rand() % NUM_SHIRT_COLORS;
+    }
+    sim.peopleInitialized = true;
+}
+
+// Whether someone walking to City University (or back to DIU) got there
+bool legFinished(PersonState state, const Position& p) {
+    if (flowFieldNavigation) return atNavGoal(navGoalFor(state), p.x, p.y);
+    return state == PERSON_TO_CITY ? p.x <= -22.0f : p.x >= 22.0f;
+}
+
+std::vector<std::vector<int>> peopleArrivals;  // Per parallelFor chunk: rows that reached DIU this tick
+
+// Someone reaching DIU picks a random spot in front of it to walk to
+void arriveAtDiu(Archetype& people, size_t row) {
+    Goal& goal = people.goals[row];
+    // Random X position between 18.0 and 26.0 (around DIU at x=22)
+    goal.x = 18.0f + (rand() % 801) * 0.01f;  // Random between 18.0 and 26.0
+    // Random Y position variation
+    goal.y = 1.8f + 0.3f + (rand() % 71) * 0.01f;  // Random Y variation (fine steps so big crowds don't stack)
+    people.personStates[row] = PERSON_CELEBRATING;  // Stop and start celebrating
+}
+
+// If stopped and celebrating, update celebration animation
+void advanceCelebration(Archetype& people, size_t row) {
+    if (people.personStates[row] == PERSON_CELEBRATING) {
+        float& cycle = people.celebrations[row].cycle;
+        cycle += 0.08f * (deltaTime / 0.0167f);  // Celebration animation speed (frame-rate independent)
+        if (cycle > 1.0f) cycle -= 1.0f;
     }
-    peopleInitialized = true;
 }
 
 void updatePeople() {
-    if (!peopleInitialized) {
+    if (!sim.peopleInitialized) {
         initializePeople();
     }
     
-    // Use global deltaTime (calculated in idle() function) instead of hardcoded value
-    
-    for (int i = 0; i < numPeople; ++i) {
-        if (people[i].walkingToCity) {
-            // Walk towards City University (from x=22 to x=-22)
-            people[i].x -= people[i].speed * deltaTime;
-            people[i].walkCycle += 0.1f * (deltaTime / 0.0167f);  // Walking animation speed (frame-rate independent)
-            if (people[i].walkCycle > 1.0f) people[i].walkCycle -= 1.0f;
-            
-            // Check if reached City University
-            if (people[i].x <= -22.0f) {
-                people[i].x = -22.0f;
-                people[i].walkingToCity = false;
-                people[i].walkingToDIU = true;
+    // Everyone steers in parallel; arrivals at DIU are only noted, then given
+    // their spots afterwards in row order so rand() is called in the same
+    // order on any number of threads
+    forEachArchetype(sim.world, ARCH_PERSON, [](Archetype& people) {
+        if (crowdAvoidance) buildSpatialHash(crowdHash, people.positions, 2.0f * crowdRadius);
+        crowdNext.resize(people.size());
+        peopleArrivals.resize((people.size() + jobGrain - 1) / jobGrain);
+        parallelFor(people.size(), [&](size_t first, size_t last) {
+            std::vector<int>& arrivals = peopleArrivals[first / jobGrain];
+            arrivals.clear();
+            for (size_t i = first; i < last; ++i) {
+                Position& next = crowdNext[i];
+                next = steerAgent(people, i);
+                Walker& walker = people.walkers[i];
+                PersonState& state = people.personStates[i];
+                if (state == PERSON_CELEBRATING) {
+                    advanceCelebration(people, i);
+                    continue;
+                }
+                walker.walkCycle += 0.1f * (deltaTime / 0.0167f);  // Walking animation speed (frame-rate independent)
+                if (walker.walkCycle > 1.0f) walker.walkCycle -= 1.0f;
+                if (state == PERSON_TO_CITY && legFinished(state, next)) {
+                    // Reached City University: turn back (with the flow fields,
+                    // in by the door's east leaf and out of the west one)
+                    if (!flowFieldNavigation) next.x = -22.0f;
+                    else next.x = 2.0f * CITY_CENTER_X - next.x;
+                    people.goals[i].x = 22.0f;
+                    state = PERSON_TO_DIU;
+                } else if (state == PERSON_TO_DIU && legFinished(state, next)) {
+                    // Reached DIU
+                    arrivals.push_back(static_cast<int>(i));
+                }
             }
-        } else if (people[i].walkingToDIU) {
-            // Walk back to DIU (from x=-22 to x=22)
-            people[i].x += people[i].speed * deltaTime;
-            people[i].walkCycle += 0.1f * (deltaTime / 0.0167f);  // Frame-rate independent
-            if (people[i].walkCycle > 1.0f) people[i].walkCycle -= 1.0f;
-            
-            // Check if reached DIU area
-            if (people[i].x >= 22.0f) {
-                // Assign random position in front of DIU (spread out)
-                // Random X position between 18.0 and 26.0 (around DIU at x=22)
-                people[i].x = 18.0f + (rand() % 81) * 0.1f;  // Random between 18.0 and 26.0
-                // Random Y position variation
-                people[i].y = 1.8f + 0.3f + (rand() % 8) * 0.1f;  // Random Y variation
-                people[i].walkingToDIU = false;
-                people[i].stopped = true;
-                people[i].celebrating = true;  // Start celebrating
+        });
+        people.positions.swap(crowdNext);
+        for (std::vector<int>& arrivals : peopleArrivals) {
+            for (int i : arrivals) {
+                arriveAtDiu(people, i);
+                advanceCelebration(people, i);
             }
+            arrivals.clear();
         }
-        // If stopped and celebrating, update celebration animation
-        if (people[i].stopped && people[i].celebrating) {
-            people[i].celebrationCycle += 0.08f * (deltaTime / 0.0167f);  // Celebration animation speed (frame-rate independent)
-            if (people[i].celebrationCycle > 1.0f) people[i].celebrationCycle -= 1.0f;
-        }
-    }
+    });
 }
 
 void drawPerson(float x, float y, float walkCycle, const Color& shirtColor, bool isWalking, bool isCelebrating = false, float celebrationCycle = 0.0f) {
-    glPushMatrix();
-    glTranslatef(x, y, 0.0f);
+    pushTransform();
+    translateTransform(x, y);
     
     // Head (circle)
     drawCircle(0.0f, 0.4f, 0.15f, {0.9f, 0.8f, 0.7f}, 10);  // Skin color
@@ -1293,64 +4903,217 @@ void drawPerson(float x, float y, float walkCycle, const Color& shirtColor, bool
     
     // Legs (animated if walking, static if celebrating)
     float legOffset = isWalking ? sinf(walkCycle * 2.0f * 3.14159265358979323846f) * 0.1f : 0.0f;
-    setColor({0.2f, 0.2f, 0.2f});  // Dark pants
-    glLineWidth(2.5f);
-    glBegin(GL_LINES);
-    // Left leg
-    glVertex2f(-0.05f, 0.1f);
-    glVertex2f(-0.05f + legOffset, -0.2f);
-    // Right leg
-    glVertex2f(0.05f, 0.1f);
-    glVertex2f(0.05f - legOffset, -0.2f);
-    glEnd();
+    const Color PANTS = {0.2f, 0.2f, 0.2f};  // Dark pants (arms share the color)
+    float limbs[] = {
+        -0.05f, 0.1f, -0.05f + legOffset, -0.2f,   // Left leg
+        0.05f, 0.1f, 0.05f - legOffset, -0.2f,     // Right leg
+        -0.1f, 0.3f, -0.15f, 0.2f,                 // Left arm
+        0.1f, 0.3f, 0.15f, 0.2f                    // Right arm
+    };
     
-    // Arms - different behavior for walking vs celebrating
+    // Arms - different behavior for walking vs celebrating (standing: arms at sides)
     if (isCelebrating) {
         // Celebration: raise and lower hands (up and down motion)
         // Use sine wave: 0.0 = down, 0.5 = up, 1.0 = down
         float armHeight = sinf(celebrationCycle * 2.0f * 3.14159265358979323846f) * 0.3f;  // Raise up to 0.3 units
         float armY = 0.3f + armHeight;  // Base Y position + raise amount
-        glBegin(GL_LINES);
-        // Left arm (raised up)
-        glVertex2f(-0.1f, 0.3f);
-        glVertex2f(-0.15f, armY);
-        // Right arm (raised up)
-        glVertex2f(0.1f, 0.3f);
-        glVertex2f(0.15f, armY);
-        glEnd();
+        limbs[11] = armY;  // Left arm (raised up)
+        limbs[15] = armY;  // Right arm (raised up)
     } else if (isWalking) {
         // Walking: swinging arms
         float armOffset = sinf(walkCycle * 2.0f * 3.14159265358979323846f) * 0.15f;
-        glBegin(GL_LINES);
-        // Left arm
-        glVertex2f(-0.1f, 0.3f);
-        glVertex2f(-0.15f - armOffset, 0.2f);
-        // Right arm
-        glVertex2f(0.1f, 0.3f);
-        glVertex2f(0.15f + armOffset, 0.2f);
-        glEnd();
-    } else {
-        // Standing: arms at sides
-        glBegin(GL_LINES);
-        // Left arm
-        glVertex2f(-0.1f, 0.3f);
-        glVertex2f(-0.15f, 0.2f);
-        // Right arm
-        glVertex2f(0.1f, 0.3f);
-        glVertex2f(0.15f, 0.2f);
-        glEnd();
+        limbs[10] = -0.15f - armOffset;
+        limbs[14] = 0.15f + armOffset;
     }
-    glLineWidth(1.0f);
+    drawLines(limbs, 4, PANTS, 2.5f);
     
-    glPopMatrix();
+    popTransform();
 }
 
-void drawPeople() {
-    for (int i = 0; i < numPeople; ++i) {
-        bool isWalking = people[i].walkingToCity || people[i].walkingToDIU;
-        bool isCelebrating = people[i].stopped && people[i].celebrating;
-        drawPerson(people[i].x, people[i].y, people[i].walkCycle, people[i].shirtColor, isWalking, isCelebrating, people[i].celebrationCycle);
+// -------------------------------------------------------------
+// Crowd sprite atlas
+// -------------------------------------------------------------
+// Every pose drawPerson() can produce is baked once into a texture: one
+// standing pose, CROWD_POSE_FRAMES walk frames and CROWD_POSE_FRAMES
+// celebration frames per column, one row per shirt color. Each person is
+// then a single textured quad, so a crowd of any size is one draw call.
+// Cells are baked at the window's own pixel scale and quads are snapped to
+// whole pixels, so the sprites sample texel-for-pixel.
+const int CROWD_POSE_FRAMES = 16;
+const int CROWD_POSES = 1 + 2 * CROWD_POSE_FRAMES;  // standing, walk frames, celebration frames
+
+// Person bounds around the feet anchor, with room for line width and raised arms
+const float PERSON_LEFT = 0.4f;
+const float PERSON_BOTTOM = 0.3f;
+const float PERSON_WIDTH = 0.8f;
+const float PERSON_HEIGHT = 1.0f;
+
+struct CrowdAtlas {
+    GLuint fbo;
+    GLuint texture;
+    int cellW, cellH;        // Cell size in pixels
+    int anchorX, anchorY;    // Feet position inside a cell, in pixels
+    int width, height;       // Texture size
+    float unitsPerPixel;     // Scale the cells were baked at
+    bool dirty;
+};
+
+CrowdAtlas crowdAtlas = {};
+bool crowdSpritesEnabled = false;   // Set by initCrowdSprites()
+bool disableCrowdSprites = false;   // --no-crowd-sprites command-line flag
+
+void initCrowdSprites() {
+    if (renderBackend != BACKEND_BATCHED || disableCrowdSprites || !initSpriteRenderer()) return;
+
+    gl33::GenFramebuffers(1, &crowdAtlas.fbo);
+    glGenTextures(1, &crowdAtlas.texture);
+    crowdAtlas.dirty = true;
+    crowdSpritesEnabled = true;
+}
+
+void invalidateCrowdAtlas() {
+    crowdAtlas.dirty = true;
+}
+
+// Atlas column for a person's current pose
+int crowdPose(const Archetype& people, size_t row) {
+    if (people.personStates[row] == PERSON_CELEBRATING) {
+        return 1 + CROWD_POSE_FRAMES + std::min(static_cast<int>(people.celebrations[row].cycle * CROWD_POSE_FRAMES), CROWD_POSE_FRAMES - 1);
+    }
+    return 1 + std::min(static_cast<int>(people.walkers[row].walkCycle * CROWD_POSE_FRAMES), CROWD_POSE_FRAMES - 1);
+}
+
+// Bake every pose and shirt color at the current pixel scale. Returns false
+// if the atlas does not fit in a texture or the framebuffer is unusable.
+bool buildCrowdAtlas() {
+    CrowdAtlas& atlas = crowdAtlas;
+    float upp = unitsPerPixel;
+    atlas.anchorX = static_cast<int>(ceilf(PERSON_LEFT / upp));
+    atlas.anchorY = static_cast<int>(ceilf(PERSON_BOTTOM / upp));
+    atlas.cellW = static_cast<int>(ceilf(PERSON_WIDTH / upp)) + 1;
+    atlas.cellH = static_cast<int>(ceilf(PERSON_HEIGHT / upp)) + 1;
+    atlas.width = atlas.cellW * CROWD_POSES;
+    atlas.height = atlas.cellH * NUM_SHIRT_COLORS;
+    atlas.unitsPerPixel = upp;
+
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    if (atlas.width > maxSize || atlas.height > maxSize) return false;
+
+    glBindTexture(GL_TEXTURE_2D, atlas.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlas.width, atlas.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    flushBatch();  // Pending scene geometry belongs to the current target, not the atlas
+    bool wasRecording = recordingFrame;  // The atlas itself is drawn now, even in split view
+    recordingFrame = false;
+    Transform2D savedTransform = currentTransform;
+    GLint prevFramebuffer = 0;
+    GLint prevViewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, prevViewport);
+
+    gl33::BindFramebuffer(GL_FRAMEBUFFER, atlas.fbo);
+    gl33::FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, atlas.texture, 0);
+    bool complete = gl33::CheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (complete) {
+        // One atlas pixel per window pixel, so line widths and circle LOD match the scene
+        float prevLeft = viewportLeftX, prevRight = viewportRightX, prevTop = viewportTopY;
+        float prevRenderUpp = renderUnitsPerPixel;
+        viewportLeftX = 0.0f;
+        viewportRightX = atlas.width * upp;
+        viewportTopY = atlas.height * upp;
+        renderUnitsPerPixel = upp;
+        glViewport(0, 0, atlas.width, atlas.height);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        for (int shirt = 0; shirt < NUM_SHIRT_COLORS; ++shirt) {
+            for (int pose = 0; pose < CROWD_POSES; ++pose) {
+                bool isWalking = pose >= 1 && pose <= CROWD_POSE_FRAMES;
+                bool isCelebrating = pose > CROWD_POSE_FRAMES;
+                float cycle = isWalking ? (pose - 1) / static_cast<float>(CROWD_POSE_FRAMES)
+                    : isCelebrating ? (pose - 1 - CROWD_POSE_FRAMES) / static_cast<float>(CROWD_POSE_FRAMES) : 0.0f;
+                resetTransform();
+                drawPerson((pose * atlas.cellW + atlas.anchorX) * upp, (shirt * atlas.cellH + atlas.anchorY) * upp,
+                    cycle, SHIRT_COLORS[shirt], isWalking, isCelebrating, cycle);
+            }
+        }
+        flushBatch();
+
+        viewportLeftX = prevLeft;
+        viewportRightX = prevRight;
+        viewportTopY = prevTop;
+        renderUnitsPerPixel = prevRenderUpp;
+        atlas.dirty = false;
+    }
+
+    gl33::BindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(prevFramebuffer));
+    glViewport(prevViewport[0], prevViewport[1], prevViewport[2], prevViewport[3]);
+    currentTransform = savedTransform;
+    recordingFrame = wasRecording;
+    return complete;
+}
+
+// One atlas quad for a person. Only valid under a plain translation, since
+// the cells are baked at the window's pixel scale; consecutive quads share
+// one sprite run.
+void drawPersonSprite(const Archetype& people, size_t row) {
+    const Position& p = people.positions[row];
+    const CrowdAtlas& atlas = crowdAtlas;
+    float upp = atlas.unitsPerPixel;
+    float du = 1.0f / atlas.width, dv = 1.0f / atlas.height;
+
+    float wx, wy;
+    transformPoint(p.x, p.y, wx, wy);
+    // Snap the feet to a pixel corner so texels land exactly on pixels
+    float x1 = viewportLeftX + (roundf((wx - viewportLeftX) / upp) - atlas.anchorX) * upp;
+    float y1 = (roundf(wy / upp) - atlas.anchorY) * upp;
+    float x2 = x1 + atlas.cellW * upp, y2 = y1 + atlas.cellH * upp;
+
+    int pose = crowdPose(people, row);
+    float u1 = pose * atlas.cellW * du, u2 = u1 + atlas.cellW * du;
+    float v1 = people.shirts[row] * atlas.cellH * dv, v2 = v1 + atlas.cellH * dv;
+
+    const SpriteVertex quad[6] = {
+        { x1, y1, u1, v1 }, { x2, y1, u2, v1 }, { x2, y2, u2, v2 },
+        { x1, y1, u1, v1 }, { x2, y2, u2, v2 }, { x1, y2, u1, v2 }
+    };
+    submitSprites(quad, 6, atlas.texture, { 1.0f, 1.0f, 1.0f });
+}
+
+void drawPersonGeometry(const Archetype& people, size_t row) {
+    const Position& p = people.positions[row];
+    bool isCelebrating = people.personStates[row] == PERSON_CELEBRATING;
+    drawPerson(p.x, p.y, people.walkers[row].walkCycle, SHIRT_COLORS[people.shirts[row]], !isCelebrating,
+        isCelebrating, people.celebrations[row].cycle);
+}
+
+// Whether people can be drawn from the atlas under the current transform
+// (rebuilding it first if it is stale)
+bool prepareCrowdSprites() {
+    const Transform2D& m = currentTransform;
+    bool plainTranslation = m.a == 1.0f && m.b == 0.0f && m.c == 0.0f && m.d == 1.0f;
+    if (!crowdSpritesEnabled || !plainTranslation) return false;
+    if (crowdAtlas.dirty && !buildCrowdAtlas()) {
+        crowdSpritesEnabled = false;  // Fall back to drawing each person
+        return false;
     }
+    return true;
+}
+
+void drawPeople() {
+    bool sprites = prepareCrowdSprites();
+    forEachArchetype(view->world, ARCH_PERSON, [&](const Archetype& people) {
+        for (size_t row = 0; row < people.size(); ++row) {
+            if (sprites) drawPersonSprite(people, row);
+            else drawPersonGeometry(people, row);
+        }
+    });
 }
 
 // -------------------------------------------------------------
@@ -1377,6 +5140,8 @@ namespace City {
     const Color BUSH_LIGHT = { 0.14f, 0.82f, 0.27f };
 
     void drawBush(float cx, float cy, float width, float height) {
+        if (submitProp(PROP_CITY_BUSH, cx, cy, width, height, BUSH_LIGHT)) return;
+
         float hw = width * 0.5f;
         float baseH = height * 0.45f;
 
@@ -1384,29 +5149,47 @@ namespace City {
         filledRect(cx - hw, cy, cx + hw, cy + baseH, BUSH_DARK);
 
         // rounded top
-        setColor(BUSH_LIGHT);
-        glBegin(GL_POLYGON);
-        glVertex2f(cx - hw, cy + baseH);
-        glVertex2f(cx - hw * 0.7f, cy + height * 0.9f);
-        glVertex2f(cx, cy + height);
-        glVertex2f(cx + hw * 0.7f, cy + height * 0.9f);
-        glVertex2f(cx + hw, cy + baseH);
-        glEnd();
+        float top[10] = {
+            cx - hw, cy + baseH,
+            cx - hw * 0.7f, cy + height * 0.9f,
+            cx, cy + height,
+            cx + hw * 0.7f, cy + height * 0.9f,
+            cx + hw, cy + baseH
+        };
+        filledPolygon(top, 5, BUSH_LIGHT);
 
         outlinedRect(cx - hw, cy, cx + hw, cy + height, OUTLINE, 2.0f);
     }
 
-    void drawSideBlock(int side) {
-        float x1 = -9.0f;
-        float x2 = -3.0f;
+    void drawWindow(float x1, float y1, float x2, float y2) {
+        if (submitProp(PROP_CITY_WINDOW, x1, y1, x2 - x1, y2 - y1, WINDOW_FILL)) return;
+        framedRect(x1, y1, x2, y2, WINDOW_FILL, WINDOW_BORDER, 2.0f);
+    }
+
+    void sideBlockBounds(int side, float& x1, float& x2) {
+        x1 = -9.0f;
+        x2 = -3.0f;
         if (side > 0) { // right block
             float tx1 = -x2, tx2 = -x1;
             x1 = tx1; x2 = tx2;
         }
+    }
+
+    void drawSideBlock(int side) {
+        float x1, x2;
+        sideBlockBounds(side, x1, x2);
         float y1 = 1.5f;
         float y2 = 9.0f;
 
         framedRect(x1, y1, x2, y2, BUILDING, OUTLINE, 3.0f);
+    }
+
+    // Windows are drawn after both side blocks so they form one prop run
+    void drawSideBlockWindows(int side) {
+        float x1, x2;
+        sideBlockBounds(side, x1, x2);
+        float y1 = 1.5f;
+        float y2 = 9.0f;
 
         const int cols = 3;
         const int rows = 5;
@@ -1423,7 +5206,7 @@ namespace City {
             for (int c = 0; c < cols; ++c) {
                 float wx1 = x1 + marginX + c * (winW + gapX);
                 float wx2 = wx1 + winW;
-                framedRect(wx1, wy1, wx2, wy2, WINDOW_FILL, WINDOW_BORDER, 2.0f);
+                drawWindow(wx1, wy1, wx2, wy2);
             }
         }
     }
@@ -1438,12 +5221,12 @@ namespace City {
         filledRect(x1 - 0.7f, 1.5f, x2 + 0.7f, 2.0f, OUTLINE);
 
         // Dark door region
-        float dX1 = -1.3f, dX2 = 1.3f;
+        float dX1 = -CITY_DOOR_HALF_WIDTH, dX2 = CITY_DOOR_HALF_WIDTH;
         float dY1 = 2.0f, dY2 = 3.2f;
         framedRect(dX1, dY1, dX2, dY2, DOOR_FILL, OUTLINE, 3.0f);
 
-        // Two tall door panels
-        float panelW = 0.9f, panelH = 0.9f;
+        // Two tall door panels, either side of the mullion
+        float panelW = CITY_DOOR_HALF_WIDTH - 0.25f - CITY_DOOR_MULLION_HALF_WIDTH, panelH = 0.9f;
         float px1 = dX1 + 0.25f;
         float px2 = px1 + panelW;
         float py1 = dY1 + 0.4f;
@@ -1457,7 +5240,7 @@ namespace City {
         // Small square panel above door
         float w0x1 = -0.6f, w0x2 = 0.6f;
         float w0y1 = 3.4f, w0y2 = 4.2f;
-        framedRect(w0x1, w0y1, w0x2, w0y2, WINDOW_FILL, WINDOW_BORDER, 2.0f);
+        drawWindow(w0x1, w0y1, w0x2, w0y2);
 
         // Floors above: 4 rows of windows, 2 columns each
         const int rows = 4;
@@ -1476,28 +5259,27 @@ namespace City {
             for (int c = 0; c < cols; ++c) {
                 float wx1 = x1 + marginX + c * (winW + gapX);
                 float wx2 = wx1 + winW;
-                framedRect(wx1, wy1, wx2, wy2, WINDOW_FILL, WINDOW_BORDER, 2.0f);
+                drawWindow(wx1, wy1, wx2, wy2);
             }
         }
 
         // Thin horizontal floor lines
-        setColor(OUTLINE);
-        glLineWidth(1.5f);
-        glBegin(GL_LINES);
+        float floorLines[4 * 4];
+        int numFloorLines = 0;
         for (int i = 1; i <= 4; ++i) {
             float fy = 2.7f + i * 1.5f;
             if (fy < y2 - 0.7f) {
-                glVertex2f(x1 + 0.2f, fy);
-                glVertex2f(x2 - 0.2f, fy);
+                float* l = floorLines + 4 * numFloorLines++;
+                l[0] = x1 + 0.2f; l[1] = fy;
+                l[2] = x2 - 0.2f; l[3] = fy;
             }
         }
-        glEnd();
-        glLineWidth(1.0f);
+        drawLines(floorLines, numFloorLines, OUTLINE, 1.5f);
     }
 
     void drawRoofAndSign() {
         float roofY1 = 9.5f, roofY2 = 10.0f;
-        framedRect(-9.4f, roofY1, 9.4f, roofY2, BUILDING, OUTLINE, 3.0f);
+        framedRect(-CITY_ROOF_HALF_WIDTH, roofY1, CITY_ROOF_HALF_WIDTH, roofY2, BUILDING, OUTLINE, 3.0f);
 
         float pedY1 = 10.0f, pedY2 = 10.35f;
         framedRect(-3.5f, pedY1, 3.5f, pedY2, BUILDING, OUTLINE, 2.0f);
@@ -1510,13 +5292,10 @@ namespace City {
     }
 
     void drawBushes() {
-        drawBush(-8.5f, 1.0f, 2.0f, 1.1f);
-        drawBush(-6.5f, 1.0f, 2.4f, 1.2f);
-        drawBush(6.5f, 1.0f, 2.4f, 1.2f);
-        drawBush(8.5f, 1.0f, 2.0f, 1.1f);
+        for (const BushPlacement& bush : CITY_BUSHES) drawBush(bush.x, bush.y, bush.width, bush.height);
     }
 
-    void drawDestroyedBuilding(float fireTime) {
+    void drawDestroyedBuilding() {
         // Draw partially collapsed building with damage
         // Left side block - partially destroyed
         float x1 = -9.0f;
@@ -1529,14 +5308,12 @@ namespace City {
         framedRect(x1, y1, x2, y2, damagedColor, OUTLINE, 3.0f);
         
         // Cracks on left block
-        setColor({0.2f, 0.2f, 0.2f});
-        glLineWidth(2.0f);
-        glBegin(GL_LINES);
-        glVertex2f(x1 + 1.0f, y1 + 2.0f);
-        glVertex2f(x1 + 2.5f, y1 + 4.0f);
-        glVertex2f(x1 + 3.5f, y1 + 1.5f);
-        glVertex2f(x1 + 4.5f, y1 + 3.5f);
-        glEnd();
+        const Color CRACK = {0.2f, 0.2f, 0.2f};
+        float leftCracks[] = {
+            x1 + 1.0f, y1 + 2.0f, x1 + 2.5f, y1 + 4.0f,
+            x1 + 3.5f, y1 + 1.5f, x1 + 4.5f, y1 + 3.5f
+        };
+        drawLines(leftCracks, 2, CRACK, 2.0f);
         
         // Right side block - partially destroyed
         x1 = 3.0f;
@@ -1546,13 +5323,11 @@ namespace City {
         framedRect(x1, y1, x2, y2, damagedColor, OUTLINE, 3.0f);
         
         // Cracks on right block
-        glBegin(GL_LINES);
-        glVertex2f(x1 + 1.0f, y1 + 2.5f);
-        glVertex2f(x1 + 2.0f, y1 + 4.5f);
-        glVertex2f(x1 + 4.0f, y1 + 1.8f);
-        glVertex2f(x1 + 5.5f, y1 + 3.8f);
-        glEnd();
-        glLineWidth(1.0f);
+        float rightCracks[] = {
+            x1 + 1.0f, y1 + 2.5f, x1 + 2.0f, y1 + 4.5f,
+            x1 + 4.0f, y1 + 1.8f, x1 + 5.5f, y1 + 3.8f
+        };
+        drawLines(rightCracks, 2, CRACK, 2.0f);
         
         // Center block - heavily damaged
         x1 = -3.0f;
@@ -1563,8 +5338,27 @@ namespace City {
         
         // Collapsed roof section
         float collapsedY = 8.5f;
-        filledRect(-2.0f, collapsedY, 2.0f, collapsedY + 0.3f, {0.4f, 0.3f, 0.2f});
-        
+        const Color RUBBLE = {0.4f, 0.3f, 0.2f};
+        filledRect(-2.0f, collapsedY, 2.0f, collapsedY + 0.3f, RUBBLE);
+
+        // Rubble heaped at the foot of the side blocks
+        for (const RubbleHeap& heap : CITY_RUBBLE) {
+            float w = heap.x2 - heap.x1;
+            float pile[10] = {
+                heap.x1, y1,
+                heap.x1 + w * 0.15f, y1 + 0.35f,
+                heap.x1 + w * 0.5f, y1 + 0.5f,
+                heap.x1 + w * 0.85f, y1 + 0.3f,
+                heap.x2, y1
+            };
+            filledPolygon(pile, 5, RUBBLE);
+        }
+    }
+
+    // Fire over the ruins (the smoke is particles); animated, so kept out of the cached campus layer
+    void drawBuildingFire(float fireTime) {
+        float collapsedY = 8.5f;
+
         // Fire on windows
         float windowFireY = 4.0f;
         drawFire(-6.0f, windowFireY, 0.8f, 1.2f, fireTime);
@@ -1574,38 +5368,35 @@ namespace City {
         
         // Fire on roof
         drawFire(0.0f, collapsedY, 1.2f, 1.5f, fireTime);
-        
-        // Smoke rising from building
-        drawSmoke(-5.0f, collapsedY, fireTime * 0.5f, 0.4f);
-        drawSmoke(0.0f, collapsedY, fireTime * 0.5f + 0.3f, 0.5f);
-        drawSmoke(5.0f, collapsedY, fireTime * 0.5f + 0.6f, 0.4f);
     }
 
     void drawScene() {
         // Ground under city
         filledRect(-11.0f, 0.0f, 11.0f, 1.5f, GROUND);
-        setColor(GROUND_EDGE);
-        glLineWidth(3.0f);
-        glBegin(GL_LINES);
-        glVertex2f(-11.0f, 1.5f);
-        glVertex2f(11.0f, 1.5f);
-        glEnd();
-        glLineWidth(1.0f);
+        drawLine(-11.0f, 1.5f, 11.0f, 1.5f, GROUND_EDGE, 3.0f);
 
         // Building - check if destroyed
-        if (!cityBuildingDestroyed) {
+        if (!view->cityBuildingDestroyed) {
             // Draw normal building
         drawSideBlock(-1);
         drawSideBlock(1);
+        drawSideBlockWindows(-1);
+        drawSideBlockWindows(1);
         drawCenterBlock();
         drawRoofAndSign();
         } else {
-            // Draw destroyed building with fire
-            drawDestroyedBuilding(explosionTime);
+            // Draw destroyed building (fire is drawn by drawEffects)
+            drawDestroyedBuilding();
         }
         
         drawBushes();
     }
+
+    void drawEffects() {
+        if (view->cityBuildingDestroyed) {
+            drawBuildingFire(view->explosionTime);
+        }
+    }
 } // namespace City
 
 // -------------------------------------------------------------
@@ -1631,23 +5422,30 @@ namespace Diu {
     const Color SIGN_TEXT = { 1.00f, 1.00f, 1.00f };
 
     void drawBush(float cx, float cy, float width, float height) {
+        if (submitProp(PROP_DIU_BUSH, cx, cy, width, height, BUSH_LIGHT)) return;
+
         float hw = width * 0.5f;
         float baseH = height * 0.45f;
 
         filledRect(cx - hw, cy, cx + hw, cy + baseH, BUSH_DARK);
 
-        setColor(BUSH_LIGHT);
-        glBegin(GL_POLYGON);
-        glVertex2f(cx - hw, cy + baseH);
-        glVertex2f(cx - hw * 0.75f, cy + height * 0.9f);
-        glVertex2f(cx, cy + height);
-        glVertex2f(cx + hw * 0.75f, cy + height * 0.9f);
-        glVertex2f(cx + hw, cy + baseH);
-        glEnd();
+        float top[10] = {
+            cx - hw, cy + baseH,
+            cx - hw * 0.75f, cy + height * 0.9f,
+            cx, cy + height,
+            cx + hw * 0.75f, cy + height * 0.9f,
+            cx + hw, cy + baseH
+        };
+        filledPolygon(top, 5, BUSH_LIGHT);
 
         outlineRect(cx - hw, cy, cx + hw, cy + height, OUTLINE, 1.5f);
     }
 
+    void drawWindow(float x1, float y1, float x2, float y2) {
+        if (submitProp(PROP_DIU_WINDOW, x1, y1, x2 - x1, y2 - y1, WIN_BLUE)) return;
+        framedRect(x1, y1, x2, y2, WIN_BLUE, OUTLINE, 1.3f);
+    }
+
     void drawWindowGrid(float x1, float y1, float x2, float y2,
         int rows, int cols, float marginX, float marginY) {
         float cellW = (x2 - x1 - 2 * marginX) / cols;
@@ -1659,7 +5457,7 @@ namespace Diu {
                 float wx2 = wx1 + cellW * 0.7f;
                 float wy1 = y1 + marginY + r * cellH + cellH * 0.15f;
                 float wy2 = wy1 + cellH * 0.7f;
-                framedRect(wx1, wy1, wx2, wy2, WIN_BLUE, OUTLINE, 1.3f);
+                drawWindow(wx1, wy1, wx2, wy2);
             }
         }
     }
@@ -1668,12 +5466,21 @@ namespace Diu {
         float wingBottom = 2.0f;
         float wingTop = 14.0f;
 
-        float x1 = leftSide ? -12.0f : 6.0f;
-        float x2 = leftSide ? -6.0f : 12.0f;
+        float x1 = leftSide ? -DIU_WING_HALF_WIDTH : 6.0f;
+        float x2 = leftSide ? -6.0f : DIU_WING_HALF_WIDTH;
 
         framedRect(x1, wingBottom, x2, wingTop, WALL, OUTLINE, 2.5f);
 
         filledRect(x1, wingBottom, x2, wingBottom + 0.25f, WALL_DARK);
+    }
+
+    // Windows are drawn after both wings so they form one prop run
+    void drawSideWingWindows(bool leftSide) {
+        float wingBottom = 2.0f;
+        float wingTop = 14.0f;
+
+        float x1 = leftSide ? -DIU_WING_HALF_WIDTH : 6.0f;
+        float x2 = leftSide ? -6.0f : DIU_WING_HALF_WIDTH;
 
         drawWindowGrid(x1, wingBottom, x2, wingTop, 10, 3, 0.7f, 0.5f);
     }
@@ -1689,17 +5496,12 @@ namespace Diu {
         framedRect(left, bottom + 0.4f, right, top - 0.6f, WIN_BLUE, OUTLINE, 2.5f);
 
         // vertical highlights
-        setColor({ 0.70f, 0.86f, 1.0f });
-        glLineWidth(2.0f);
-        glBegin(GL_LINES);
-        glVertex2f(left + (right - left) * 0.22f, bottom + 0.6f);
-        glVertex2f(left + (right - left) * 0.22f, top - 0.8f);
-        glVertex2f(left + (right - left) * 0.50f, bottom + 0.6f);
-        glVertex2f(left + (right - left) * 0.50f, top - 0.8f);
-        glVertex2f(left + (right - left) * 0.78f, bottom + 0.6f);
-        glVertex2f(left + (right - left) * 0.78f, top - 0.8f);
-        glEnd();
-        glLineWidth(1.0f);
+        float highlights[] = {
+            left + (right - left) * 0.22f, bottom + 0.6f, left + (right - left) * 0.22f, top - 0.8f,
+            left + (right - left) * 0.50f, bottom + 0.6f, left + (right - left) * 0.50f, top - 0.8f,
+            left + (right - left) * 0.78f, bottom + 0.6f, left + (right - left) * 0.78f, top - 0.8f
+        };
+        drawLines(highlights, 3, { 0.70f, 0.86f, 1.0f }, 2.0f);
 
         // beige floor bands
         for (int i = 0; i < 6; ++i) {
@@ -1715,54 +5517,675 @@ namespace Diu {
         // entrance + doors
         float doorBaseY = 2.0f;
         framedRect(-2.0f, doorBaseY, 2.0f, bottom + 0.6f, WALL, OUTLINE, 2.0f);
-        framedRect(-1.1f, doorBaseY + 0.5f, -0.1f, bottom + 0.45f, WIN_BLUE, OUTLINE, 1.5f);
-        framedRect(0.1f, doorBaseY + 0.5f, 1.1f, bottom + 0.45f, WIN_BLUE, OUTLINE, 1.5f);
+        framedRect(-DIU_DOOR_HALF_WIDTH, doorBaseY + 0.5f, -0.1f, bottom + 0.45f, WIN_BLUE, OUTLINE, 1.5f);
+        framedRect(0.1f, doorBaseY + 0.5f, DIU_DOOR_HALF_WIDTH, bottom + 0.45f, WIN_BLUE, OUTLINE, 1.5f);
 
         // step + path
-        filledRect(-2.4f, 1.7f, 2.4f, 2.0f, PATH_COLOR);
-        outlineRect(-2.4f, 1.7f, 2.4f, 2.0f, OUTLINE, 1.5f);
+        filledRect(-DIU_STEP_HALF_WIDTH, DIU_STEP_Y1, DIU_STEP_HALF_WIDTH, DIU_STEP_Y2, PATH_COLOR);
+        outlineRect(-DIU_STEP_HALF_WIDTH, DIU_STEP_Y1, DIU_STEP_HALF_WIDTH, DIU_STEP_Y2, OUTLINE, 1.5f);
         filledRect(-1.3f, 1.0f, 1.3f, 1.7f, PATH_COLOR);
         outlineRect(-1.3f, 1.0f, 1.3f, 1.7f, OUTLINE, 1.5f);
 
-        // roof
-        float roofY1 = top + 0.2f, roofY2 = top + 0.8f;
-        framedRect(-8.0f, roofY1, 8.0f, roofY2, ROOF, OUTLINE, 2.5f);
+        // roof
+        float roofY1 = top + 0.2f, roofY2 = top + 0.8f;
+        framedRect(-8.0f, roofY1, 8.0f, roofY2, ROOF, OUTLINE, 2.5f);
+
+        // sign pedestal
+        float pedY1 = roofY2, pedY2 = roofY2 + 0.6f;
+        framedRect(-7.0f, pedY1, 7.0f, pedY2, ROOF, OUTLINE, 2.0f);
+
+        // sign board
+        float signY1 = pedY2, signY2 = pedY2 + 0.9f;
+        framedRect(-6.5f, signY1, 6.5f, signY2, SIGN_BG, OUTLINE, 2.0f);
+
+        // text
+        setColor(SIGN_TEXT);
+        drawCenteredText("Daffodil International University",
+            0.0f, signY1 + 0.25f, 0.22f, GLUT_BITMAP_HELVETICA_18);
+    }
+
+    void drawGround() {
+        filledRect(-13.5f, 0.0f, 13.5f, 2.0f, GROUND);
+        filledRect(-11.5f, 2.0f, 11.5f, 2.6f, GROUND_DARK);
+
+        for (const BushPlacement& bush : DIU_BUSHES) drawBush(bush.x, bush.y, bush.width, bush.height);
+    }
+
+    void drawScene() {
+        drawGround();
+        drawSideWing(true);
+        drawSideWing(false);
+        drawSideWingWindows(true);
+        drawSideWingWindows(false);
+        drawCenterBlock();
+    }
+} // namespace Diu
+
+// -------------------------------------------------------------
+// Prop meshes (same shapes as the direct-drawing fallbacks above)
+// -------------------------------------------------------------
+void initPropInstancing() {
+    if (renderBackend != BACKEND_BATCHED || disablePropInstancing) return;
+    propMeshVertices.clear();
+
+    // Windows: unit square, fill takes the instance color
+    beginPropMesh(PROP_CITY_WINDOW);
+    propQuad(0.0f, 0.0f, 1.0f, 1.0f, City::WINDOW_FILL, 1.0f);
+    propFrame(0.0f, 0.0f, 1.0f, 1.0f, City::WINDOW_BORDER, 2.0f);
+    endPropMesh();
+
+    beginPropMesh(PROP_DIU_WINDOW);
+    propQuad(0.0f, 0.0f, 1.0f, 1.0f, Diu::WIN_BLUE, 1.0f);
+    propFrame(0.0f, 0.0f, 1.0f, 1.0f, Diu::OUTLINE, 1.3f);
+    endPropMesh();
+
+    // Bushes: unit width and height, origin at bottom center, top takes the instance color
+    const float cityBushTop[10] = { -0.5f, 0.45f, -0.35f, 0.9f, 0.0f, 1.0f, 0.35f, 0.9f, 0.5f, 0.45f };
+    beginPropMesh(PROP_CITY_BUSH);
+    propQuad(-0.5f, 0.0f, 0.5f, 0.45f, City::BUSH_DARK);
+    propPolygon(cityBushTop, 5, City::BUSH_LIGHT, 1.0f);
+    propFrame(-0.5f, 0.0f, 0.5f, 1.0f, City::OUTLINE, 2.0f);
+    endPropMesh();
+
+    const float diuBushTop[10] = { -0.5f, 0.45f, -0.375f, 0.9f, 0.0f, 1.0f, 0.375f, 0.9f, 0.5f, 0.45f };
+    beginPropMesh(PROP_DIU_BUSH);
+    propQuad(-0.5f, 0.0f, 0.5f, 0.45f, Diu::BUSH_DARK);
+    propPolygon(diuBushTop, 5, Diu::BUSH_LIGHT, 1.0f);
+    propFrame(-0.5f, 0.0f, 0.5f, 1.0f, Diu::OUTLINE, 1.5f);
+    endPropMesh();
+
+    // Tree at scale 1, leaves take the instance color
+    beginPropMesh(PROP_TREE);
+    propQuad(-0.15f, 0.0f, 0.15f, 1.2f, TREE_TRUNK);
+    propCircle(0.0f, 1.5f, 0.8f, TREE_LEAVES, 1.0f, tess::table<20>());
+    propCircle(-0.3f, 1.3f, 0.6f, TREE_LEAVES, 1.0f, tess::table<15>());
+    propCircle(0.3f, 1.3f, 0.6f, TREE_LEAVES, 1.0f, tess::table<15>());
+    endPropMesh();
+
+    // Street light, glow takes the instance color
+    beginPropMesh(PROP_STREET_LIGHT);
+    propQuad(-0.08f, 0.0f, 0.08f, 2.5f, STREET_LIGHT_POLE);
+    propQuad(-0.3f, 2.5f, 0.3f, 2.7f, STREET_LIGHT_POLE);
+    propCircle(0.0f, 2.6f, 0.4f, STREET_LIGHT_GLOW, 1.0f, tess::table<20>());
+    propCircle(0.0f, 2.6f, 0.2f, {1.0f, 1.0f, 0.9f}, 0.0f, tess::table<15>());
+    endPropMesh();
+
+    // Rocket pointing along +x, centred on its body (see drawRocket())
+    const Color black = { 0.0f, 0.0f, 0.0f };
+    const float fins[3][6] = {
+        { -1.0f, 0.4f, -1.3f, 0.55f, -1.09f, 0.4f },    // top
+        { -1.0f, -0.4f, -1.3f, -0.55f, -1.09f, -0.4f }, // bottom
+        { -1.0f, 0.0f, -1.3f, -0.09f, -1.3f, 0.09f }    // centre, pointing backward
+    };
+    beginPropMesh(PROP_ROCKET);
+    propQuad(-1.0f, -0.4f, 1.0f, 0.4f, ROCKET_BODY);
+    propFrame(-1.0f, -0.4f, 1.0f, 0.4f, black, 1.5f);
+    const float nose[6] = { 1.4f, 0.0f, 1.0f, -0.4f, 1.0f, 0.4f };
+    propPolygon(nose, 3, ROCKET_NOSE);
+    propTriangleOutline(nose[0], nose[1], nose[2], nose[3], nose[4], nose[5], black, 1.5f);
+    for (const float* f : fins) propPolygon(f, 3, ROCKET_FIN);
+    for (const float* f : fins) propTriangleOutline(f[0], f[1], f[2], f[3], f[4], f[5], black, 1.0f);
+    propCircle(-1.3f, 0.0f, 0.4f, FLAME_ORANGE, 0.0f, tess::table<20>());
+    propCircle(-1.3f, 0.0f, 0.25f, FLAME_YELLOW, 0.0f, tess::table<20>());
+    propCircle(-1.3f, 0.0f, 0.15f, {1.0f, 1.0f, 0.5f}, 0.0f, tess::table<15>());
+    endPropMesh();
+
+    // Debris and exhaust squares, and smoke puffs: unit half-size, instance color
+    beginPropMesh(PROP_PARTICLE);
+    propQuad(-1.0f, -1.0f, 1.0f, 1.0f, DEBRIS_COLOR, 1.0f);
+    endPropMesh();
+
+    beginPropMesh(PROP_SMOKE_PUFF);
+    propCircle(0.0f, 0.0f, 1.0f, SMOKE_DARK, 1.0f, tess::table<12>());
+    endPropMesh();
+
+    propInstancingEnabled = initPropRenderer();
+}
+
+// -------------------------------------------------------------
+// Global display / reshape / main
+// -------------------------------------------------------------
+// Static sky: ground fill and moon over a transparent background (cached in LAYER_SKY)
+void drawSkyLayer() {
+    // Full green ground at the bottom - covering entire bottom area
+    const Color GREEN_GROUND = {0.26f, 0.66f, 0.35f};
+    filledRect(-40.0f, 0.0f, 40.0f, 5.0f, GREEN_GROUND);  // Green ground covering full bottom area
+
+    drawMoon();
+}
+
+// Static campus: road, trees, lights and both universities (cached in LAYER_CAMPUS)
+void drawCampusLayer() {
+    // Draw road and environment elements
+    drawRoad();
+    drawTrees();
+    drawStreetLights();
+
+    // LEFT: City University, shifted left
+    pushTransform();
+    translateTransform(CITY_CENTER_X, 0.0f);
+    City::drawScene();
+    popTransform();
+
+    // RIGHT: DIU, shifted right
+    pushTransform();
+    translateTransform(DIU_CENTER_X, 0.0f);
+    Diu::drawScene();
+    popTransform();
+}
+
+// -------------------------------------------------------------
+// Render queue
+// -------------------------------------------------------------
+// Moving entities are submitted each frame with a sort key of layer, then
+// material (which renderer state the draw needs), then depth by Y, and drawn
+// in key order. Same-material draws within a layer end up adjacent, so the
+// batch, effect and sprite runs merge them; within a material, things further
+// up the road (higher Y) draw first so nearer ones overlap them.
+enum DrawLayer { DRAW_RUINS, DRAW_AIRCRAFT, DRAW_FLAGS, DRAW_CROWD, DRAW_BLAST, DRAW_FIREWORKS, DRAW_OVERLAY };
+enum DrawMaterial { MAT_EFFECT, MAT_GEOMETRY, MAT_SPRITE, MAT_TEXT };
+
+struct DrawItem {
+    uint64_t key;
+    void (*draw)(const DrawItem& item);
+    int index;           // Entity slot (or other index) for the draw function
+    float x, y, angle;   // Placement for the draw function
+    int part;            // Which slice of the entity, for ones drawn in pieces
+};
+
+std::vector<DrawItem> drawQueue;
+
+uint64_t drawSortKey(DrawLayer layer, DrawMaterial material, float y) {
+    uint32_t bits;
+    std::memcpy(&bits, &y, sizeof(bits));
+    bits = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);  // Unsigned order now matches float order
+    uint32_t depth = ~bits;                                       // Higher Y sorts first
+    return (static_cast<uint64_t>(layer) << 56) | (static_cast<uint64_t>(material) << 48) |
+        (static_cast<uint64_t>(depth) << 16);
+}
+
+void submitDraw(DrawLayer layer, DrawMaterial material, void (*draw)(const DrawItem&),
+    float x, float y, float angle = 0.0f, int index = 0, int part = 0) {
+    drawQueue.push_back({ drawSortKey(layer, material, y), draw, index, x, y, angle, part });
+}
+
+// The archetype and row holding a draw item's entity (index = entity slot) in the drawn state
+const Archetype& drawnEntity(const DrawItem& item, size_t& row) {
+    const EntitySlot& slot = view->world.slots[item.index];
+    row = slot.row;
+    return view->world.archetypes[slot.archetype];
+}
+
+// With the batched or software backend the sorted queue is recorded in
+// parallel: each layer is cut into chunks of consecutive items, the job
+// system records each chunk into that chunk's own draw list, and the GL
+// thread then submits the lists in queue order, so the result is the same as
+// drawing the items one by one. DRAW_OVERLAY stays on the GL thread, since
+// text can fall back to GLUT calls and shares the string layout caches.
+const size_t MIN_DRAW_CHUNK = 256;   // Items; smaller layers are not worth splitting
+
+struct DrawChunk {
+    size_t first, last;              // Queue items [first, last)
+    bool onGLThread;
+};
+
+std::vector<DrawChunk> drawChunks;
+std::vector<DrawList> drawChunkLists;  // One per chunk, reused frame to frame
+
+void recordDrawChunk(size_t i) {
+    const DrawChunk& chunk = drawChunks[i];
+    if (chunk.onGLThread) return;
+    activeDrawList = &drawChunkLists[i];
+    resetTransform();
+    for (size_t k = chunk.first; k < chunk.last; ++k) drawQueue[k].draw(drawQueue[k]);
+    activeDrawList = &mainDrawList;
+}
+
+// Split the sorted queue into chunks; returns whether any can go to a worker
+bool planDrawChunks() {
+    drawChunks.clear();
+    const size_t threads = jobDeques.size();
+    bool parallel = false;
+    for (size_t first = 0; first < drawQueue.size(); ) {
+        const uint64_t layer = drawQueue[first].key >> 56;
+        size_t last = first;
+        while (last < drawQueue.size() && (drawQueue[last].key >> 56) == layer) ++last;
+
+        if (layer == DRAW_OVERLAY) {
+            drawChunks.push_back({ first, last, true });
+        } else {
+            size_t count = last - first;
+            size_t pieces = std::max<size_t>(1, std::min(threads, count / MIN_DRAW_CHUNK));
+            for (size_t p = 0; p < pieces; ++p) {
+                drawChunks.push_back({ first + count * p / pieces, first + count * (p + 1) / pieces, false });
+            }
+            parallel = true;
+        }
+        first = last;
+    }
+    if (drawChunkLists.size() < drawChunks.size()) drawChunkLists.resize(drawChunks.size());
+    return parallel;
+}
+
+// Sort and draw everything submitted this frame (ties keep submission order)
+void flushDrawQueue() {
+    std::stable_sort(drawQueue.begin(), drawQueue.end(),
+        [](const DrawItem& a, const DrawItem& b) { return a.key < b.key; });
+    if (renderBackend == BACKEND_IMMEDIATE || jobWorkers.empty() || !planDrawChunks()) {  // Every draw is a GL call with --immediate
+        for (const DrawItem& item : drawQueue) item.draw(item);
+        drawQueue.clear();
+        return;
+    }
+
+    const Color color = currentColor;
+    parallelFor(drawChunks.size(), [](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) recordDrawChunk(i);
+    }, 1);
+    currentColor = color;
+
+    for (size_t i = 0; i < drawChunks.size(); ++i) {
+        const DrawChunk& chunk = drawChunks[i];
+        if (chunk.onGLThread) {
+            for (size_t k = chunk.first; k < chunk.last; ++k) drawQueue[k].draw(drawQueue[k]);
+        } else {
+            flushBatch();  // Anything the GL thread recorded before this chunk goes first
+            submitDrawList(drawChunkLists[i]);
+        }
+    }
+    drawQueue.clear();
+}
+
+// Chunks of a pool as draw items, so the job system can share out a big burst
+void submitParticleDraws(const ParticlePool& pool, DrawLayer layer, DrawMaterial material,
+    void (*draw)(const DrawItem&), float x, float y) {
+    for (size_t first = 0; first < pool.count(); first += PARTICLE_DRAW_CHUNK) {
+        submitDraw(layer, material, draw, x, y, 0.0f, static_cast<int>(first));
+    }
+}
+
+void drawRuinsItem(const DrawItem&) {
+    pushTransform();
+    translateTransform(CITY_CENTER_X, 0.0f);
+    City::drawEffects();
+    popTransform();
+}
+
+void drawMissilesItem(const DrawItem& item) { drawMissileChunk(item.index); }
+void drawDroneItem(const DrawItem& item) { drawDrone(item.x, item.y); }
+void drawFlagsItem(const DrawItem&) { drawFlags(); }
+void drawPersonItem(const DrawItem& item) {
+    size_t row;
+    const Archetype& people = drawnEntity(item, row);
+    drawPersonGeometry(people, row);
+}
+
+void drawPersonSpriteItem(const DrawItem& item) {
+    size_t row;
+    const Archetype& people = drawnEntity(item, row);
+    drawPersonSprite(people, row);
+}
+void drawExplosionItem(const DrawItem& item) { drawExplosion(item.x, item.y, view->explosionTime); }
+void drawDebrisItem(const DrawItem& item) { drawDebris(item.index); }
+void drawSmokeItem(const DrawItem& item) { drawSmokePuffs(item.index); }
+void drawExhaustItem(const DrawItem& item) { drawExhaust(item.index); }
+
+void drawFirecrackerItem(const DrawItem& item) {
+    size_t row;
+    const Archetype& shells = drawnEntity(item, row);
+    drawFirecracker(item.x, item.y, shells.bursts[row].color);
+}
+
+void drawFirecrackerBurstItem(const DrawItem& item) {  // part: spark chunk
+    size_t row;
+    const Archetype& shells = drawnEntity(item, row);
+    drawFireworkSparks(item.x, item.y, shells.bursts[row], item.part * SPARK_DRAW_CHUNK);
+}
+
+void drawVictoryBannerItem(const DrawItem& item) {
+    setColor(FIRECRACKER_YELLOW);  // Bright yellow/gold color
+    drawLargeStrokeText("Happy Victory Day DIU", item.x, item.y, 0.035f, 1.5f);  // Thinner line width
+}
+
+// Place the drawn salvo at the frame's clock, a draw item per chunk (sorted by its first missile)
+void submitMissileDraws() {
+    evaluateMissiles(view->missiles, view->missileClock, drawnMissilePaths);
+    for (size_t first = 0; first < drawnMissilePaths.x.size(); first += MISSILE_DRAW_CHUNK) {
+        submitDraw(DRAW_AIRCRAFT, MAT_GEOMETRY, drawMissilesItem, drawnMissilePaths.x[first],
+            drawnMissilePaths.y[first], 0.0f, static_cast<int>(first));
+    }
+}
+
+// Live stats overlay (--hud): last frame's GPU work and a smoothed frame rate
+bool showStatsHud = false;
+RenderStats lastFrameStats = { 0, 0 };
+float hudFps = 0.0f;
+
+void drawStatsHud() {
+    if (frameSeconds > 0.0) {
+        float fps = static_cast<float>(1.0 / frameSeconds);
+        hudFps = (hudFps > 0.0f) ? hudFps * 0.95f + fps * 0.05f : fps;
+    }
+    std::ostringstream line1, line2;
+    line1 << std::fixed << std::setprecision(1) << "FPS " << hudFps;
+    line2 << "draw calls " << lastFrameStats.drawCalls << "   vertices " << lastFrameStats.vertices
+          << "   " << (renderBackend == BACKEND_BATCHED ? "batched" : renderBackend == BACKEND_SOFTWARE ? "software" : "immediate");
+    if (dynamicResolution) {
+        line1 << "   scale " << std::setprecision(2) << resolutionScale << " (" << sceneW << "x" << sceneH
+              << ", scene " << std::setprecision(1) << sceneGpuMsAverage << " ms)";
+    }
+
+    resetTransform();
+    setColor({1.0f, 1.0f, 1.0f});
+    float x = viewportLeftX + 10.0f * unitsPerPixel;
+    drawText(line1.str(), x, viewportTopY - 20.0f * unitsPerPixel, GLUT_BITMAP_HELVETICA_12);
+    drawText(line2.str(), x, viewportTopY - 36.0f * unitsPerPixel, GLUT_BITMAP_HELVETICA_12);
+}
+
+// -------------------------------------------------------------
+// Split view
+// -------------------------------------------------------------
+// --split-view shows three live cameras at once: the wide shot across the top
+// and close-ups of City University's roof and the DIU launch point below.
+// The frame is recorded once (see Draw lists); each recorded step is then
+// uploaded once and drawn through every camera in turn, so tessellation and
+// uploads don't grow with the number of views. Geometry is built at the wide
+// shot's pixel scale, so in a close-up line widths and sprites grow with the
+// zoom like everything else, while circle LOD is picked for the closest
+// camera so curves stay smooth there.
+struct SplitCamera {
+    float centerX, centerY;   // World point at the middle of a close-up
+    float halfHeight;         // World half-height of a close-up (0 = wide shot, framed like reshape())
+    float x0, y0, x1, y1;     // Part of the render target, as fractions
+};
+
+const SplitCamera SPLIT_CAMERAS[] = {
+    { 0.0f, 0.0f, 0.0f, 0.0f, 0.45f, 1.0f, 1.0f },       // Wide shot
+    { -22.0f, 10.9f, 3.5f, 0.0f, 0.0f, 0.5f, 0.45f },    // City University roof
+    { 22.0f, 16.8f, 3.5f, 0.5f, 0.0f, 1.0f, 0.45f },     // DIU launch point
+};
+const int NUM_SPLIT_CAMERAS = sizeof(SPLIT_CAMERAS) / sizeof(SPLIT_CAMERAS[0]);
+const int SPLIT_GAP = 2;                          // Border between views, in pixels
+const Color SPLIT_BORDER = { 0.25f, 0.25f, 0.28f };
+
+struct SplitView {
+    GLint x, y, w, h;                 // Pixels of the render target
+    float left, right, bottom, top;   // World window
+};
+
+bool splitView = false;               // --split-view
+SplitView splitViews[NUM_SPLIT_CAMERAS];
+float splitSavedUnitsPerPixel = 0.0f; // renderUnitsPerPixel outside the split-view frame
+float splitSavedViewport[4];          // Window's world window outside the split-view frame
+
+// All of x [-40, 40], y [0, 20], widened or heightened to fill the aspect ratio
+void fitWorldWindow(float aspect, float& halfW, float& topY) {
+    const float worldW = 80.0f, worldH = 20.0f;
+    if (aspect >= worldW / worldH) {
+        halfW = 0.5f * worldH * aspect;
+        topY = worldH;
+    } else {
+        halfW = 0.5f * worldW;
+        topY = worldW / aspect;
+    }
+}
+
+// Lay the cameras out over the current viewport and start recording the frame
+void beginSplitViewFrame() {
+    GLint target[4];
+    glGetIntegerv(GL_VIEWPORT, target);
+    float finestUnitsPerPixel = unitsPerPixel;
+    for (int i = 0; i < NUM_SPLIT_CAMERAS; ++i) {
+        const SplitCamera& camera = SPLIT_CAMERAS[i];
+        SplitView& view = splitViews[i];
+        view.x = target[0] + static_cast<GLint>(camera.x0 * target[2]) + (camera.x0 > 0.0f ? SPLIT_GAP / 2 : 0);
+        view.y = target[1] + static_cast<GLint>(camera.y0 * target[3]) + (camera.y0 > 0.0f ? SPLIT_GAP / 2 : 0);
+        view.w = std::max(1, target[0] + static_cast<GLint>(camera.x1 * target[2]) - (camera.x1 < 1.0f ? SPLIT_GAP / 2 : 0) - view.x);
+        view.h = std::max(1, target[1] + static_cast<GLint>(camera.y1 * target[3]) - (camera.y1 < 1.0f ? SPLIT_GAP / 2 : 0) - view.y);
+
+        float aspect = static_cast<float>(view.w) / static_cast<float>(view.h);
+        if (camera.halfHeight <= 0.0f) {
+            float halfW, topY;
+            fitWorldWindow(aspect, halfW, topY);
+            view.left = -halfW; view.right = halfW;
+            view.bottom = 0.0f; view.top = topY;
+        } else {
+            float halfW = camera.halfHeight * aspect;
+            view.left = camera.centerX - halfW; view.right = camera.centerX + halfW;
+            view.bottom = camera.centerY - camera.halfHeight; view.top = camera.centerY + camera.halfHeight;
+        }
+        finestUnitsPerPixel = std::min(finestUnitsPerPixel, (view.right - view.left) / view.w);
+    }
+    splitSavedUnitsPerPixel = renderUnitsPerPixel;
+    renderUnitsPerPixel = finestUnitsPerPixel;
+
+    // Record in the wide shot's world window: the sky (moon, stars, clouds,
+    // countdown, banner) is placed from viewportTopY, and the close-ups all
+    // lie inside the wide shot anyway
+    const SplitView& wide = splitViews[0];
+    splitSavedViewport[0] = viewportLeftX;
+    splitSavedViewport[1] = viewportRightX;
+    splitSavedViewport[2] = viewportBottomY;
+    splitSavedViewport[3] = viewportTopY;
+    viewportLeftX = wide.left;
+    viewportRightX = wide.right;
+    viewportBottomY = wide.bottom;
+    viewportTopY = wide.top;
+    recordingFrame = true;
+}
+
+// Draw the recorded frame through every camera
+void drawSplitViewFrame() {
+    flushBatch();
+    recordingFrame = false;
+
+    GLint target[4];
+    glGetIntegerv(GL_VIEWPORT, target);
+    auto useView = [](const SplitView& view) {
+        glViewport(view.x, view.y, view.w, view.h);
+        glScissor(view.x, view.y, view.w, view.h);
+        viewportLeftX = view.left;
+        viewportRightX = view.right;
+        viewportBottomY = view.bottom;
+        viewportTopY = view.top;
+        renderUnitsPerPixel = (view.right - view.left) / view.w;
+    };
+
+    glClearColor(SPLIT_BORDER.r, SPLIT_BORDER.g, SPLIT_BORDER.b, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glEnable(GL_SCISSOR_TEST);
+    glClearColor(NIGHT_SKY.r, NIGHT_SKY.g, NIGHT_SKY.b, 1.0f);
+    for (const SplitView& view : splitViews) {
+        useView(view);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    for (const FrameStep& step : frameSteps) {
+        if (step.list) uploadDrawList(*step.list);
+        for (const SplitView& view : splitViews) {
+            useView(view);
+            if (step.list) drawDrawListRuns(*step.list);
+            else step.pass();
+        }
+        if (step.list && !step.keep) step.list->clear();
+    }
+    glDisable(GL_SCISSOR_TEST);
+
+    viewportLeftX = splitSavedViewport[0];
+    viewportRightX = splitSavedViewport[1];
+    viewportBottomY = splitSavedViewport[2];
+    viewportTopY = splitSavedViewport[3];
+    renderUnitsPerPixel = splitSavedUnitsPerPixel;
+    glViewport(target[0], target[1], target[2], target[3]);
+    frameSteps.clear();
+    sealedDrawListsUsed = 0;
+}
+
+// Batched renderer only: immediate mode has nothing recorded to replay, and
+// uncached text would draw straight away through GLUT
+bool initSplitView() {
+    if (renderBackend != BACKEND_BATCHED || !textCacheEnabled) return false;
+    layerCacheEnabled = false;  // Static layers are kept as draw lists instead
+    return true;
+}
+
+// -------------------------------------------------------------
+// Fixed-timestep simulation
+// -------------------------------------------------------------
+// The scene advances in fixed ticks of 1/--sim-hz seconds, so debris and
+// firecracker motion integrates the same way at any frame rate. The
+// simulation runs up to the first tick at or after the clock, and each
+// frame is drawn at the clock's place between that tick and the one before
+// it. A reset in between (the rocket starting over, a person reaching the
+// end of the road) is not blended across. In a window, frames are paced by
+// vsync and, with --max-fps, by sleeping until the next frame is due
+// instead of redrawing from a spinning idle callback.
+//
+// Ticks reach the renderer through a triple buffer of SimFrames: the
+// simulation fills the back frame and swaps it with the middle one, and the
+// renderer swaps the middle one with its front frame whenever a newer one is
+// there. Neither side waits for the other, and the renderer only ever reads
+// whole ticks. Unless --no-sim-thread is given, the ticks run on their own
+// thread in a window, so a slow frame doesn't hold the simulation back and
+// a burst of ticks doesn't delay a frame.
+int simTickRate = 60;                     // --sim-hz
+const int MAX_SIM_STEPS_PER_FRAME = 8;    // Ticks run at once at most; a longer stall is skipped
+double simClockStart = 0.0;               // Clock reading at tick 0 (simulation side)
+bool timeInitialized = false;             // Whether the simulation has been started
+std::atomic<bool> simResetRequested(false); // R key: start the attack over before the next tick
+bool simInterpolation = true;             // --no-interpolation draws the latest tick as it is
+double lastFrameClock = 0.0;              // Clock reading at the previous idle()
+bool campusShowsRuins = false;            // What the cached campus layer was drawn with
+
+int maxFps = 60;                          // --max-fps (0 = no cap, frames follow vsync)
+bool vsyncEnabled = true;                 // --no-vsync
+double nextFrameDue = 0.0;
+
+// The last two ticks, published together
+struct SimFrame {
+    SimState previous;                    // The tick before `current` (the same state at tick 0)
+    SimState current;
+    ParticleSystem particles;             // As of `current`
+};
+
+const int SIM_FRAME_FRESH = 4;            // Flag on simMiddleFrame: not taken by the renderer yet
+SimFrame simFrames[3];
+int simBackFrame = 0;                     // Simulation side
+std::atomic<int> simMiddleFrame(1);       // Frame index, plus SIM_FRAME_FRESH
+int simFrontFrame = 2;                    // Renderer side
+SimState interpolatedSimState;            // Renderer side: the blend display() draws
+
+// Simulation side: hand the filled back frame over
+void publishSimFrame() {
+    simBackFrame = simMiddleFrame.exchange(simBackFrame | SIM_FRAME_FRESH) & 3;
+}
+
+// Renderer side: take the newest published frame, if there is a new one
+bool acquireSimFrame() {
+    if (!(simMiddleFrame.load() & SIM_FRAME_FRESH)) return false;
+    simFrontFrame = simMiddleFrame.exchange(simFrontFrame) & 3;
+    return true;
+}
+
+// Ticks needed to cover clock reading `now`: up to the first tick at or after it
+long long simTicksDue(double now) {
+    return static_cast<long long>(ceil((now - simClockStart) * simTickRate - 1e-6));
+}
 
-        // sign pedestal
-        float pedY1 = roofY2, pedY2 = roofY2 + 0.6f;
-        framedRect(-7.0f, pedY1, 7.0f, pedY2, ROOF, OUTLINE, 2.0f);
+// A value that only grows until something resets it; a drop means a reset
+float lerpForward(float from, float to, float t) {
+    return to >= from ? from + (to - from) * t : to;
+}
 
-        // sign board
-        float signY1 = pedY2, signY2 = pedY2 + 0.9f;
-        framedRect(-6.5f, signY1, 6.5f, signY2, SIGN_BG, OUTLINE, 2.0f);
+// A value that wraps back by period
+float lerpCycle(float from, float to, float t, float period) {
+    if (to < from) to += period;
+    float value = from + (to - from) * t;
+    return value >= period ? value - period : value;
+}
 
-        // text
-        setColor(SIGN_TEXT);
-        drawCenteredText("Daffodil International University",
-            0.0f, signY1 + 0.25f, 0.22f, GLUT_BITMAP_HELVETICA_18);
+// The state to draw at clock reading `now`: one of the frame's ticks, or a
+// blend of the two when the clock is between them. Particles are only kept
+// for the current tick; they are drawn backed off by particleLag instead.
+const SimState* interpolateSimFrame(const SimFrame& frame, double now) {
+    const SimState& from = frame.previous;
+    const SimState& to = frame.current;
+    viewParticles = &frame.particles;
+    particleLag = 0.0f;
+    if (!simInterpolation || to.clock <= from.clock) return &to;
+    float t = static_cast<float>((now - from.clock) / (to.clock - from.clock));
+    float tickScale = 1.0f / simTickRate / 0.0167f;
+    if (t >= 0.999f) return &to;
+    if (t <= 0.001f) {
+        particleLag = tickScale;
+        return &from;
     }
 
-    void drawGround() {
-        filledRect(-13.5f, 0.0f, 13.5f, 2.0f, GROUND);
-        filledRect(-11.5f, 2.0f, 11.5f, 2.6f, GROUND_DARK);
+    SimState& state = interpolatedSimState;
+    state = to;
+    state.missileClock = lerpForward(from.missileClock, to.missileClock, t);
+    state.droneAnimTime = lerpForward(from.droneAnimTime, to.droneAnimTime, t);
+    state.cloudOffsetX = lerpCycle(from.cloudOffsetX, to.cloudOffsetX, t, cloudLoopWidth);
+    state.flagWaveTime = lerpCycle(from.flagWaveTime, to.flagWaveTime, t, 6.28f);
+    state.starTwinkleTime = lerpForward(from.starTwinkleTime, to.starTwinkleTime, t);
+    state.explosionTime = lerpForward(from.explosionTime, to.explosionTime, t);
+
+    particleLag = (1.0f - t) * tickScale;
+    // Entities still in the same row blend; ones that changed state (or were
+    // despawned) show as they are now
+    const size_t archetypes = std::min(from.world.archetypes.size(), to.world.archetypes.size());
+    for (size_t a = 0; a < archetypes; ++a) {
+        const Archetype& before = from.world.archetypes[a];
+        const Archetype& after = to.world.archetypes[a];
+        Archetype& blend = state.world.archetypes[a];
+        const size_t rows = std::min(before.size(), after.size());
+        for (size_t row = 0; row < rows; ++row) {
+            if (before.entities[row] != after.entities[row]) continue;
+            if (after.has(COMP_PERSON_STATE) && before.personStates[row] != after.personStates[row]) continue;
+            if (after.has(COMP_BURST) && before.bursts[row].exploded != after.bursts[row].exploded) continue;
+            if (after.has(COMP_POSITION)) {
+                const Position& p = before.positions[row];
+                const Position& q = after.positions[row];
+                blend.positions[row] = { p.x + (q.x - p.x) * t, p.y + (q.y - p.y) * t };
+            }
+            if (after.has(COMP_WALKER)) {
+                blend.walkers[row].walkCycle = lerpCycle(before.walkers[row].walkCycle, after.walkers[row].walkCycle, t, 1.0f);
+            }
+            if (after.has(COMP_CELEBRATION)) {
+                blend.celebrations[row].cycle = lerpCycle(before.celebrations[row].cycle, after.celebrations[row].cycle, t, 1.0f);
+            }
+            if (after.has(COMP_BURST) && after.bursts[row].exploded) {
+                blend.bursts[row].explosionTime = lerpForward(before.bursts[row].explosionTime, after.bursts[row].explosionTime, t);
+            }
+        }
+    }
+    return &state;
+}
 
-        drawBush(-10.0f, 2.0f, 2.0f, 0.9f);
-        drawBush(-7.5f, 2.0f, 2.4f, 1.0f);
-        drawBush(7.5f, 2.0f, 2.4f, 1.0f);
-        drawBush(10.0f, 2.0f, 2.0f, 0.9f);
+// Sleep until the next --max-fps frame is due; returns the clock after waking
+double paceFrame(double now) {
+    if (maxFps <= 0) return now;
+    double period = 1.0 / maxFps;
+    if (now < nextFrameDue) {
+        std::this_thread::sleep_for(std::chrono::duration<double>(nextFrameDue - now));
+        now = clockSeconds();
     }
+    // Keep a steady cadence, but don't try to catch up after a long frame
+    nextFrameDue = now - nextFrameDue > period ? now + period : nextFrameDue + period;
+    return now;
+}
 
-    void drawScene() {
-        drawGround();
-        drawSideWing(true);
-        drawSideWing(false);
-        drawCenterBlock();
+// Ask the driver to wait for the display refresh in glutSwapBuffers
+void enableVsync() {
+    typedef int (APIENTRY *SwapIntervalProc)(int);
+    const char* names[] = { "wglSwapIntervalEXT", "glXSwapIntervalSGI", "glXSwapIntervalMESA" };
+    for (const char* name : names) {
+        SwapIntervalProc swapInterval = reinterpret_cast<SwapIntervalProc>(glutGetProcAddress(name));
+        if (swapInterval) {
+            swapInterval(1);
+            return;
+        }
     }
-} // namespace Diu
+}
 
-// -------------------------------------------------------------
-// Global display / reshape / main
-// -------------------------------------------------------------
 void display() {
     // #region agent log
     {
@@ -1775,118 +6198,153 @@ void display() {
     }
     // #endregion
     
-    // Night sky background
-    glClearColor(NIGHT_SKY.r, NIGHT_SKY.g, NIGHT_SKY.b, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
+    lastFrameStats = renderStats;
+    renderStats = { 0, 0 };
+    if (renderBackend != BACKEND_SOFTWARE) {
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
+    }
 
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    // Re-render any cached layer that was invalidated since the last frame
+    // (always at full window resolution)
+    if (layerCacheEnabled) {
+        for (int i = 0; i < NUM_CACHED_LAYERS; ++i) {
+            if (!cachedLayers[i].dirty) continue;
+            bool ok = (i == LAYER_SKY)
+                ? renderLayerToTexture(LAYER_SKY, drawSkyLayer, {0.0f, 0.0f, 0.0f}, 0.0f)
+                : renderLayerToTexture(LAYER_CAMPUS, drawCampusLayer, {0.0f, 0.0f, 0.0f}, 0.0f);
+            if (!ok) layerCacheEnabled = false;  // Fall back to drawing everything every frame
+        }
+    }
 
-    // Full green ground at the bottom - covering entire bottom area
-    const Color GREEN_GROUND = {0.26f, 0.66f, 0.35f};
-    filledRect(-40.0f, 0.0f, 40.0f, 5.0f, GREEN_GROUND);  // Green ground covering full bottom area
+    // Night sky background
+    if (renderBackend == BACKEND_SOFTWARE) {
+        beginSoftwareFrame(NIGHT_SKY);
+    } else if (!beginScenePass(NIGHT_SKY)) {
+        glClearColor(NIGHT_SKY.r, NIGHT_SKY.g, NIGHT_SKY.b, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    if (splitView) beginSplitViewFrame();
+    resetTransform();
 
     // Draw sky elements (moon, stars, clouds) before buildings
-    drawMoon();
-    drawStars();
+    drawStars();  // Twinkles, so it stays out of the cached sky (and sits behind the moon)
+    if (splitView) drawStaticLayerList(LAYER_SKY, drawSkyLayer);
+    else if (layerCacheEnabled) compositeLayer(LAYER_SKY, true);
+    else drawSkyLayer();
     drawClouds();
     
     // Draw countdown timer (10 to 1) before rocket launch - disappears at 0
-    if (countdownValue > 0 && !missileAttackActive) {
+    if (view->countdownValue > 0 && !view->missileAttackActive) {
         float countdownY = viewportTopY * 0.6f;  // 60% up from bottom (center area)
         setColor({1.0f, 1.0f, 0.0f});  // Bright yellow color
-        glLineWidth(4.0f);  // Thick line for visibility
-        std::string countdownStr = std::to_string(countdownValue);
-        drawLargeStrokeText(countdownStr, 0.0f, countdownY, 0.15f);  // Large, centered text
-        glLineWidth(1.0f);  // Reset line width
+        std::string countdownStr = std::to_string(view->countdownValue);
+        float countdownScale = std::min(0.15f, (viewportTopY - countdownY) / 119.05f);  // Digits are 119.05 stroke units tall; keep them on screen in wide windows
+        drawLargeStrokeText(countdownStr, 0.0f, countdownY, countdownScale, 4.0f);  // Large, centered, thick lines for visibility
     }
     
-    // Draw road and environment elements
-    drawRoad();
-    drawTrees();
-    drawStreetLights();
+    // Road, environment and both universities
+    if (splitView) drawStaticLayerList(LAYER_CAMPUS, drawCampusLayer);
+    else if (layerCacheEnabled) compositeLayer(LAYER_CAMPUS, true);
+    else drawCampusLayer();
 
-    // LEFT: City University, shifted left
-    glPushMatrix();
-    glTranslatef(-22.0f, 0.0f, 0.0f);      // center around x ≈ -22
-    City::drawScene();
-    glPopMatrix();
+    // Fire and smoke over the destroyed City University
+    if (view->cityBuildingDestroyed) submitDraw(DRAW_RUINS, MAT_GEOMETRY, drawRuinsItem, -22.0f, 0.0f);
+    submitParticleDraws(viewParticles->smoke, DRAW_RUINS, MAT_GEOMETRY, drawSmokeItem, -22.0f, 0.0f);
 
-    // RIGHT: DIU, shifted right
-    glPushMatrix();
-    glTranslatef(22.0f, 0.0f, 0.0f);       // center around x ≈ +22
-    Diu::drawScene();
-    glPopMatrix();
+    // Exhaust trails, under the rocket and the drone
+    submitParticleDraws(viewParticles->exhaust, DRAW_AIRCRAFT, MAT_EFFECT, drawExhaustItem, 0.0f, 0.0f);
 
-    // Draw animated rocket (only if missile attacks are active - after 10 second delay)
-    if (missileAttackActive) {
-        float rocketX, rocketY, rocketAngle;
-        calculateRocketPosition(rocketAnimTime, rocketX, rocketY, rocketAngle);
-        drawRocket(rocketX, rocketY, rocketAngle);
-    }
+    // Draw the salvo in flight (only if missile attacks are active - after 10 second delay)
+    if (view->missileAttackActive) submitMissileDraws();
 
     // Draw animated drone (loops DIU ↔ City University)
     float droneX, droneY;
-    calculateDronePosition(droneAnimTime, droneDirection, droneX, droneY);
-    drawDrone(droneX, droneY);
+    calculateDronePosition(view->droneAnimTime, view->droneDirection, droneX, droneY);
+    submitDraw(DRAW_AIRCRAFT, MAT_GEOMETRY, drawDroneItem, droneX, droneY);
     
     // Draw flags on buildings
-    drawFlags();
+    submitDraw(DRAW_FLAGS, MAT_GEOMETRY, drawFlagsItem, 0.0f, 0.0f);
     
     // Draw people walking on the road (after buildings so they appear in front)
-    drawPeople();
+    bool crowdSprites = prepareCrowdSprites();
+    forEachArchetype(view->world, ARCH_PERSON, [&](const Archetype& people) {
+        for (size_t row = 0; row < people.size(); ++row) {
+            const Position& p = people.positions[row];
+            int entity = static_cast<int>(people.entities[row].index);
+            if (crowdSprites) submitDraw(DRAW_CROWD, MAT_SPRITE, drawPersonSpriteItem, p.x, p.y, 0.0f, entity);
+            else submitDraw(DRAW_CROWD, MAT_GEOMETRY, drawPersonItem, p.x, p.y, 0.0f, entity);
+        }
+    });
 
     // Draw destruction effects (explosion, debris) if building is destroyed
-    if (cityBuildingDestroyed) {
+    if (view->cityBuildingDestroyed) {
         float impactX = -22.0f;  // City University X position (world coordinates)
         float impactY = 10.9f;   // City University roof Y position
         
         // Draw explosion effect
-        if (explosionTime < 2.0f) {
-            drawExplosion(impactX, impactY, explosionTime);
+        if (view->explosionTime < 2.0f) {
+            submitDraw(DRAW_BLAST, MAT_EFFECT, drawExplosionItem, impactX, impactY);
         }
         
-        // Draw debris particles
-        drawDebris();
     }
     
+    // Draw debris particles
+    submitParticleDraws(viewParticles->debris, DRAW_BLAST, MAT_GEOMETRY, drawDebrisItem, -22.0f, 10.9f);
+    
     // Draw firecracker jubilation animation
-    if (firecrackersActive) {
-        for (int i = 0; i < MAX_FIRECRACKERS; ++i) {
-            if (!firecrackers[i].exploded) {
-                // Draw firecracker body with its assigned color
-                drawFirecracker(firecrackers[i].x, firecrackers[i].y, firecrackers[i].color);
-            } else if (firecrackers[i].explosionTime < 2.0f) {
-                // Draw firecracker explosion with its assigned color
-                drawFirecrackerExplosion(firecrackers[i].x, firecrackers[i].y, firecrackers[i].explosionTime, firecrackers[i].color);
+    if (view->firecrackersActive) {
+        forEachArchetype(view->world, COMP_POSITION | COMP_BURST, [&](const Archetype& shells) {
+            for (size_t row = 0; row < shells.size(); ++row) {
+                const Position& p = shells.positions[row];
+                const Burst& burst = shells.bursts[row];
+                int entity = static_cast<int>(shells.entities[row].index);
+                if (!burst.exploded) {
+                    // Draw firecracker body with its assigned color
+                    submitDraw(DRAW_FIREWORKS, MAT_GEOMETRY, drawFirecrackerItem, p.x, p.y, 0.0f, entity);
+                } else if (burst.explosionTime < 2.0f) {
+                    // One burst instance for the shader, or the sparks in chunks the job system can share out
+                    if (sdfEffectsEnabled) {
+                        submitDraw(DRAW_FIREWORKS, MAT_EFFECT, drawFirecrackerBurstItem, p.x, p.y, 0.0f, entity);
+                    } else {
+                        for (int chunk = 0; chunk * SPARK_DRAW_CHUNK < fireworkSparks; ++chunk) {
+                            submitDraw(DRAW_FIREWORKS, MAT_GEOMETRY, drawFirecrackerBurstItem, p.x, p.y, 0.0f, entity, chunk);
+                        }
+                    }
+                }
             }
-        }
+        });
     }
     
     // Draw victory message when building is destroyed
-    if (cityBuildingDestroyed) {
+    if (view->cityBuildingDestroyed) {
         // Position in top middle area (around Y = 16-17, centered at X = 0)
         float textY = viewportTopY * 0.85f;  // 85% up from bottom (top middle area)
         float textX = 0.0f;  // Center horizontally
-        
-        // Draw victory text with bright colors (smaller size to fit screen)
-        setColor(FIRECRACKER_YELLOW);  // Bright yellow/gold color
-        glLineWidth(1.5f);  // Thinner line width
-        drawLargeStrokeText("Happy Victory Day DIU", textX, textY, 0.035f);
-        glLineWidth(1.0f);  // Reset line width
+        submitDraw(DRAW_OVERLAY, MAT_TEXT, drawVictoryBannerItem, textX, textY);
     }
 
-    glFlush();
-    glutSwapBuffers();
+    flushDrawQueue();
+    if (splitView) drawSplitViewFrame();
+    endScenePass();
+
+    if (showStatsHud) drawStatsHud();
+
+    flushBatch();
+    if (renderBackend == BACKEND_SOFTWARE) {
+        rasterizeSoftwareFrame(mainDrawList.vertices);
+        mainDrawList.clear();
+        presentSoftwareFrame();
+    }
+    if (!headlessMode) {
+        glFlush();
+        glutSwapBuffers();
+    }
 }
 
 void reshape(int w, int h) {
     winW = w;
     winH = h;
-    glViewport(0, 0, w, h);
-
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
 
     // Big world: x [-40, 40], y [0, 20]
     float worldW = 80.0f;
@@ -1901,21 +6359,27 @@ void reshape(int w, int h) {
     }
     // #endregion
 
-    float topY = worldH;
-    if (aspect >= worldW / worldH) {
-        float halfW = 0.5f * worldH * aspect;
-        glOrtho(-halfW, halfW, 0.0f, worldH, -1.0f, 1.0f);
-        topY = worldH;
-    }
-    else {
-        float halfH = 0.5f * worldW / aspect;
-        topY = 2.0f * halfH;
-        glOrtho(-0.5f * worldW, 0.5f * worldW,
-            0.0f, topY, -1.0f, 1.0f);
+    float halfW, topY;
+    fitWorldWindow(aspect, halfW, topY);
+
+    // --headless --software runs without any GL context
+    if (!(headlessMode && renderBackend == BACKEND_SOFTWARE)) {
+        glViewport(0, 0, w, h);
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glOrtho(-halfW, halfW, 0.0f, topY, -1.0f, 1.0f);
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
     }
     
     // Update global viewport top Y for dynamic positioning
     viewportTopY = topY;
+    viewportLeftX = -halfW;
+    viewportRightX = halfW;
+    unitsPerPixel = (2.0f * halfW) / static_cast<float>(w > 0 ? w : 1);
+    renderUnitsPerPixel = unitsPerPixel;
+    invalidateLayerCache();  // Size and viewportTopY both feed the cached layers
+    invalidateCrowdAtlas();  // Sprites are baked at the window's pixel scale
 
     // #region agent log
     {
@@ -1924,9 +6388,6 @@ void reshape(int w, int h) {
         debugLog("project.cpp:664", "Reshape: calculated top Y value", json.str(), "run3", "D");
     }
     // #endregion
-
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
 }
 
 void keyboard(unsigned char key, int, int) {
@@ -1936,214 +6397,860 @@ void keyboard(unsigned char key, int, int) {
     
     // Restart animation with 'r' or 'R' key
     if (key == 'r' || key == 'R') {
-        // Reset all animation states
-        rocketAnimTime = 0.0f;
-        missileHitCount = 0;
-        missileAttackActive = false;
-        firstMissileHitTime = -1.0f;  // Reset first missile hit time
-        cityBuildingDestroyed = false;
-        explosionTime = 0.0f;
-        debrisInitialized = false;
-        
-        // Reset drone animation (optional - remove if you want drone to continue)
-        // droneAnimTime = 0.0f;
-        // droneDirection = true;
-        
-        // Reset firecracker jubilation
-        firecrackersInitialized = false;
-        firecrackersActive = false;
-        firecrackerJubilationTime = 0.0f;
-        buildingDestroyedTime = -1.0f;  // Reset building destruction time
-        // Reset all firecracker structs
-        for (int i = 0; i < MAX_FIRECRACKERS; ++i) {
-            firecrackers[i].exploded = true;
-            firecrackers[i].explosionTime = 2.1f;
-        }
-        
-        // Reset people animation
-        peopleInitialized = false;  // Will re-initialize on next update
-        
-        // Reset cloud animation
-        cloudOffsetX = 0.0f;
+        simResetRequested = true;  // The simulation starts over before its next tick
         cloudYInitialized = false;  // Re-initialize with new random positions
-        
-        // Reset flag animation
-        flagWaveTime = 0.0f;
-        
-        // Reset timer for 10 second delay
-        timeInitialized = false;  // Reset timer so it re-initializes in idle()
-        startTime = 0;
-        lastFrameTime = 0;  // Reset frame timing
-        deltaTime = 0.0167f;  // Reset to default
-        countdownValue = 10;  // Reset countdown to 10
-        
-        // Reset sound flags
-        rocketSoundPlayed = false;
-        explosionSoundPlayed = false;
-        firecrackerSoundPlayed = false;
         stopSound();  // Stop any currently playing sounds
         
         glutPostRedisplay();
     }
 }
 
-void idle() {
-    // Calculate elapsed time since program start (in seconds)
-    if (!timeInitialized) {
-        startTime = glutGet(GLUT_ELAPSED_TIME);  // Get time in milliseconds
-        lastFrameTime = startTime;  // Initialize last frame time
-        timeInitialized = true;
-    }
-    
-    int currentTime = glutGet(GLUT_ELAPSED_TIME);
-    float elapsedTime = (currentTime - startTime) / 1000.0f;  // Convert to seconds
-    
-    // Calculate actual deltaTime based on frame rate (frame-rate independent)
-    deltaTime = (currentTime - lastFrameTime) / 1000.0f;  // Actual time since last frame
-    if (deltaTime > 0.1f) deltaTime = 0.0167f;  // Cap deltaTime to prevent huge jumps (max 0.1s = 10 FPS min)
-    lastFrameTime = currentTime;  // Update last frame time
-    
+// One fixed tick of the scene; elapsedTime is simulated seconds since the start
+void stepSimulation(float elapsedTime) {
     // Calculate countdown value (10 to 0)
     float remainingTime = missileDelay - elapsedTime;
     if (remainingTime > 0.0f) {
-        countdownValue = (int)ceil(remainingTime);
-        if (countdownValue < 0) countdownValue = 0;
-        if (countdownValue > 10) countdownValue = 10;
+        sim.countdownValue = (int)ceil(remainingTime);
+        if (sim.countdownValue < 0) sim.countdownValue = 0;
+        if (sim.countdownValue > 10) sim.countdownValue = 10;
     } else {
-        countdownValue = 0;
+        sim.countdownValue = 0;
     }
     
+    sim.missileClock = elapsedTime;
+    
     // Activate missile attacks after 10 second delay (for first missile)
-    static bool justActivated = false;
-    if (!missileAttackActive && elapsedTime >= missileDelay && missileHitCount < 2) {
+    bool launching = false;
+    if (!sim.missileAttackActive && elapsedTime >= missileDelay && sim.missileHitCount < 2) {
         // Check if we need to wait for second missile delay
-        if (missileHitCount == 0) {
+        if (sim.missileHitCount == 0) {
             // First missile: launch immediately after 10 second delay
-            missileAttackActive = true;
-            rocketSoundPlayed = false;  // Reset flag so sound can play
-            justActivated = true;  // Mark that we just activated
-        } else if (missileHitCount == 1 && firstMissileHitTime >= 0.0f) {
+            launching = true;
+        } else if (sim.missileHitCount == 1 && sim.firstMissileHitTime >= 0.0f) {
             // Second missile: launch 4 seconds after first hit
-            float timeSinceFirstHit = elapsedTime - firstMissileHitTime;
+            float timeSinceFirstHit = elapsedTime - sim.firstMissileHitTime;
             if (timeSinceFirstHit >= secondMissileDelay) {
-                missileAttackActive = true;
-                rocketSoundPlayed = false;  // Reset flag so sound can play
-                justActivated = true;  // Mark that we just activated
+                launching = true;
             }
         }
     }
+    if (launching) {
+        // Launched at the start of this tick, so the first missile has already
+        // flown one tick's worth by its end
+        launchSalvo(elapsedTime - deltaTime);
+        sim.missileAttackActive = true;
+        playSound("Rocket-launcher.wav");
+    }
     
-    // Update rocket animation (one-way: DIU to City University)
+    // Fly the salvo (one-way: DIU to City University)
     // Only update if missile attacks are active (after 10 second delay)
-    float prevRocketTime = rocketAnimTime;
-    
-    if (missileAttackActive) {
-        // Play rocket sound immediately when attack activates or when rocket resets
-        if (missileAttackActive && !rocketSoundPlayed && (justActivated || rocketAnimTime < 0.05f)) {
-            playSound("Rocket-launcher.wav");
-            rocketSoundPlayed = true;
-            justActivated = false;  // Clear the flag
-        }
-        
-        rocketAnimTime += rocketSpeed * (deltaTime / 0.0167f);  // Scale by actual frame time (normalized to 60 FPS)
-        
-        // Detect rocket impact on City University
-        if (rocketAnimTime >= 1.0f && prevRocketTime < 1.0f) {
-            missileHitCount++;
+    if (sim.missileAttackActive) {
+        // Detect the salvo's impact on City University: its last missile has landed
+        if (updateMissiles(elapsedTime)) {
+            sim.missileHitCount++;
             
             // First hit: no destruction, just count and record time
-            if (missileHitCount == 1) {
-                firstMissileHitTime = elapsedTime;  // Record time of first hit
-                missileAttackActive = false;  // Stop launching until delay passes
-                rocketAnimTime = 0.0f;  // Reset animation
-                rocketSoundPlayed = false;  // Reset flag for next rocket sound
+            if (sim.missileHitCount == 1) {
+                sim.firstMissileHitTime = elapsedTime;  // Record time of first hit
+                sim.missileAttackActive = false;  // Stop launching until delay passes
             }
             // Second hit: destroy the building
-            else if (missileHitCount == 2 && !cityBuildingDestroyed) {
+            else if (sim.missileHitCount == 2 && !sim.cityBuildingDestroyed) {
                 // Rocket just reached target - trigger destruction
-                cityBuildingDestroyed = true;
-                explosionTime = 0.0f;
+                sim.cityBuildingDestroyed = true;
+                sim.explosionTime = 0.0f;
                 float impactX = -22.0f;  // City University X position (world coordinates)
                 float impactY = 10.9f;  // City University roof Y position
                 initializeDebris(impactX, impactY);
+                if (flowFieldNavigation) dropCityRubble();
                 
                 // Record the time when building was destroyed
-                buildingDestroyedTime = elapsedTime;
+                sim.buildingDestroyedTime = elapsedTime;
                 
                 // Play explosion sound
-                if (!explosionSoundPlayed) {
+                if (!sim.explosionSoundPlayed) {
                     playSound("explosion.wav");
-                    explosionSoundPlayed = true;
+                    sim.explosionSoundPlayed = true;
                 }
                 
                 // After second hit, stop launching new missiles
-                missileAttackActive = false;
+                sim.missileAttackActive = false;
             }
         }
     }
     
     // Update drone animation (loop: DIU ↔ City University)
-    droneAnimTime += droneSpeed * (deltaTime / 0.0167f);  // Scale by actual frame time
-    if (droneAnimTime >= 1.0f) {
-        droneAnimTime = 0.0f;
-        droneDirection = !droneDirection;  // Toggle direction for continuous loop
+    sim.droneAnimTime += droneSpeed * (deltaTime / 0.0167f);  // Scale by actual frame time
+    if (sim.droneAnimTime >= 1.0f) {
+        sim.droneAnimTime = 0.0f;
+        sim.droneDirection = !sim.droneDirection;  // Toggle direction for continuous loop
     }
     
     // Update cloud animation (move left to right, looping)
-    cloudOffsetX += cloudSpeed * (deltaTime / 0.0167f);  // Scale by actual frame time
-    if (cloudOffsetX >= cloudLoopWidth) {
-        cloudOffsetX -= cloudLoopWidth;  // Loop back to start
+    sim.cloudOffsetX += cloudSpeed * (deltaTime / 0.0167f);  // Scale by actual frame time
+    if (sim.cloudOffsetX >= cloudLoopWidth) {
+        sim.cloudOffsetX -= cloudLoopWidth;  // Loop back to start
     }
     
     // Update flag animation (waving effect)
-    flagWaveTime += flagWaveSpeed * (deltaTime / 0.0167f);  // Scale by actual frame time
-    if (flagWaveTime > 6.28f) {  // Reset after full wave cycle (2*PI)
-        flagWaveTime -= 6.28f;
+    sim.flagWaveTime += flagWaveSpeed * (deltaTime / 0.0167f);  // Scale by actual frame time
+    if (sim.flagWaveTime > 6.28f) {  // Reset after full wave cycle (2*PI)
+        sim.flagWaveTime -= 6.28f;
     }
     
+    // Update star twinkle
+    sim.starTwinkleTime += deltaTime;
+    
     // Update people animation (walking from DIU to City University and back)
     updatePeople();
     
     // Update destruction effects
-    if (cityBuildingDestroyed) {
-        explosionTime += explosionSpeed * (deltaTime / 0.0167f);  // Scale by actual frame time
-        updateDebris();
+    if (sim.cityBuildingDestroyed) {
+        sim.explosionTime += explosionSpeed * (deltaTime / 0.0167f);  // Scale by actual frame time
+        emitSmoke();
         
         // Start firecracker jubilation 10 seconds after building is destroyed
-        if (missileHitCount == 2 && !firecrackersActive && buildingDestroyedTime >= 0.0f) {
-            float timeSinceDestruction = elapsedTime - buildingDestroyedTime;
+        if (sim.missileHitCount == 2 && !sim.firecrackersActive && sim.buildingDestroyedTime >= 0.0f) {
+            float timeSinceDestruction = elapsedTime - sim.buildingDestroyedTime;
             if (timeSinceDestruction >= firecrackerDelay) {
                 initializeFirecrackers();
-                firecrackersInitialized = true;
-                firecrackersActive = true;
-                firecrackerJubilationTime = 0.0f;
+                sim.firecrackersInitialized = true;
+                sim.firecrackersActive = true;
+                sim.firecrackerJubilationTime = 0.0f;
                 
                 // Play firecracker celebration sound
-                if (!firecrackerSoundPlayed) {
+                if (!sim.firecrackerSoundPlayed) {
                     playSound("firecrackers.wav");
-                    firecrackerSoundPlayed = true;
+                    sim.firecrackerSoundPlayed = true;
                 }
             }
         }
     }
     
     // Update firecracker animation (continuous loop)
-    if (firecrackersActive) {
+    if (sim.firecrackersActive) {
         updateFirecrackers();  // This will automatically launch new batches when current ones finish
-        firecrackerJubilationTime += deltaTime;  // Use actual frame time
+        sim.firecrackerJubilationTime += deltaTime;  // Use actual frame time
     }
-    
-    glutPostRedisplay();
+
+    // Update debris, smoke and exhaust
+    updateParticles();
+}
+
+// -------------------------------------------------------------
+// Simulation thread
+// -------------------------------------------------------------
+// Everything here runs on the simulation side: on the simulation thread, or
+// inside idle() with --no-sim-thread. A headless run keeps the ticks in
+// lockstep with its simulated clock, so its frames stay exact with or
+// without the thread.
+bool simThreadEnabled = true;             // --no-sim-thread
+bool forceSimThread = false;              // --sim-thread: use it headless too (off there by default)
+std::thread simThread;
+std::mutex simMutex;
+std::condition_variable simWake;          // A new headless target, or shutting down
+std::condition_variable simCaughtUp;      // Tick 0, or the headless target, has been published
+long long simTargetTick = 0;              // Headless: run up to here
+long long simPublishedTick = 0;           // Headless: last tick published
+bool simStopping = false;
+bool simStarted = false;                  // The thread has published tick 0
+unsigned int simThreadSeed = 0;           // --seed, for rand() on the simulation thread
+
+// Tick 0 sets everything up without moving it, like the first frame always has
+void startSimulation(double now) {
+    simClockStart = now;
+    deltaTime = 0.0f;
+    sim.tick = 0;
+    sim.clock = now;
+    stepSimulation(0.0f);
+    SimFrame& frame = simFrames[simBackFrame];
+    frame.previous = sim;
+    frame.current = sim;
+    frame.particles = particles;
+    publishSimFrame();
+}
+
+// Back to the start of the attack; the drone and the stars carry on
+void resetSimulation(double now) {
+    SimState fresh;
+    fresh.droneAnimTime = sim.droneAnimTime;
+    fresh.droneDirection = sim.droneDirection;
+    fresh.starTwinkleTime = sim.starTwinkleTime;
+    sim = std::move(fresh);
+    particles.clear();
+    startSimulation(now);
+}
+
+// Run the ticks up to `target` and publish the last two
+void runSimulationTicks(long long target) {
+    if (!headlessMode && target - sim.tick > MAX_SIM_STEPS_PER_FRAME) {
+        simClockStart += static_cast<double>(target - sim.tick - MAX_SIM_STEPS_PER_FRAME) / simTickRate;
+        target = sim.tick + MAX_SIM_STEPS_PER_FRAME;
+    }
+    if (target <= sim.tick) return;
+    SimFrame& frame = simFrames[simBackFrame];
+    deltaTime = 1.0f / simTickRate;
+    while (sim.tick < target) {
+        if (sim.tick == target - 1) frame.previous = sim;
+        ++sim.tick;
+        sim.clock = simClockStart + static_cast<double>(sim.tick) / simTickRate;
+        stepSimulation(static_cast<float>(static_cast<double>(sim.tick) / simTickRate));
+    }
+    frame.current = sim;
+    frame.particles = particles;
+    publishSimFrame();
+}
+
+// Tick 0 runs here as well, after the seeding, so every rand() call the
+// simulation makes (crowd setup included) comes from one --seed sequence
+void simulationThreadLoop(double start) {
+#ifdef _WIN32
+    srand(simThreadSeed);  // The CRT keeps rand() state per thread
+#endif
+    startSimulation(start);
+    {
+        std::lock_guard<std::mutex> lock(simMutex);
+        simStarted = true;
+        simCaughtUp.notify_one();
+    }
+    for (;;) {
+        long long target;
+        {
+            std::unique_lock<std::mutex> lock(simMutex);
+            if (headlessMode) {
+                simWake.wait(lock, [] { return simStopping || simTargetTick > sim.tick; });
+                target = simTargetTick;
+            } else {
+                // The next tick is due as soon as the clock passes this one
+                double wait = simClockStart + static_cast<double>(sim.tick) / simTickRate - clockSeconds();
+                if (wait > 0.0) simWake.wait_for(lock, std::chrono::duration<double>(wait), [] { return simStopping; });
+                target = 0;
+            }
+            if (simStopping) return;
+        }
+        if (!headlessMode) {
+            double now = clockSeconds();
+            if (simResetRequested.exchange(false)) resetSimulation(now);
+            target = simTicksDue(now);
+        }
+        runSimulationTicks(target);
+        if (headlessMode) {
+            std::lock_guard<std::mutex> lock(simMutex);
+            simPublishedTick = sim.tick;
+            simCaughtUp.notify_one();
+        }
+    }
+}
+
+void stopSimulationThread() {
+    {
+        std::lock_guard<std::mutex> lock(simMutex);
+        simStopping = true;
+    }
+    simWake.notify_all();
+    if (simThread.joinable()) simThread.join();
+}
+
+void idle() {
+    double now = clockSeconds();
+    if (!headlessMode) now = paceFrame(now);
+    if (!timeInitialized) {
+        lastFrameClock = now;
+        nextFrameDue = now;
+        if (simThreadEnabled) {
+            simThread = std::thread(simulationThreadLoop, now);
+            atexit(stopSimulationThread);  // GLUT leaves its main loop through exit()
+            std::unique_lock<std::mutex> lock(simMutex);
+            simCaughtUp.wait(lock, [] { return simStarted; });  // The first frame needs tick 0
+        } else {
+            startSimulation(now);
+        }
+        timeInitialized = true;
+    }
+    frameSeconds = now - lastFrameClock;
+    lastFrameClock = now;
+
+    if (!simThreadEnabled) {
+        if (simResetRequested.exchange(false)) resetSimulation(now);
+        runSimulationTicks(simTicksDue(now));
+    } else if (headlessMode) {
+        // simClockStart never moves in a headless run, so it can be read here
+        long long target = simTicksDue(now);
+        std::unique_lock<std::mutex> lock(simMutex);
+        simTargetTick = target;
+        simWake.notify_one();
+        simCaughtUp.wait(lock, [&] { return simPublishedTick >= target; });
+    }
+    acquireSimFrame();
+    view = interpolateSimFrame(simFrames[simFrontFrame], now);
+    if (view->cityBuildingDestroyed != campusShowsRuins) {
+        campusShowsRuins = view->cityBuildingDestroyed;
+        invalidateLayer(LAYER_CAMPUS);  // Swap the intact building for the ruins, or back
+    }
+
+    if (!headlessMode) glutPostRedisplay();
+}
+
+// -------------------------------------------------------------
+// Headless mode
+// -------------------------------------------------------------
+// --headless runs without a display: a surfaceless EGL context on Mesa, the
+// scene rendered into an offscreen framebuffer, idle() and display() called
+// from a plain loop with the clock advanced 1/fps per frame, and selected
+// frames written out as binary PPM files.
+int headlessFrames = 600;             // --frames
+int headlessDumpEvery = 0;            // --dump-every: also write every Nth frame (0 = last frame only)
+std::string headlessDumpDir = ".";    // --dump-dir
+GLuint headlessFramebuffer = 0;
+GLuint headlessColorTexture = 0;
+
+#ifdef HAVE_HEADLESS_EGL
+bool createHeadlessContext() {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+        eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (getPlatformDisplay) {
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    EGLint major = 0, minor = 0;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) return false;
+    if (!eglBindAPI(EGL_OPENGL_API)) return false;
+    // No config and no surface: everything is drawn into our own framebuffer object
+    EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, nullptr);
+    if (context == EGL_NO_CONTEXT) return false;
+    return eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context) == EGL_TRUE;
+}
+#else
+bool createHeadlessContext() {
+    return false;
+}
+#endif
+
+// Color target the whole frame renders into; stays bound for the run
+bool createHeadlessFramebuffer() {
+    if (!gl33Available) return false;
+    glGenTextures(1, &headlessColorTexture);
+    glBindTexture(GL_TEXTURE_2D, headlessColorTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, winW, winH, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    gl33::GenFramebuffers(1, &headlessFramebuffer);
+    gl33::BindFramebuffer(GL_FRAMEBUFFER, headlessFramebuffer);
+    gl33::FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, headlessColorTexture, 0);
+    return gl33::CheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+// Read the finished frame back and write it top row first
+bool writeFramePpm(const std::string& path, std::vector<unsigned char>& pixels) {
+    const size_t rowSize = static_cast<size_t>(winW) * 3;
+    pixels.resize(rowSize * winH);
+    if (renderBackend == BACKEND_SOFTWARE) {
+        const unsigned char* rgba = reinterpret_cast<const unsigned char*>(softwareFramebuffer.data());
+        for (size_t i = 0, n = static_cast<size_t>(winW) * winH; i < n; ++i) memcpy(&pixels[i * 3], &rgba[i * 4], 3);
+    } else {
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, winW, winH, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+    }
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    fprintf(file, "P6\n%d %d\n255\n", winW, winH);
+    for (int y = winH - 1; y >= 0; --y) fwrite(&pixels[y * rowSize], 1, rowSize, file);
+    return fclose(file) == 0;
+}
+
+// -------------------------------------------------------------
+// Frame export
+// -------------------------------------------------------------
+// --export png|rgba (implies --headless) captures every frame of the run.
+// glReadPixels writes into a ring of pixel-pack buffers, and each buffer is
+// mapped only when it is EXPORT_RING_SIZE - 1 frames old, so the render
+// loop never waits on its own readback. The mapped pixels are copied into a
+// pooled frame and handed to worker threads: PNG frames are encoded in
+// parallel, raw RGBA frames are written to stdout in order by a single
+// writer (for piping into ffmpeg).
+enum ExportFormat { EXPORT_NONE, EXPORT_PNG, EXPORT_RGBA };
+ExportFormat exportFormat = EXPORT_NONE;   // --export
+int exportThreads = 0;                     // --export-threads (0 = one per core, minus the render thread)
+
+const int EXPORT_RING_SIZE = 3;
+GLuint exportPixelBuffers[EXPORT_RING_SIZE];
+
+struct ExportFrame {
+    int index;
+    std::vector<unsigned char> pixels;     // RGBA, bottom row first, as read back
+};
+
+std::vector<std::thread> exportWorkers;
+std::mutex exportMutex;
+std::condition_variable exportWorkReady;   // Frames queued, or closing
+std::condition_variable exportFrameFreed;  // A pooled frame came back
+std::deque<ExportFrame*> exportQueue;
+std::vector<ExportFrame*> exportFreeFrames;
+std::vector<ExportFrame*> exportAllFrames;
+size_t exportMaxFrames = 0;                // Pool size: bounds the memory held by a slow encoder
+bool exportClosing = false;
+bool exportFailed = false;
+double exportStallSeconds = 0.0;           // Render loop time spent waiting for a free frame
+
+// PNG pieces: CRC-32 for chunks, Adler-32 for the zlib stream
+uint32_t crc32Table[256];
+
+void initCrc32Table() {
+    for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc32Table[n] = c;
+    }
+}
+
+uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc = 0) {
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) crc = crc32Table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t adler32(const unsigned char* data, size_t size) {
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        size_t chunk = std::min<size_t>(size, 5552);  // Longest run before the sums can overflow
+        for (size_t i = 0; i < chunk; ++i) { a += data[i]; b += a; }
+        a %= 65521; b %= 65521;
+        data += chunk; size -= chunk;
+    }
+    return (b << 16) | a;
+}
+
+struct BitWriter {
+    std::vector<unsigned char>& out;
+    uint64_t bits = 0;
+    int count = 0;
+
+    explicit BitWriter(std::vector<unsigned char>& o) : out(o) {}
+    void put(uint32_t value, int n) {  // Deflate packs bits LSB first
+        bits |= static_cast<uint64_t>(value) << count;
+        count += n;
+        while (count >= 8) { out.push_back(static_cast<unsigned char>(bits)); bits >>= 8; count -= 8; }
+    }
+    void putHuffman(uint32_t code, int n) {  // Huffman codes go in MSB first
+        uint32_t reversed = 0;
+        for (int i = 0; i < n; ++i) reversed |= ((code >> i) & 1) << (n - 1 - i);
+        put(reversed, n);
+    }
+    void flush() { if (count > 0) put(0, 8 - count); }
+};
+
+void putFixedLiteral(BitWriter& w, int symbol) {
+    if (symbol < 144) w.putHuffman(0x30 + symbol, 8);
+    else if (symbol < 256) w.putHuffman(0x190 + symbol - 144, 9);
+    else if (symbol < 280) w.putHuffman(symbol - 256, 7);
+    else w.putHuffman(0xC0 + symbol - 280, 8);
+}
+
+// One fixed-Huffman deflate block with greedy LZ77 on a single-probe hash.
+// Filtered scanlines are mostly long zero runs, which this handles well
+// and fast; it is not trying to match zlib's ratio.
+void deflateFixed(const unsigned char* data, size_t size, std::vector<unsigned char>& out) {
+    static const int LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const int LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const int DIST_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const int DIST_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    const int HASH_BITS = 15;
+    const size_t WINDOW = 32768;
+    std::vector<int64_t> head(static_cast<size_t>(1) << HASH_BITS, -1);
+
+    BitWriter w(out);
+    w.put(1, 1);  // Final block
+    w.put(1, 2);  // Fixed Huffman codes
+    size_t i = 0;
+    while (i < size) {
+        size_t length = 0, distance = 0;
+        if (i + 3 <= size) {
+            uint32_t h = ((data[i] << 16) | (data[i + 1] << 8) | data[i + 2]) * 2654435761u >> (32 - HASH_BITS);
+            int64_t candidate = head[h];
+            head[h] = static_cast<int64_t>(i);
+            if (candidate >= 0 && i - static_cast<size_t>(candidate) <= WINDOW) {
+                size_t limit = std::min<size_t>(258, size - i);
+                const unsigned char* a = data + candidate;
+                const unsigned char* b = data + i;
+                while (length < limit && a[length] == b[length]) ++length;
+                distance = i - static_cast<size_t>(candidate);
+            }
+        }
+        if (length < 3) {
+            putFixedLiteral(w, data[i]);
+            ++i;
+            continue;
+        }
+        int lc = 0;
+        while (lc < 28 && LENGTH_BASE[lc + 1] <= static_cast<int>(length)) ++lc;
+        putFixedLiteral(w, 257 + lc);
+        w.put(static_cast<uint32_t>(length - LENGTH_BASE[lc]), LENGTH_EXTRA[lc]);
+        int dc = 0;
+        while (dc < 29 && DIST_BASE[dc + 1] <= static_cast<int>(distance)) ++dc;
+        w.putHuffman(dc, 5);
+        w.put(static_cast<uint32_t>(distance - DIST_BASE[dc]), DIST_EXTRA[dc]);
+        i += length;
+    }
+    putFixedLiteral(w, 256);  // End of block
+    w.flush();
+}
+
+void appendBigEndian(std::vector<unsigned char>& out, uint32_t v) {
+    out.push_back(static_cast<unsigned char>(v >> 24));
+    out.push_back(static_cast<unsigned char>(v >> 16));
+    out.push_back(static_cast<unsigned char>(v >> 8));
+    out.push_back(static_cast<unsigned char>(v));
+}
+
+void appendPngChunk(std::vector<unsigned char>& out, const char* type, const std::vector<unsigned char>& data) {
+    appendBigEndian(out, static_cast<uint32_t>(data.size()));
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    appendBigEndian(out, crc32(&out[start], out.size() - start));
+}
+
+// 8-bit RGB PNG from a bottom-up RGBA frame. Each scanline uses whichever
+// of the None/Sub/Up filters gives the smallest sum of residuals.
+void encodePng(const ExportFrame& frame, int width, int height, std::vector<unsigned char>& png) {
+    const size_t rowSize = static_cast<size_t>(width) * 3;
+    std::vector<unsigned char> filtered((rowSize + 1) * height);
+    std::vector<unsigned char> row(rowSize), previous(rowSize, 0), candidate[3];
+    for (int f = 0; f < 3; ++f) candidate[f].resize(rowSize);
+    for (int y = 0; y < height; ++y) {
+        const unsigned char* src = &frame.pixels[static_cast<size_t>(height - 1 - y) * width * 4];
+        for (int x = 0; x < width; ++x) {
+            row[x * 3] = src[x * 4];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 2];
+        }
+        unsigned long cost[3] = { 0, 0, 0 };
+        for (size_t k = 0; k < rowSize; ++k) {
+            unsigned char left = k >= 3 ? row[k - 3] : 0;
+            candidate[0][k] = row[k];
+            candidate[1][k] = static_cast<unsigned char>(row[k] - left);
+            candidate[2][k] = static_cast<unsigned char>(row[k] - previous[k]);
+            for (int f = 0; f < 3; ++f) cost[f] += std::abs(static_cast<signed char>(candidate[f][k]));
+        }
+        int best = 0;
+        for (int f = 1; f < 3; ++f) if (cost[f] < cost[best]) best = f;
+        unsigned char* dst = &filtered[y * (rowSize + 1)];
+        dst[0] = static_cast<unsigned char>(best);
+        memcpy(dst + 1, candidate[best].data(), rowSize);
+        previous.swap(row);
+    }
+
+    std::vector<unsigned char> header;
+    appendBigEndian(header, static_cast<uint32_t>(width));
+    appendBigEndian(header, static_cast<uint32_t>(height));
+    header.insert(header.end(), { 8, 2, 0, 0, 0 });  // 8-bit RGB, deflate, adaptive filters, no interlace
+
+    std::vector<unsigned char> idat = { 0x78, 0x01 };  // zlib header, 32K window
+    deflateFixed(filtered.data(), filtered.size(), idat);
+    appendBigEndian(idat, adler32(filtered.data(), filtered.size()));
+
+    static const unsigned char SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    png.assign(SIGNATURE, SIGNATURE + 8);
+    appendPngChunk(png, "IHDR", header);
+    appendPngChunk(png, "IDAT", idat);
+    appendPngChunk(png, "IEND", {});
+}
+
+bool writeExportFrame(const ExportFrame& frame, std::vector<unsigned char>& scratch) {
+    if (exportFormat == EXPORT_RGBA) {
+        const size_t rowSize = static_cast<size_t>(winW) * 4;
+        for (int y = winH - 1; y >= 0; --y) {
+            if (fwrite(&frame.pixels[y * rowSize], 1, rowSize, stdout) != rowSize) return false;
+        }
+        return true;
+    }
+    encodePng(frame, winW, winH, scratch);
+    char name[32];
+    snprintf(name, sizeof(name), "/frame%05d.png", frame.index);
+    FILE* file = fopen((headlessDumpDir + name).c_str(), "wb");
+    if (!file) return false;
+    bool ok = fwrite(scratch.data(), 1, scratch.size(), file) == scratch.size();
+    return fclose(file) == 0 && ok;
+}
+
+void exportWorker() {
+    std::vector<unsigned char> scratch;
+    for (;;) {
+        ExportFrame* frame = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(exportMutex);
+            exportWorkReady.wait(lock, [] { return !exportQueue.empty() || exportClosing; });
+            if (exportQueue.empty()) return;
+            frame = exportQueue.front();
+            exportQueue.pop_front();
+        }
+        bool ok = writeExportFrame(*frame, scratch);
+        {
+            std::lock_guard<std::mutex> lock(exportMutex);
+            if (!ok) exportFailed = true;
+            exportFreeFrames.push_back(frame);
+        }
+        exportFrameFreed.notify_one();
+    }
+}
+
+void startExport() {
+    initCrc32Table();
+    const GLsizeiptr frameBytes = static_cast<GLsizeiptr>(winW) * winH * 4;
+    if (renderBackend != BACKEND_SOFTWARE) {  // Software frames are already in memory
+        gl33::GenBuffers(EXPORT_RING_SIZE, exportPixelBuffers);
+        for (int i = 0; i < EXPORT_RING_SIZE; ++i) {
+            gl33::BindBuffer(GL_PIXEL_PACK_BUFFER, exportPixelBuffers[i]);
+            gl33::BufferData(GL_PIXEL_PACK_BUFFER, frameBytes, nullptr, GL_STREAM_READ);
+        }
+        gl33::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // Raw frames must reach the pipe in order, so they get one writer
+    int workers = exportThreads;
+    if (workers <= 0) workers = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+    if (exportFormat == EXPORT_RGBA) workers = 1;
+    exportMaxFrames = static_cast<size_t>(workers) * 2 + 2;
+    for (int i = 0; i < workers; ++i) exportWorkers.emplace_back(exportWorker);
+}
+
+// Copy one frame into a pooled buffer (waiting for the encoders if the pool
+// is used up) and queue it for the workers. A null source means the copy failed.
+void queueExportFrame(int frameIndex, const void* source) {
+    ExportFrame* frame = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(exportMutex);
+        if (exportFreeFrames.empty() && exportAllFrames.size() < exportMaxFrames) {
+            exportAllFrames.push_back(new ExportFrame());
+            exportFreeFrames.push_back(exportAllFrames.back());
+        }
+        if (exportFreeFrames.empty()) {
+            auto waitStart = std::chrono::steady_clock::now();
+            exportFrameFreed.wait(lock, [] { return !exportFreeFrames.empty(); });
+            exportStallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - waitStart).count();
+        }
+        frame = exportFreeFrames.back();
+        exportFreeFrames.pop_back();
+    }
+
+    const size_t frameBytes = static_cast<size_t>(winW) * winH * 4;
+    frame->index = frameIndex;
+    frame->pixels.resize(frameBytes);
+    if (source) memcpy(frame->pixels.data(), source, frameBytes);
+
+    {
+        std::lock_guard<std::mutex> lock(exportMutex);
+        if (!source) exportFailed = true;
+        exportQueue.push_back(frame);
+    }
+    exportWorkReady.notify_one();
+}
+
+// Hand a ring slot whose readback has had EXPORT_RING_SIZE - 1 frames to finish to the workers
+void retireExportFrame(int frameIndex) {
+    const GLsizeiptr frameBytes = static_cast<GLsizeiptr>(winW) * winH * 4;
+    gl33::BindBuffer(GL_PIXEL_PACK_BUFFER, exportPixelBuffers[frameIndex % EXPORT_RING_SIZE]);
+    const void* mapped = gl33::MapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes, GL_MAP_READ_BIT);
+    queueExportFrame(frameIndex, mapped);
+    gl33::UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    gl33::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void captureExportFrame(int frameIndex) {
+    if (renderBackend == BACKEND_SOFTWARE) {
+        queueExportFrame(frameIndex, softwareFramebuffer.data());
+        return;
+    }
+    gl33::BindBuffer(GL_PIXEL_PACK_BUFFER, exportPixelBuffers[frameIndex % EXPORT_RING_SIZE]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, winW, winH, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);  // Queued; lands in the buffer later
+    gl33::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    int oldest = frameIndex - (EXPORT_RING_SIZE - 1);
+    if (oldest >= 0) retireExportFrame(oldest);
+}
+
+// Drain the ring, wait for the workers, and report whether every frame was written
+bool finishExport(int frameCount) {
+    if (renderBackend != BACKEND_SOFTWARE) {
+        for (int i = std::max(0, frameCount - (EXPORT_RING_SIZE - 1)); i < frameCount; ++i) retireExportFrame(i);
+        gl33::DeleteBuffers(EXPORT_RING_SIZE, exportPixelBuffers);
+    }
+    {
+        std::lock_guard<std::mutex> lock(exportMutex);
+        exportClosing = true;
+    }
+    exportWorkReady.notify_all();
+    for (std::thread& worker : exportWorkers) worker.join();
+    exportWorkers.clear();
+    for (ExportFrame* frame : exportAllFrames) delete frame;
+    exportAllFrames.clear();
+    exportFreeFrames.clear();
+    if (exportFormat == EXPORT_RGBA) fflush(stdout);
+    return !exportFailed;
+}
+
+int runHeadless() {
+    reshape(winW, winH);
+#ifdef _WIN32
+    _mkdir(headlessDumpDir.c_str());
+#else
+    mkdir(headlessDumpDir.c_str(), 0755);
+#endif
+
+    std::vector<unsigned char> pixels;
+    int framesWritten = 0;
+    if (exportFormat != EXPORT_NONE) startExport();
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < headlessFrames; ++frame) {
+        headlessClockSeconds = static_cast<double>(frame) / headlessFps;
+        idle();
+        display();
+
+        if (exportFormat != EXPORT_NONE) {
+            captureExportFrame(frame);
+            ++framesWritten;
+            continue;
+        }
+        bool dump = (frame == headlessFrames - 1) || (headlessDumpEvery > 0 && frame % headlessDumpEvery == 0);
+        if (!dump) continue;
+        char name[32];
+        snprintf(name, sizeof(name), "/frame%05d.ppm", frame);
+        if (!writeFramePpm(headlessDumpDir + name, pixels)) {
+            std::cerr << "Could not write " << headlessDumpDir << name << std::endl;
+            return 1;
+        }
+        ++framesWritten;
+    }
+    if (exportFormat != EXPORT_NONE && !finishExport(headlessFrames)) {
+        std::cerr << "Export failed: could not read back or write every frame" << std::endl;
+        return 1;
+    }
+    if (renderBackend != BACKEND_SOFTWARE) glFinish();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Raw RGBA export owns stdout, so the report goes to stderr
+    std::ostream& report = exportFormat == EXPORT_RGBA ? std::cerr : std::cout;
+    report << "Rendered " << headlessFrames << " frames at " << winW << "x" << winH
+           << " in " << std::fixed << std::setprecision(3) << seconds << " s ("
+           << std::setprecision(2) << seconds * 1000.0 / std::max(1, headlessFrames) << " ms/frame), wrote "
+           << framesWritten << " frame(s) to " << (exportFormat == EXPORT_RGBA ? "stdout" : headlessDumpDir) << std::endl;
+    if (exportFormat != EXPORT_NONE) {
+        report << "Waited " << std::setprecision(3) << exportStallSeconds << " s for encoders" << std::endl;
+    }
+    report << "Last frame: " << renderStats.drawCalls << " draw calls, "
+           << renderStats.vertices << " vertices" << std::endl;
+    return 0;
 }
 
 int main(int argc, char** argv) {
+    unsigned int randomSeed = static_cast<unsigned int>(time(nullptr));
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--headless") headlessMode = true;                   // No window; render offscreen and dump frames
+        else if (arg == "--export" && i + 1 < argc) {                   // Capture every frame: png or rgba
+            std::string format = argv[++i];
+            exportFormat = format == "rgba" ? EXPORT_RGBA : EXPORT_PNG;
+            headlessMode = true;
+        }
+        else if (arg == "--export-threads" && i + 1 < argc) exportThreads = std::max(0, atoi(argv[++i]));
+        else if (arg == "--seed" && i + 1 < argc) randomSeed = static_cast<unsigned int>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--frames" && i + 1 < argc) headlessFrames = std::max(1, atoi(argv[++i]));
+        else if (arg == "--fps" && i + 1 < argc) headlessFps = std::max(1, atoi(argv[++i]));
+        else if (arg == "--sim-hz" && i + 1 < argc) simTickRate = std::max(1, atoi(argv[++i]));
+        else if (arg == "--max-fps" && i + 1 < argc) maxFps = std::max(0, atoi(argv[++i]));
+        else if (arg == "--no-vsync") vsyncEnabled = false;              // Swap as soon as a frame is done
+        else if (arg == "--no-interpolation") simInterpolation = false;  // Draw the latest tick, not a blend
+        else if (arg == "--no-sim-thread") simThreadEnabled = false;    // Run the ticks inside idle()
+        else if (arg == "--sim-thread") forceSimThread = true;          // Also use the thread when headless
+        else if (arg == "--dump-every" && i + 1 < argc) headlessDumpEvery = std::max(0, atoi(argv[++i]));
+        else if (arg == "--dump-dir" && i + 1 < argc) headlessDumpDir = argv[++i];
+        else if (arg == "--size" && i + 1 < argc) {                     // Window or frame size, WxH
+            int w = 0, h = 0;
+            if (sscanf(argv[++i], "%dx%d", &w, &h) == 2 && w > 0 && h > 0) { winW = w; winH = h; }
+        }
+        else if (arg == "--immediate") forceImmediateMode = true;  // Skip the batched GL 3.3 renderer
+        else if (arg == "--software") forceSoftwareMode = true;       // Rasterize on the CPU, no GL drawing
+        else if (arg == "--split-view") splitView = true;                // Wide shot plus two close-ups
+        else if (arg == "--dynamic-res") dynamicResolution = true;      // Scale the scene to fit --target-ms
+        else if (arg == "--min-scale" && i + 1 < argc) dynamicResMinScale = std::max(0.1f, std::min(2.0f, static_cast<float>(atof(argv[++i]))));
+        else if (arg == "--max-scale" && i + 1 < argc) dynamicResMaxScale = std::max(0.1f, std::min(2.0f, static_cast<float>(atof(argv[++i]))));
+        else if (arg == "--target-ms" && i + 1 < argc) dynamicResTargetMs = std::max(0.1f, static_cast<float>(atof(argv[++i])));
+        else if (arg == "--job-threads" && i + 1 < argc) jobThreads = std::max(0, atoi(argv[++i]));
+        else if (arg == "--job-grain" && i + 1 < argc) jobGrain = static_cast<size_t>(std::max(1, atoi(argv[++i])));
+        else if (arg == "--no-layer-cache") disableLayerCache = true;  // Redraw static layers every frame
+        else if (arg == "--no-circle-lod") circleLodEnabled = false;    // Use the fixed per-call segment counts
+        else if (arg == "--no-instancing") disablePropInstancing = true; // Draw repeated props one by one
+        else if (arg == "--no-crowd-sprites") disableCrowdSprites = true; // Draw each person from geometry
+        else if (arg == "--no-crowd-avoidance") crowdAvoidance = false;  // People walk through each other
+        else if (arg == "--no-flow-field") flowFieldNavigation = false;  // People walk straight along the road
+        else if (arg == "--no-text-cache") disableTextCache = true;    // Call GLUT for every glyph every frame
+        else if (arg == "--hud") showStatsHud = true;                   // Frame rate and draw-call overlay
+        else if (arg == "--no-sdf-effects") disableSdfEffects = true;  // Stack circles for explosions and glows
+        else if (arg == "--stars" && i + 1 < argc) {                    // Starfield size
+            starCount = std::max(0, std::min(MAX_STARS, atoi(argv[++i])));
+        }
+        else if (arg == "--star-seed" && i + 1 < argc) {                // Starfield layout
+            starSeed = static_cast<unsigned int>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--people" && i + 1 < argc) {                   // Crowd size
+            numPeople = std::max(1, std::min(MAX_PEOPLE, atoi(argv[++i])));
+        }
+        else if (arg == "--debris" && i + 1 < argc) {                   // Particles in the impact burst
+            debrisCount = std::max(0, std::min(static_cast<int>(MAX_PARTICLES), atoi(argv[++i])));
+        }
+        else if (arg == "--sparks" && i + 1 < argc) {                   // Sparks per firework burst
+            fireworkSparks = std::max(1, std::min(MAX_SPARKS, atoi(argv[++i])));
+        }
+        else if (arg == "--salvo" && i + 1 < argc) {                    // Missiles per salvo
+            salvoSize = std::max(1, std::min(MAX_MISSILES, atoi(argv[++i])));
+        }
+        else if (arg == "--smoke-rate" && i + 1 < argc) smokeRate = std::max(0, atoi(argv[++i]));
+        else if (arg == "--exhaust-rate" && i + 1 < argc) exhaustRate = std::max(0, atoi(argv[++i]));
+    }
+
     // Seed random number generator for debris effects
-    srand(static_cast<unsigned int>(time(nullptr)));
+    srand(randomSeed);
+    simThreadSeed = randomSeed;
     
-    glutInit(&argc, argv);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA);
-    glutInitWindowSize(winW, winH);
-    glutCreateWindow("DIU and City University Scene");
+    if (headlessMode) {
+        if (!forceSoftwareMode && !createHeadlessContext()) {
+            std::cerr << "--headless needs an EGL surfaceless context (Mesa on Linux)" << std::endl;
+            return 1;
+        }
+    } else {
+        glutInit(&argc, argv);
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA);
+        glutInitWindowSize(winW, winH);
+        glutCreateWindow("DIU and City University Scene");
+        if (vsyncEnabled) enableVsync();
+    }
+    initRenderer();
+    if (headlessMode && renderBackend != BACKEND_SOFTWARE && !createHeadlessFramebuffer()) {
+        std::cerr << "--headless could not create its offscreen framebuffer" << std::endl;
+        return 1;
+    }
+    if (dynamicResolution && !initDynamicResolution()) {
+        std::cerr << "--dynamic-res needs the batched GL 3.3 renderer, rendering at full size" << std::endl;
+        dynamicResolution = false;
+    }
+    initJobSystem();
+    initPropInstancing();
+    initCrowdSprites();
+    initStarfield();
+    sdfEffectsEnabled = renderBackend == BACKEND_BATCHED && !disableSdfEffects && initEffectRenderer();
+    initTextRenderer();
+    if (splitView && !initSplitView()) {
+        std::cerr << "--split-view needs the batched GL 3.3 renderer and the text cache" << std::endl;
+        splitView = false;
+    }
+    if (headlessMode && !forceSimThread) simThreadEnabled = false;
+    if (headlessMode) return runHeadless();
 
     glutDisplayFunc(display);
     glutReshapeFunc(reshape);